@@ -67,6 +67,8 @@ static void finalize_key(void *a, void *b)
 
 	key->new_key_aid = APP_AID_INVALID;
 
+	/* The reference held for the new key now belongs to the key */
+	mesh_crypto_key_unref(key->key);
 	memcpy(key->key, key->new_key, 16);
 }
 
@@ -85,6 +87,7 @@ static struct mesh_app_key *app_key_new(void)
 {
 	struct mesh_app_key *key = l_new(struct mesh_app_key, 1);
 
+	key->key_aid = APP_AID_INVALID;
 	key->new_key_aid = APP_AID_INVALID;
 	return key;
 }
@@ -97,6 +100,12 @@ static bool set_key(struct mesh_app_key *key, uint16_t app_idx,
 	if (!mesh_crypto_k4(key_value, &key_aid))
 		return false;
 
+	/* Only drop the references actually taken for the current values */
+	if (is_new && key->new_key_aid != APP_AID_INVALID)
+		mesh_crypto_key_unref(key->new_key);
+	else if (!is_new && key->key_aid != APP_AID_INVALID)
+		mesh_crypto_key_unref(key->key);
+
 	key_aid = KEY_ID_AKF | (key_aid << KEY_AID_SHIFT);
 	if (!is_new)
 		key->key_aid = key_aid;
@@ -104,6 +113,7 @@ static bool set_key(struct mesh_app_key *key, uint16_t app_idx,
 		key->new_key_aid = key_aid;
 
 	memcpy(is_new ? key->new_key : key->key, key_value, 16);
+	mesh_crypto_key_ref(key_value);
 
 	return true;
 }
@@ -115,6 +125,12 @@ void appkey_key_free(void *data)
 	if (!key)
 		return;
 
+	if (key->key_aid != APP_AID_INVALID)
+		mesh_crypto_key_unref(key->key);
+
+	if (key->new_key_aid != APP_AID_INVALID)
+		mesh_crypto_key_unref(key->new_key);
+
 	l_free(key);
 }
 
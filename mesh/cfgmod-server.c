@@ -761,11 +761,10 @@ static uint16_t get_composition(struct mesh_node *node, uint8_t page,
 	return len + 1;
 }
 
-static bool cfg_srv_pkt(uint16_t src, uint16_t dst, uint16_t app_idx,
-				uint16_t net_idx, const uint8_t *data,
-				uint16_t size, const void *user_data)
+static bool cfg_srv_msg(struct mesh_node *node, uint16_t src, uint16_t dst,
+				uint16_t app_idx, uint16_t net_idx,
+				const uint8_t *data, uint16_t size)
 {
-	struct mesh_node *node = (struct mesh_node *) user_data;
 	struct mesh_net *net;
 	const uint8_t *pkt = data;
 	uint32_t opcode;
@@ -1117,6 +1116,26 @@ static bool cfg_srv_pkt(uint16_t src, uint16_t dst, uint16_t app_idx,
 	return true;
 }
 
+static bool cfg_srv_pkt(uint16_t src, uint16_t dst, uint16_t app_idx,
+				uint16_t net_idx, const uint8_t *data,
+				uint16_t size, const void *user_data)
+{
+	struct mesh_node *node = (struct mesh_node *) user_data;
+	struct mesh_config *cfg = node_config_get(node);
+	bool result;
+
+	/*
+	 * Changes must be stored before they are confirmed to the client, so
+	 * a write failure turns into the status of the message that caused it.
+	 * Messages that do not change anything do not touch the disk.
+	 */
+	mesh_config_set_write_through(cfg, true);
+	result = cfg_srv_msg(node, src, dst, app_idx, net_idx, data, size);
+	mesh_config_set_write_through(cfg, false);
+
+	return result;
+}
+
 static void cfgmod_srv_unregister(void *user_data)
 {
 }
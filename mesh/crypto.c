@@ -25,12 +25,142 @@
 /* Multiply used Zero array */
 static const uint8_t zero[16] = { 0, };
 
+/*
+ * Every cipher and checksum handle is backed by an AF_ALG socket, which is
+ * expensive to set up. Keys that are used for every network PDU, such as
+ * network and application keys, are registered by their owners so that
+ * the handles are created once and then reused until the key is dropped.
+ */
+struct crypto_key {
+	uint8_t key[16];
+	unsigned int ref_cnt;
+	struct l_cipher *ecb;
+	struct l_aead_cipher *ccm4;
+	struct l_aead_cipher *ccm8;
+	struct l_checksum *cmac;
+};
+
+static struct l_queue *crypto_keys;
+
+static bool match_crypto_key(const void *a, const void *b)
+{
+	const struct crypto_key *ckey = a;
+
+	return !memcmp(ckey->key, b, sizeof(ckey->key));
+}
+
+static struct crypto_key *crypto_key_find(const uint8_t key[16])
+{
+	return l_queue_find(crypto_keys, match_crypto_key, key);
+}
+
+static void crypto_key_free(void *data)
+{
+	struct crypto_key *ckey = data;
+
+	l_cipher_free(ckey->ecb);
+	l_aead_cipher_free(ckey->ccm4);
+	l_aead_cipher_free(ckey->ccm8);
+	l_checksum_free(ckey->cmac);
+	explicit_bzero(ckey->key, sizeof(ckey->key));
+	l_free(ckey);
+}
+
+bool mesh_crypto_key_ref(const uint8_t key[16])
+{
+	struct crypto_key *ckey = crypto_key_find(key);
+
+	if (ckey) {
+		ckey->ref_cnt++;
+		return true;
+	}
+
+	if (!crypto_keys)
+		crypto_keys = l_queue_new();
+
+	ckey = l_new(struct crypto_key, 1);
+	memcpy(ckey->key, key, sizeof(ckey->key));
+	ckey->ref_cnt = 1;
+
+	return l_queue_push_tail(crypto_keys, ckey);
+}
+
+void mesh_crypto_key_unref(const uint8_t key[16])
+{
+	struct crypto_key *ckey = crypto_key_find(key);
+
+	if (!ckey || --ckey->ref_cnt)
+		return;
+
+	l_queue_remove(crypto_keys, ckey);
+	crypto_key_free(ckey);
+
+	if (l_queue_isempty(crypto_keys)) {
+		l_queue_destroy(crypto_keys, NULL);
+		crypto_keys = NULL;
+	}
+}
+
+static struct l_cipher *crypto_key_ecb(const uint8_t key[16])
+{
+	struct crypto_key *ckey = crypto_key_find(key);
+
+	if (!ckey)
+		return NULL;
+
+	if (!ckey->ecb)
+		ckey->ecb = l_cipher_new(L_CIPHER_AES, key, 16);
+
+	return ckey->ecb;
+}
+
+static struct l_aead_cipher *crypto_key_ccm(const uint8_t key[16],
+							size_t mic_size)
+{
+	struct crypto_key *ckey;
+	struct l_aead_cipher **ccm;
+
+	if (mic_size != 4 && mic_size != 8)
+		return NULL;
+
+	ckey = crypto_key_find(key);
+	if (!ckey)
+		return NULL;
+
+	ccm = mic_size == 4 ? &ckey->ccm4 : &ckey->ccm8;
+
+	if (!*ccm)
+		*ccm = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16,
+								mic_size);
+
+	return *ccm;
+}
+
+static struct l_checksum *crypto_key_cmac(const uint8_t key[16])
+{
+	struct crypto_key *ckey = crypto_key_find(key);
+
+	if (!ckey)
+		return NULL;
+
+	if (!ckey->cmac)
+		ckey->cmac = l_checksum_new_cmac_aes(key, 16);
+	else
+		l_checksum_reset(ckey->cmac);
+
+	return ckey->cmac;
+}
+
 static bool aes_ecb_one(const uint8_t key[16], const uint8_t in[16],
 								uint8_t out[16])
 {
 	void *cipher;
 	bool result = false;
 
+	cipher = crypto_key_ecb(key);
+	if (cipher)
+		return l_cipher_encrypt(cipher, in, out, 16);
+
 	cipher = l_cipher_new(L_CIPHER_AES, key, 16);
 
 	if (cipher) {
@@ -59,6 +189,10 @@ static bool aes_cmac_one(const uint8_t key[16], const void *msg,
 	void *checksum;
 	bool result;
 
+	checksum = crypto_key_cmac(key);
+	if (checksum)
+		return aes_cmac(checksum, msg, msg_len, res);
+
 	checksum = l_checksum_new_cmac_aes(key, 16);
 	if (!checksum)
 		return false;
@@ -89,6 +223,11 @@ bool mesh_crypto_aes_ccm_encrypt(const uint8_t nonce[13], const uint8_t key[16],
 	void *cipher;
 	bool result;
 
+	cipher = crypto_key_ccm(key, mic_size);
+	if (cipher)
+		return l_aead_cipher_encrypt(cipher, msg, msg_len, aad, aad_len,
+					nonce, 13, out_msg, msg_len + mic_size);
+
 	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
 
 	result = l_aead_cipher_encrypt(cipher, msg, msg_len, aad, aad_len,
@@ -105,11 +244,13 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 				void *out_msg,
 				void *out_mic, size_t mic_size)
 {
-	void *cipher;
+	void *cipher, *cached;
 	bool result;
 	size_t out_msg_len = enc_msg_len - mic_size;
 
-	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
+	cached = crypto_key_ccm(key, mic_size);
+	cipher = cached ? : l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16,
+								mic_size);
 
 	result = l_aead_cipher_decrypt(cipher, enc_msg, enc_msg_len,
 							aad, aad_len, nonce, 13,
@@ -124,7 +265,8 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 				l_get_be64(enc_msg + enc_msg_len - mic_size);
 	}
 
-	l_aead_cipher_free(cipher);
+	if (!cached)
+		l_aead_cipher_free(cipher);
 
 	return result;
 }
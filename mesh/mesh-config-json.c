@@ -40,17 +40,22 @@
 
 #define CHECK_KEY_IDX_RANGE(x) ((x) <= 4095)
 
+/* Maximum time a configuration change may wait before hitting the disk */
+#define CONFIG_FLUSH_DELAY	500
+
 struct mesh_config {
 	json_object *jnode;
 	char *node_dir_path;
 	uint8_t uuid[16];
 	uint32_t write_seq;
 	struct timeval write_time;
-	struct l_queue *idles;
+	struct l_timeout *flush_to;
+	struct l_queue *pending;
+	bool dirty;
+	bool write_through;
 };
 
 struct write_info {
-	struct mesh_config *cfg;
 	void *user_data;
 	mesh_config_status_func_t cb;
 };
@@ -102,6 +107,8 @@ static bool save_config(json_object *jnode, const char *fname)
 
 	if (fwrite(str, sizeof(char), strlen(str), outfile) < strlen(str))
 		l_warn("Incomplete write of mesh configuration");
+	else if (fflush(outfile))
+		l_warn("Failed to flush mesh configuration");
 	else
 		result = true;
 
@@ -110,6 +117,8 @@ static bool save_config(json_object *jnode, const char *fname)
 	return result;
 }
 
+static bool mark_dirty(struct mesh_config *cfg);
+
 static bool get_int(json_object *jobj, const char *keyword, int *value)
 {
 	json_object *jvalue;
@@ -674,7 +683,7 @@ bool mesh_config_net_key_add(struct mesh_config *cfg, uint16_t idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 
 fail:
 	if (jentry)
@@ -716,7 +725,7 @@ bool mesh_config_net_key_update(struct mesh_config *cfg, uint16_t idx,
 	json_object_object_add(jentry, keyRefresh,
 				json_object_new_int(KEY_REFRESH_PHASE_ONE));
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_net_key_del(struct mesh_config *cfg, uint16_t idx)
@@ -736,7 +745,7 @@ bool mesh_config_net_key_del(struct mesh_config *cfg, uint16_t idx)
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jnode, netKeys);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_write_device_key(struct mesh_config *cfg, const uint8_t *key)
@@ -744,7 +753,7 @@ bool mesh_config_write_device_key(struct mesh_config *cfg, const uint8_t *key)
 	if (!cfg || !add_key_value(cfg->jnode, deviceKey, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_write_candidate(struct mesh_config *cfg, const uint8_t *key)
@@ -752,7 +761,7 @@ bool mesh_config_write_candidate(struct mesh_config *cfg, const uint8_t *key)
 	if (!cfg || !add_key_value(cfg->jnode, deviceCan, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_read_candidate(struct mesh_config *cfg, uint8_t *key)
@@ -779,7 +788,7 @@ bool mesh_config_finalize_candidate(struct mesh_config *cfg)
 	if (!add_key_value(cfg->jnode, deviceKey, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_write_token(struct mesh_config *cfg, const uint8_t *token)
@@ -787,7 +796,7 @@ bool mesh_config_write_token(struct mesh_config *cfg, const uint8_t *token)
 	if (!cfg || !add_u64_value(cfg->jnode, "token", token))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
@@ -830,7 +839,7 @@ bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 
 fail:
 
@@ -872,7 +881,7 @@ bool mesh_config_app_key_update(struct mesh_config *cfg, uint16_t app_idx,
 	if (!add_key_value(jentry, "key", key))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_app_key_del(struct mesh_config *cfg, uint16_t net_idx,
@@ -893,7 +902,7 @@ bool mesh_config_app_key_del(struct mesh_config *cfg, uint16_t net_idx,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jnode, appKeys);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -940,7 +949,7 @@ bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -976,7 +985,7 @@ bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, bind);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 static void free_model(void *data)
@@ -1587,7 +1596,7 @@ bool mesh_config_write_mode(struct mesh_config *cfg, const char *keyword,
 	if (!cfg || !write_mode(cfg->jnode, keyword, value))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_write_mode_ex(struct mesh_config *cfg, const char *keyword,
@@ -1635,7 +1644,7 @@ bool mesh_config_write_unicast(struct mesh_config *cfg, uint16_t unicast)
 	if (!cfg || !write_uint16_hex(cfg->jnode, unicastAddress, unicast))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
@@ -1645,7 +1654,7 @@ bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
 	if (!cfg || !write_relay_mode(cfg->jnode, mode, count, interval))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_write_mpb(struct mesh_config *cfg, uint8_t mode,
@@ -1660,7 +1669,7 @@ bool mesh_config_write_mpb(struct mesh_config *cfg, uint8_t mode,
 			return false;
 	}
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
@@ -1686,7 +1695,7 @@ bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
 	json_object_object_del(jnode, retransmit);
 	json_object_object_add(jnode, retransmit, jrtx);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 
 fail:
 	json_object_put(jrtx);
@@ -1711,7 +1720,7 @@ bool mesh_config_write_iv_index(struct mesh_config *cfg, uint32_t idx,
 	if (!write_int(jnode, "IVupdate", tmp))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 static void add_model(void *a, void *b)
@@ -1847,7 +1856,7 @@ static struct mesh_config *create_config(const char *cfg_path,
 	memcpy(cfg->uuid, uuid, 16);
 	cfg->node_dir_path = l_strdup(cfg_path);
 	cfg->write_seq = node->seq_number;
-	cfg->idles = l_queue_new();
+	cfg->pending = l_queue_new();
 	gettimeofday(&cfg->write_time, NULL);
 
 	return cfg;
@@ -2000,7 +2009,7 @@ bool mesh_config_net_key_set_phase(struct mesh_config *cfg, uint16_t idx,
 		finish_key_refresh(jnode, idx);
 	}
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mesh_config_save(cfg, true, NULL, NULL);
 }
 
 bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2063,7 +2072,7 @@ bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
 	json_object_object_add(jpub, retransmit, jrtx);
 	json_object_object_add(jmodel, publish, jpub);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 
 fail:
 	json_object_put(jpub);
@@ -2096,7 +2105,7 @@ bool mesh_config_model_pub_del(struct mesh_config *cfg, uint16_t addr,
 								publish))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 static bool del_page(json_object *jarray, uint8_t page)
@@ -2142,7 +2151,7 @@ void mesh_config_comp_page_del(struct mesh_config *cfg, uint8_t page)
 	json_object_object_get_ex(jnode, "pages", &jarray);
 
 	if (del_page(jarray, page))
-		save_config(jnode, cfg->node_dir_path);
+		mark_dirty(cfg);
 }
 
 bool mesh_config_comp_page_add(struct mesh_config *cfg, uint8_t page,
@@ -2182,7 +2191,7 @@ bool mesh_config_comp_page_add(struct mesh_config *cfg, uint8_t page,
 	json_object_array_add(jarray, jstring);
 	l_free(buf);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_sub_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2234,7 +2243,7 @@ bool mesh_config_model_sub_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2275,7 +2284,7 @@ bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, subscribe);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_sub_del_all(struct mesh_config *cfg, uint16_t addr,
@@ -2285,7 +2294,7 @@ bool mesh_config_model_sub_del_all(struct mesh_config *cfg, uint16_t addr,
 								subscribe))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2314,7 +2323,7 @@ bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, publish);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2343,7 +2352,7 @@ bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, subscribe);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
@@ -2385,8 +2394,8 @@ bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
 		elapsed_ms = elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
 
 		/*
-		 * If time since last write is zero, this means that
-		 * idle_save_config is already pending, so we don't need to do
+		 * If time since last write is zero, this means that the
+		 * configuration has just been written, so we don't need to do
 		 * anything.
 		 */
 		if (!elapsed_ms)
@@ -2416,7 +2425,7 @@ bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
 		if (!write_int(cfg->jnode, sequenceNumber, cached))
 			return false;
 
-		return mesh_config_save(cfg, false, NULL, NULL);
+		return mesh_config_save(cfg, true, NULL, NULL);
 	}
 
 	return true;
@@ -2427,7 +2436,7 @@ bool mesh_config_write_ttl(struct mesh_config *cfg, uint8_t ttl)
 	if (!cfg || !write_int(cfg->jnode, defaultTTL, ttl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
@@ -2435,7 +2444,7 @@ bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "cid", cid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
@@ -2443,7 +2452,7 @@ bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "pid", pid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
@@ -2451,7 +2460,7 @@ bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "vid", vid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
@@ -2459,7 +2468,7 @@ bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "crpl", crpl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return mark_dirty(cfg);
 }
 
 static bool load_node(const char *fname, const uint8_t uuid[16],
@@ -2521,13 +2530,13 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 		memcpy(cfg->uuid, uuid, 16);
 		cfg->node_dir_path = l_strdup(fname);
 		cfg->write_seq = node.seq_number;
-		cfg->idles = l_queue_new();
+		cfg->pending = l_queue_new();
 		gettimeofday(&cfg->write_time, NULL);
 
 		result = cb(&node, uuid, cfg, user_data);
 
 		if (!result) {
-			l_free(cfg->idles);
+			l_queue_destroy(cfg->pending, NULL);
 			l_free(cfg->node_dir_path);
 			l_free(cfg);
 		}
@@ -2551,42 +2560,49 @@ done:
 	return result;
 }
 
-static void release_idle(void *data)
+static void complete_write(void *data, void *user_data)
 {
-	struct l_idle *idle = data;
+	struct write_info *info = data;
+	bool result = L_PTR_TO_UINT(user_data);
 
-	l_idle_remove(idle);
+	if (info->cb)
+		info->cb(info->user_data, result);
+
+	l_free(info);
 }
 
-void mesh_config_release(struct mesh_config *cfg)
+static void complete_pending(struct mesh_config *cfg, bool result)
 {
-	if (!cfg)
-		return;
-
-	l_queue_destroy(cfg->idles, release_idle);
+	struct l_queue *pending = cfg->pending;
 
-	l_free(cfg->node_dir_path);
-	json_object_put(cfg->jnode);
-	l_free(cfg);
+	/* Callbacks may queue further writes */
+	cfg->pending = l_queue_new();
+	l_queue_foreach(pending, complete_write, L_UINT_TO_PTR(result));
+	l_queue_destroy(pending, NULL);
 }
 
-static void idle_save_config(struct l_idle *idle, void *user_data)
+/* Atomically replaces the node configuration with the in-memory state */
+static bool write_config(struct mesh_config *cfg)
 {
-	struct write_info *info = user_data;
 	char *fname_tmp, *fname_bak, *fname_cfg;
 	bool result = false;
 
-	fname_cfg = info->cfg->node_dir_path;
+	l_timeout_remove(cfg->flush_to);
+	cfg->flush_to = NULL;
+	cfg->dirty = false;
+
+	fname_cfg = cfg->node_dir_path;
 	fname_tmp = l_strdup_printf("%s%s", fname_cfg, tmp_ext);
 	fname_bak = l_strdup_printf("%s%s", fname_cfg, bak_ext);
 	remove(fname_tmp);
 
-	result = save_config(info->cfg->jnode, fname_tmp);
+	result = save_config(cfg->jnode, fname_tmp);
 
 	if (result) {
 		remove(fname_bak);
 
-		if (rename(fname_cfg, fname_bak) < 0 ||
+		/* A newly created node has nothing to back up yet */
+		if ((rename(fname_cfg, fname_bak) < 0 && errno != ENOENT) ||
 					rename(fname_tmp, fname_cfg) < 0)
 			result = false;
 	}
@@ -2596,18 +2612,73 @@ static void idle_save_config(struct l_idle *idle, void *user_data)
 	l_free(fname_tmp);
 	l_free(fname_bak);
 
-	gettimeofday(&info->cfg->write_time, NULL);
+	gettimeofday(&cfg->write_time, NULL);
 
-	if (info->cb)
-		info->cb(info->user_data, result);
+	/* Keep the changes around so that the next write retries them */
+	if (!result)
+		cfg->dirty = true;
 
-	if (idle) {
-		l_queue_remove(info->cfg->idles, idle);
-		l_idle_remove(idle);
-	}
+	complete_pending(cfg, result);
 
-	l_free(info);
+	return result;
+}
+
+static void flush_config(struct l_timeout *timeout, void *user_data)
+{
+	if (!write_config(user_data))
+		l_error("Failed to write mesh configuration");
+}
+
+/*
+ * Changes are batched: the first modification arms a timer, and everything
+ * that changes until it fires is written out in a single pass. Keys, the
+ * unicast address, the IV Index and the sequence number cache must never be
+ * lost in a crash, so they are written right away with mesh_config_save().
+ * In write-through mode every change is written before returning, and a
+ * failed write is reported to the caller.
+ */
+static bool mark_dirty(struct mesh_config *cfg)
+{
+	cfg->dirty = true;
 
+	if (cfg->write_through)
+		return write_config(cfg);
+
+	if (!cfg->flush_to)
+		cfg->flush_to = l_timeout_create_ms(CONFIG_FLUSH_DELAY,
+						flush_config, cfg, NULL);
+
+	return true;
+}
+
+bool mesh_config_sync(struct mesh_config *cfg)
+{
+	if (!cfg)
+		return false;
+
+	if (!cfg->dirty)
+		return true;
+
+	return write_config(cfg);
+}
+
+void mesh_config_set_write_through(struct mesh_config *cfg, bool enable)
+{
+	if (cfg)
+		cfg->write_through = enable;
+}
+
+void mesh_config_release(struct mesh_config *cfg)
+{
+	if (!cfg)
+		return;
+
+	mesh_config_sync(cfg);
+	l_queue_destroy(cfg->pending, l_free);
+
+	l_free(cfg->node_dir_path);
+	json_object_put(cfg->jnode);
+	l_free(cfg);
 }
 
 bool mesh_config_save(struct mesh_config *cfg, bool no_wait,
@@ -2618,21 +2689,17 @@ bool mesh_config_save(struct mesh_config *cfg, bool no_wait,
 	if (!cfg)
 		return false;
 
-	info = l_new(struct write_info, 1);
-	info->cfg = cfg;
-	info->cb = cb;
-	info->user_data = user_data;
-
-	if (no_wait) {
-		idle_save_config(NULL, info);
-	} else {
-		struct l_idle *idle;
-
-		idle = l_idle_create(idle_save_config, info, NULL);
-		l_queue_push_tail(cfg->idles, idle);
+	if (cb) {
+		info = l_new(struct write_info, 1);
+		info->cb = cb;
+		info->user_data = user_data;
+		l_queue_push_tail(cfg->pending, info);
 	}
 
-	return true;
+	if (no_wait)
+		return write_config(cfg);
+
+	return mark_dirty(cfg);
 }
 
 bool mesh_config_load_nodes(const char *cfgdir_name, mesh_config_node_func_t cb,
@@ -2702,6 +2769,12 @@ void mesh_config_destroy_nvm(struct mesh_config *cfg)
 	if (!cfg)
 		return;
 
+	/* Nothing left to write once the node is gone */
+	l_timeout_remove(cfg->flush_to);
+	cfg->flush_to = NULL;
+	cfg->dirty = false;
+	complete_pending(cfg, false);
+
 	node_dir = dirname(cfg->node_dir_path);
 	l_debug("Delete node config %s", node_dir);
 
@@ -39,6 +39,9 @@
 #define DEFAULT_CRPL 100
 #define DEFAULT_FRIEND_QUEUE_SZ 32
 
+#define DEFAULT_RPL_SYNC_INTERVAL	1000
+#define DEFAULT_RPL_SYNC_ENTRIES	32
+
 #define DEFAULT_ALGORITHMS 0x0001
 
 struct scan_filter {
@@ -52,6 +55,8 @@ struct bt_mesh {
 	prov_rx_cb_t prov_rx;
 	void *prov_data;
 	uint32_t prov_timeout;
+	uint32_t rpl_sync_interval;
+	uint32_t rpl_sync_entries;
 	bool beacon_enabled;
 	bool friend_support;
 	bool relay_support;
@@ -81,6 +86,8 @@ struct mesh_init_request {
 static struct bt_mesh mesh = {
 	.algorithms = DEFAULT_ALGORITHMS,
 	.prov_timeout = DEFAULT_PROV_TIMEOUT,
+	.rpl_sync_interval = DEFAULT_RPL_SYNC_INTERVAL,
+	.rpl_sync_entries = DEFAULT_RPL_SYNC_ENTRIES,
 	.beacon_enabled = true,
 	.friend_support = true,
 	.relay_support = true,
@@ -207,6 +214,16 @@ uint8_t mesh_get_friend_queue_size(void)
 	return mesh.friend_queue_sz;
 }
 
+uint32_t mesh_get_rpl_sync_interval(void)
+{
+	return mesh.rpl_sync_interval;
+}
+
+uint32_t mesh_get_rpl_sync_entries(void)
+{
+	return mesh.rpl_sync_entries;
+}
+
 static void parse_settings(const char *mesh_conf_fname)
 {
 	struct l_settings *settings;
@@ -249,6 +266,14 @@ static void parse_settings(const char *mesh_conf_fname)
 	if (l_settings_get_uint(settings, "General", "ProvTimeout", &value))
 		mesh.prov_timeout = value;
 
+	if (l_settings_get_uint(settings, "General", "RPLSyncInterval", &value)
+							&& value <= 60000)
+		mesh.rpl_sync_interval = value;
+
+	if (l_settings_get_uint(settings, "General", "RPLSyncEntries", &value)
+								&& value)
+		mesh.rpl_sync_entries = value;
+
 done:
 	l_settings_free(settings);
 }
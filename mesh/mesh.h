@@ -43,3 +43,5 @@ bool mesh_relay_supported(void);
 bool mesh_friendship_supported(void);
 uint16_t mesh_get_crpl(void);
 uint8_t mesh_get_friend_queue_size(void);
+uint32_t mesh_get_rpl_sync_interval(void);
+uint32_t mesh_get_rpl_sync_entries(void);
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ell/ell.h>
+
+#include "mesh/msg-cache.h"
+
+/* Marks an unused slot in the hash table */
+#define CACHE_SLOT_FREE	0xffff
+
+struct cache_entry {
+	uint64_t key;
+	uint32_t ext;
+};
+
+/*
+ * Fixed size duplicate cache: entries live in a FIFO ring, and an open
+ * addressing hash table with twice as many slots indexes into the ring.
+ * Nothing is allocated once the cache has been created.
+ */
+struct msg_cache {
+	struct cache_entry *ring;
+	uint16_t *slots;
+	uint16_t size;
+	uint16_t mask;
+	uint16_t head;
+	uint16_t count;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+};
+
+struct msg_cache *msg_cache_new(uint16_t size)
+{
+	struct msg_cache *cache = l_new(struct msg_cache, 1);
+	unsigned int slots = 1;
+
+	while (slots < 2 * size)
+		slots <<= 1;
+
+	cache->ring = l_new(struct cache_entry, size);
+	cache->slots = l_malloc(slots * sizeof(*cache->slots));
+	memset(cache->slots, 0xff, slots * sizeof(*cache->slots));
+	cache->size = size;
+	cache->mask = slots - 1;
+
+	return cache;
+}
+
+void msg_cache_clear(struct msg_cache *cache)
+{
+	if (!cache)
+		return;
+
+	memset(cache->slots, 0xff, (cache->mask + 1) * sizeof(*cache->slots));
+	cache->head = 0;
+	cache->count = 0;
+}
+
+void msg_cache_free(struct msg_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_free(cache->ring);
+	l_free(cache->slots);
+	l_free(cache);
+}
+
+static uint16_t msg_cache_hash(struct msg_cache *cache, uint64_t key,
+								uint32_t ext)
+{
+	key ^= (uint64_t) ext << 13;
+	key *= 0x9e3779b97f4a7c15ULL;
+
+	return (key >> 40) & cache->mask;
+}
+
+static bool msg_cache_match(struct msg_cache *cache, uint16_t idx,
+						uint64_t key, uint32_t ext)
+{
+	const struct cache_entry *entry = &cache->ring[idx];
+
+	return entry->key == key && entry->ext == ext;
+}
+
+static void msg_cache_unlink(struct msg_cache *cache, uint16_t idx)
+{
+	const struct cache_entry *entry = &cache->ring[idx];
+	uint16_t i, j, home;
+
+	i = msg_cache_hash(cache, entry->key, entry->ext);
+
+	while (cache->slots[i] != idx)
+		i = (i + 1) & cache->mask;
+
+	/* Backward shift deletion keeps probe sequences unbroken */
+	j = i;
+
+	while (true) {
+		j = (j + 1) & cache->mask;
+
+		if (cache->slots[j] == CACHE_SLOT_FREE)
+			break;
+
+		entry = &cache->ring[cache->slots[j]];
+		home = msg_cache_hash(cache, entry->key, entry->ext);
+
+		if (((j - home) & cache->mask) < ((j - i) & cache->mask))
+			continue;
+
+		cache->slots[i] = cache->slots[j];
+		i = j;
+	}
+
+	cache->slots[i] = CACHE_SLOT_FREE;
+}
+
+/* Returns true if the entry was already cached, otherwise adds it */
+bool msg_cache_check(struct msg_cache *cache, uint64_t key,
+								uint32_t ext)
+{
+	struct cache_entry *entry;
+	uint16_t i, idx;
+
+	i = msg_cache_hash(cache, key, ext);
+
+	while (cache->slots[i] != CACHE_SLOT_FREE) {
+		if (msg_cache_match(cache, cache->slots[i], key, ext)) {
+			cache->hits++;
+			return true;
+		}
+
+		i = (i + 1) & cache->mask;
+	}
+
+	cache->misses++;
+
+	/* Oldest entry is in the slot that is about to be reused */
+	idx = cache->head;
+
+	if (cache->count == cache->size) {
+		msg_cache_unlink(cache, idx);
+		cache->evictions++;
+
+		/* Unlinking may have moved the free slot found above */
+		i = msg_cache_hash(cache, key, ext);
+
+		while (cache->slots[i] != CACHE_SLOT_FREE)
+			i = (i + 1) & cache->mask;
+	} else
+		cache->count++;
+
+	entry = &cache->ring[idx];
+	entry->key = key;
+	entry->ext = ext;
+	cache->slots[i] = idx;
+	cache->head = (idx + 1) % cache->size;
+
+	return false;
+}
+
+void msg_cache_stats(const char *name, struct msg_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_debug("%s cache: %u hits, %u misses, %u evictions", name,
+				cache->hits, cache->misses, cache->evictions);
+}
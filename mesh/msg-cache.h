@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+struct msg_cache;
+
+struct msg_cache *msg_cache_new(uint16_t size);
+void msg_cache_free(struct msg_cache *cache);
+void msg_cache_clear(struct msg_cache *cache);
+bool msg_cache_check(struct msg_cache *cache, uint64_t key, uint32_t ext);
+void msg_cache_stats(const char *name, struct msg_cache *cache);
@@ -71,17 +71,34 @@ struct net_key {
 	bool ivu;
 };
 
+/* Number of distinct values of the 7-bit NID */
+#define NID_BUCKETS	128
+
+/*
+ * To avoid re-decrypting the same packet for multiple nodes, or when it
+ * is heard again from another relay, recently decrypted packets are cached
+ */
+#define DECRYPT_CACHE_MAX	8
+
+struct decrypt_cache {
+	uint8_t pkt[MESH_NET_MAX_PDU_LEN];
+	uint8_t plain[MESH_NET_MAX_PDU_LEN];
+	size_t len;
+	uint32_t hash;
+	uint32_t id;
+	uint32_t iv_index;
+};
+
 static struct l_queue *beacons;
 static struct l_queue *keys;
+static struct l_queue *nid_keys[NID_BUCKETS];
 static uint32_t last_flooding_id;
 
-/* To avoid re-decrypting same packet for multiple nodes, cache and check */
-static uint8_t cache_pkt[MESH_NET_MAX_PDU_LEN];
-static uint8_t cache_plain[MESH_NET_MAX_PDU_LEN];
-static size_t cache_len;
-static size_t cache_plainlen;
-static uint32_t cache_id;
-static uint32_t cache_iv_index;
+static struct decrypt_cache decrypt_cache[DECRYPT_CACHE_MAX];
+static unsigned int decrypt_cache_next;
+
+/* Decryption is attempted here so only successes take a cache slot */
+static struct decrypt_cache decrypt_scratch;
 
 static bool match_flooding(const void *a, const void *b)
 {
@@ -106,6 +123,62 @@ static bool match_network(const void *a, const void *b)
 	return memcmp(key->net_id, net_id, sizeof(key->net_id)) == 0;
 }
 
+static void key_crypto_ref(struct net_key *key)
+{
+	mesh_crypto_key_ref(key->enc_key);
+	mesh_crypto_key_ref(key->prv_key);
+
+	if (key->friend_key)
+		return;
+
+	mesh_crypto_key_ref(key->snb_key);
+	mesh_crypto_key_ref(key->pvt_key);
+}
+
+static void key_crypto_unref(struct net_key *key)
+{
+	mesh_crypto_key_unref(key->enc_key);
+	mesh_crypto_key_unref(key->prv_key);
+
+	if (key->friend_key)
+		return;
+
+	mesh_crypto_key_unref(key->snb_key);
+	mesh_crypto_key_unref(key->pvt_key);
+}
+
+static void key_index(struct net_key *key)
+{
+	struct l_queue **bucket = &nid_keys[key->nid & 0x7f];
+
+	if (!*bucket)
+		*bucket = l_queue_new();
+
+	/* Friendship credentials take precedence over flooding ones */
+	if (key->friend_key)
+		l_queue_push_head(*bucket, key);
+	else
+		l_queue_push_tail(*bucket, key);
+}
+
+static void key_unindex(struct net_key *key)
+{
+	struct l_queue **bucket = &nid_keys[key->nid & 0x7f];
+	unsigned int i;
+
+	l_queue_remove(*bucket, key);
+
+	if (l_queue_isempty(*bucket)) {
+		l_queue_destroy(*bucket, NULL);
+		*bucket = NULL;
+	}
+
+	for (i = 0; i < DECRYPT_CACHE_MAX; i++) {
+		if (decrypt_cache[i].id == key->id)
+			decrypt_cache[i].id = 0;
+	}
+}
+
 /* Key added from Provisioning, NetKey Add or NetKey update */
 uint32_t net_key_add(const uint8_t flooding[16])
 {
@@ -145,8 +218,11 @@ uint32_t net_key_add(const uint8_t flooding[16])
 	if (!result)
 		goto fail;
 
+	key_crypto_ref(key);
+
 	key->id = ++last_flooding_id;
 	l_queue_push_tail(keys, key);
+	key_index(key);
 	return key->id;
 
 fail:
@@ -183,8 +259,10 @@ uint32_t net_key_frnd_add(uint32_t flooding_id, uint16_t lpn, uint16_t frnd,
 
 	frnd_key->friend_key = true;
 	frnd_key->ref_cnt++;
+	key_crypto_ref(frnd_key);
 	frnd_key->id = ++last_flooding_id;
 	l_queue_push_head(keys, frnd_key);
+	key_index(frnd_key);
 
 	return frnd_key->id;
 }
@@ -197,6 +275,8 @@ void net_key_unref(uint32_t id)
 		if (--key->ref_cnt == 0) {
 			l_timeout_remove(key->observe.timeout);
 			l_queue_remove(keys, key);
+			key_unindex(key);
+			key_crypto_unref(key);
 			l_free(key);
 		}
 	}
@@ -224,51 +304,95 @@ bool net_key_retrieve(uint32_t id, uint8_t *flooding)
 	return false;
 }
 
-static void decrypt_net_pkt(void *a, void *b)
+static uint32_t pkt_hash(const uint8_t *pkt, size_t len)
 {
-	const struct net_key *key = a;
-	bool result;
+	uint32_t hash = 2166136261u;
+	size_t i;
 
-	if (cache_id || !key->ref_cnt || (cache_pkt[0] & 0x7f) != key->nid)
-		return;
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= pkt[i];
+		hash *= 16777619u;
+	}
 
-	result = mesh_crypto_packet_decode(cache_pkt, cache_len, false,
-						cache_plain, cache_iv_index,
-						key->enc_key, key->prv_key);
+	return hash;
+}
+
+static struct decrypt_cache *decrypt_cache_find(const uint8_t *pkt,
+						size_t len, uint32_t hash)
+{
+	unsigned int i;
 
-	if (result) {
-		cache_id = key->id;
-		cache_plainlen = cache_len;
+	for (i = 0; i < DECRYPT_CACHE_MAX; i++) {
+		struct decrypt_cache *entry = &decrypt_cache[i];
+
+		if (entry->id && entry->hash == hash && entry->len == len &&
+						!memcmp(entry->pkt, pkt, len))
+			return entry;
 	}
+
+	return NULL;
+}
+
+static bool decrypt_net_pkt(const void *a, const void *b)
+{
+	const struct net_key *key = a;
+	struct decrypt_cache *entry = (struct decrypt_cache *) b;
+
+	if (!key->ref_cnt)
+		return false;
+
+	return mesh_crypto_packet_decode(entry->pkt, entry->len, false,
+						entry->plain, entry->iv_index,
+						key->enc_key, key->prv_key);
 }
 
 uint32_t net_key_decrypt(uint32_t iv_index, const uint8_t *pkt, size_t len,
 					uint8_t **plain, size_t *plain_len)
 {
+	struct decrypt_cache *entry;
+	const struct net_key *key;
+	uint32_t hash;
+
+	if (!len || len > MESH_NET_MAX_PDU_LEN)
+		return 0;
+
+	hash = pkt_hash(pkt, len);
+
 	/* If we already successfully decrypted this packet, use cached data */
-	if (cache_id && cache_len == len && !memcmp(pkt, cache_pkt, len)) {
+	entry = decrypt_cache_find(pkt, len, hash);
+	if (entry) {
 		/* IV Index must match what was used to decrypt */
-		if (cache_iv_index != iv_index)
+		if (entry->iv_index != iv_index)
 			return 0;
 
 		goto done;
 	}
 
-	cache_id = 0;
-	memcpy(cache_pkt, pkt, len);
-	cache_len = len;
-	cache_iv_index = iv_index;
+	memcpy(decrypt_scratch.pkt, pkt, len);
+	decrypt_scratch.len = len;
+	decrypt_scratch.hash = hash;
+	decrypt_scratch.iv_index = iv_index;
+
+	/* Only try the network keys whose NID matches */
+	key = l_queue_find(nid_keys[pkt[0] & 0x7f], decrypt_net_pkt,
+							&decrypt_scratch);
+	if (!key)
+		return 0;
+
+	decrypt_scratch.id = key->id;
 
-	/* Try all network keys known to us */
-	l_queue_foreach(keys, decrypt_net_pkt, NULL);
+	/* Replace the oldest entry only once the packet was decrypted */
+	entry = &decrypt_cache[decrypt_cache_next];
+	*entry = decrypt_scratch;
+
+	decrypt_cache_next = (decrypt_cache_next + 1) % DECRYPT_CACHE_MAX;
 
 done:
-	if (cache_id) {
-		*plain = cache_plain;
-		*plain_len = cache_plainlen;
-	}
+	*plain = entry->plain;
+	*plain_len = entry->len;
 
-	return cache_id;
+	return entry->id;
 }
 
 bool net_key_encrypt(uint32_t id, uint32_t iv_index, uint8_t *pkt, size_t len)
@@ -785,6 +909,7 @@ static void free_key(void *data)
 	struct net_key *key = data;
 
 	l_timeout_remove(key->mpb_to);
+	key_crypto_unref(key);
 	l_free(key->snb);
 	l_free(key->mpb);
 	l_free(key);
@@ -792,6 +917,16 @@ static void free_key(void *data)
 
 void net_key_cleanup(void)
 {
+	unsigned int i;
+
+	for (i = 0; i < NID_BUCKETS; i++) {
+		l_queue_destroy(nid_keys[i], NULL);
+		nid_keys[i] = NULL;
+	}
+
+	memset(decrypt_cache, 0, sizeof(decrypt_cache));
+	decrypt_cache_next = 0;
+
 	l_queue_destroy(keys, free_key);
 	keys = NULL;
 	l_queue_destroy(beacons, l_free);
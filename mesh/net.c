@@ -33,6 +33,7 @@
 #include "mesh/model.h"
 #include "mesh/appkey.h"
 #include "mesh/rpl.h"
+#include "mesh/msg-cache.h"
 
 #define abs_diff(a, b) ((a) > (b) ? (a) - (b) : (b) - (a))
 
@@ -129,7 +130,7 @@ struct mesh_net {
 	uint16_t features;
 
 	struct l_queue *subnets;
-	struct l_queue *msg_cache;
+	struct msg_cache *msg_cache;
 	struct l_queue *replay_cache;
 	struct l_queue *sar_in;
 	struct l_queue *sar_out;
@@ -140,12 +141,6 @@ struct mesh_net {
 	struct l_queue *destinations;
 };
 
-struct mesh_msg {
-	uint16_t src;
-	uint32_t seq;
-	uint32_t mic;
-};
-
 struct mesh_sar {
 	unsigned int id;
 	struct l_timeout *seg_timeout;
@@ -206,7 +201,7 @@ struct net_beacon_data {
 	bool local;
 };
 
-static struct l_queue *fast_cache;
+static struct msg_cache *fast_cache;
 static struct l_queue *nets;
 
 static void net_rx(void *net_ptr, void *user_data);
@@ -626,7 +621,7 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 	net->tx_interval = DEFAULT_TRANSMIT_INTERVAL;
 
 	net->subnets = l_queue_new();
-	net->msg_cache = l_queue_new();
+	net->msg_cache = msg_cache_new(MSG_CACHE_SIZE);
 	net->sar_in = l_queue_new();
 	net->sar_out = l_queue_new();
 	net->sar_queue = l_queue_new();
@@ -639,7 +634,7 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 		nets = l_queue_new();
 
 	if (!fast_cache)
-		fast_cache = l_queue_new();
+		fast_cache = msg_cache_new(FAST_CACHE_SIZE);
 
 	return net;
 }
@@ -652,7 +647,8 @@ void mesh_net_free(void *user_data)
 		return;
 
 	l_queue_destroy(net->subnets, subnet_free);
-	l_queue_destroy(net->msg_cache, l_free);
+	msg_cache_stats("Message", net->msg_cache);
+	msg_cache_free(net->msg_cache);
 	l_queue_destroy(net->replay_cache, l_free);
 	l_queue_destroy(net->sar_in, mesh_sar_free);
 	l_queue_destroy(net->sar_out, mesh_sar_free);
@@ -668,7 +664,8 @@ void mesh_net_free(void *user_data)
 
 void mesh_net_cleanup(void)
 {
-	l_queue_destroy(fast_cache, l_free);
+	msg_cache_stats("Fast", fast_cache);
+	msg_cache_free(fast_cache);
 	fast_cache = NULL;
 	l_queue_destroy(nets, mesh_net_free);
 	nets = NULL;
@@ -1017,50 +1014,18 @@ void mesh_net_set_frnd_seq(struct mesh_net *net, bool seq)
 	net->friend_seq = seq;
 }
 
-static bool match_cache(const void *a, const void *b)
-{
-	const struct mesh_msg *msg = a;
-	const struct mesh_msg *tst = b;
-
-	if (msg->seq != tst->seq || msg->mic != tst->mic ||
-					msg->src != tst->src)
-		return false;
-
-	return true;
-}
-
 static bool msg_in_cache(struct mesh_net *net, uint16_t src, uint32_t seq,
 								uint32_t mic)
 {
-	struct mesh_msg *msg;
-	struct mesh_msg tst = {
-		.src = src,
-		.seq = seq,
-		.mic = mic,
-	};
-
-	msg = l_queue_find(net->msg_cache, match_cache, &tst);
-
-	if (msg) {
+	if (msg_cache_check(net->msg_cache, ((uint64_t) seq << 32) | mic,
+									src)) {
 		l_debug("Suppressing duplicate %4.4x + %6.6x + %8.8x",
 							src, seq, mic);
 		return true;
 	}
 
-	msg = l_new(struct mesh_msg, 1);
-	*msg = tst;
-	l_queue_push_head(net->msg_cache, msg);
 	l_debug("Add %4.4x + %6.6x + %8.8x", src, seq, mic);
 
-	if (l_queue_length(net->msg_cache) > MSG_CACHE_SIZE) {
-		msg = l_queue_peek_tail(net->msg_cache);
-		/* Remove Tail (oldest msg in cache) */
-		l_debug("Remove %4.4x + %6.6x + %8.8x",
-						msg->src, msg->seq, msg->mic);
-		if (l_queue_remove(net->msg_cache, msg))
-			l_free(msg);
-	}
-
 	return false;
 }
 
@@ -2195,31 +2160,9 @@ static bool ctl_received(struct mesh_net *net, uint32_t net_key_id,
 	return true;
 }
 
-static bool find_fast_hash(const void *a, const void *b)
-{
-	const uint64_t *entry = a;
-	const uint64_t *test = b;
-
-	return *entry == *test;
-}
-
 static bool check_fast_cache(uint64_t hash)
 {
-	void *found = l_queue_find(fast_cache, find_fast_hash, &hash);
-	uint64_t *new_hash;
-
-	if (found)
-		return false;
-
-	if (l_queue_length(fast_cache) >= FAST_CACHE_SIZE)
-		new_hash = l_queue_pop_head(fast_cache);
-	else
-		new_hash = l_malloc(sizeof(hash));
-
-	*new_hash = hash;
-	l_queue_push_tail(fast_cache, new_hash);
-
-	return true;
+	return !msg_cache_check(fast_cache, hash, 0);
 }
 
 static bool match_by_dst(const void *a, const void *b)
@@ -2558,7 +2501,7 @@ static void iv_upd_to(struct l_timeout *upd_timeout, void *user_data)
 							net->iv_index, false);
 		l_queue_foreach(net->subnets, refresh_beacon, net);
 		queue_friend_update(net);
-		l_queue_clear(net->msg_cache, l_free);
+		msg_cache_clear(net->msg_cache);
 		break;
 
 	case IV_UPD_INIT:
@@ -2994,7 +2937,7 @@ bool mesh_net_attach(struct mesh_net *net, struct mesh_io *io)
 			nets = l_queue_new();
 
 		if (!fast_cache)
-			fast_cache = l_queue_new();
+			fast_cache = msg_cache_new(FAST_CACHE_SIZE);
 
 		mesh_io_register_recv_cb(io, snb, sizeof(snb),
 							beacon_recv, NULL);
@@ -3048,7 +2991,7 @@ bool mesh_net_iv_index_update(struct mesh_net *net)
 		return false;
 
 	l_debug("iv_upd_state = IV_UPD_UPDATING");
-	l_queue_clear(net->msg_cache, l_free);
+	msg_cache_clear(net->msg_cache);
 
 	if (!mesh_config_write_iv_index(node_config_get(net->node),
 						net->iv_index + 1, true))
@@ -303,6 +303,7 @@ static void free_node_resources(void *data)
 	mesh_agent_remove(node->agent);
 	mesh_config_release(node->cfg);
 	mesh_net_free(node->net);
+	rpl_cleanup(node);
 	l_free(node->storage_dir);
 	l_free(node);
 }
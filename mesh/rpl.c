@@ -27,109 +27,424 @@
 
 #include "mesh/mesh-defs.h"
 
+#include "mesh/mesh.h"
+#include "mesh/crypto.h"
 #include "mesh/node.h"
 #include "mesh/net.h"
 #include "mesh/util.h"
 #include "mesh/rpl.h"
 
 static const char *rpl_dir = "/rpl";
+static const char *rpl_journal = "/journal";
 
-bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
-								uint32_t seq)
+/*
+ * RPL entries are appended to a per-node journal. Each accepted entry is
+ * handed to the kernel right away with a single write(), so a restart of
+ * the daemon always sees it, while syncing to the storage device is done
+ * in groups according to the configured flush policy. The journal is
+ * compacted on IV Index updates and whenever it grows well beyond the
+ * number of live entries.
+ *
+ * A record holds the type, source, IV Index and sequence number, followed
+ * by an FCS over all of them. Replay stops at the first record that fails
+ * the check and the journal is truncated there.
+ */
+#define RPL_RECORD_PUT		0x01
+#define RPL_RECORD_DEL		0x02
+#define RPL_RECORD_LEN		12
+#define RPL_RECORD_FCS		(RPL_RECORD_LEN - 1)
+
+/* Minimum number of records before the journal is compacted */
+#define RPL_COMPACT_MIN		1024
+
+struct rpl_journal {
+	struct mesh_node *node;
+	struct l_timeout *sync_to;
+	char *path;
+	int fd;
+	unsigned int records;
+	unsigned int compact_at;
+	unsigned int pending;
+};
+
+static struct l_queue *journals;
+
+static bool match_src(const void *a, const void *b)
+{
+	const struct mesh_rpl *rpl = a;
+	uint16_t src = L_PTR_TO_UINT(b);
+
+	return rpl->src == src;
+}
+
+static bool match_node(const void *a, const void *b)
+{
+	const struct rpl_journal *journal = a;
+
+	return journal->node == b;
+}
+
+static void journal_sync(struct rpl_journal *journal)
+{
+	l_timeout_remove(journal->sync_to);
+	journal->sync_to = NULL;
+
+	if (!journal->pending)
+		return;
+
+	if (fdatasync(journal->fd) < 0)
+		l_error("Failed to sync(%d): %s", errno, journal->path);
+
+	journal->pending = 0;
+}
+
+static void journal_sync_to(struct l_timeout *timeout, void *user_data)
+{
+	journal_sync(user_data);
+}
+
+static void journal_free(void *data)
+{
+	struct rpl_journal *journal = data;
+
+	journal_sync(journal);
+	close(journal->fd);
+	l_free(journal->path);
+	l_free(journal);
+}
+
+static void journal_replay_record(const uint8_t *rec, struct l_queue *list)
+{
+	struct mesh_rpl *rpl;
+	uint16_t src = l_get_le16(rec + 1);
+	uint32_t iv_index = l_get_le32(rec + 3);
+	uint32_t seq = l_get_le32(rec + 7);
+
+	if (!IS_UNICAST(src))
+		return;
+
+	rpl = l_queue_find(list, match_src, L_UINT_TO_PTR(src));
+
+	if (rec[0] == RPL_RECORD_DEL) {
+		if (rpl) {
+			l_queue_remove(list, rpl);
+			l_free(rpl);
+		}
+
+		return;
+	}
+
+	if (seq > SEQ_MASK)
+		return;
+
+	if (!rpl) {
+		rpl = l_new(struct mesh_rpl, 1);
+		rpl->src = src;
+		l_queue_push_head(list, rpl);
+	} else if (rpl->iv_index > iv_index ||
+			(rpl->iv_index == iv_index && rpl->seq > seq)) {
+		/* Never move an entry backwards */
+		return;
+	}
+
+	rpl->iv_index = iv_index;
+	rpl->seq = seq;
+}
+
+/* Loads all journal records, dropping a torn or corrupted tail */
+static unsigned int journal_replay(struct rpl_journal *journal,
+							struct l_queue *list)
 {
+	uint8_t buf[RPL_RECORD_LEN * 64];
+	unsigned int records = 0;
+	off_t valid = 0;
+	ssize_t len;
+	ssize_t i;
+
+	if (lseek(journal->fd, 0, SEEK_SET) < 0)
+		return 0;
+
+	while ((len = read(journal->fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i + RPL_RECORD_LEN <= len; i += RPL_RECORD_LEN) {
+			if (buf[i] != RPL_RECORD_PUT &&
+						buf[i] != RPL_RECORD_DEL)
+				goto done;
+
+			if (!mesh_crypto_check_fcs(buf + i, RPL_RECORD_FCS,
+						buf[i + RPL_RECORD_FCS]))
+				goto done;
+
+			journal_replay_record(buf + i, list);
+			valid += RPL_RECORD_LEN;
+			records++;
+		}
+
+		if (i != len)
+			break;
+	}
+
+	if (len < 0) {
+		l_error("Failed to read(%d): %s", errno, journal->path);
+		return records;
+	}
+
+done:
+	if (lseek(journal->fd, 0, SEEK_END) != valid) {
+		l_warn("Truncating RPL journal: %s", journal->path);
+
+		if (ftruncate(journal->fd, valid) < 0)
+			l_error("Failed to truncate(%d): %s", errno,
+								journal->path);
+	}
+
+	return records;
+}
+
+static bool journal_write(int fd, uint8_t type, uint16_t src,
+						uint32_t iv_index, uint32_t seq)
+{
+	uint8_t rec[RPL_RECORD_LEN] = { type };
+
+	l_put_le16(src, rec + 1);
+	l_put_le32(iv_index, rec + 3);
+	l_put_le32(seq, rec + 7);
+	rec[RPL_RECORD_FCS] = mesh_crypto_compute_fcs(rec, RPL_RECORD_FCS);
+
+	return write(fd, rec, sizeof(rec)) == sizeof(rec);
+}
+
+static struct rpl_journal *journal_get(struct mesh_node *node)
+{
+	struct rpl_journal *journal;
 	const char *node_path;
-	char src_file[PATH_MAX];
-	char seq_txt[7];
-	bool result = false;
-	DIR *dir;
+	char path[PATH_MAX];
 	int fd;
 
-	if (!IS_UNICAST(src))
-		return false;
+	journal = l_queue_find(journals, match_node, node);
+	if (journal)
+		return journal;
 
 	node_path = node_get_storage_dir(node);
+	if (!node_path)
+		return NULL;
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
-		return false;
+	if (strlen(node_path) + strlen(rpl_dir) + strlen(rpl_journal) + 5 >=
+								PATH_MAX)
+		return NULL;
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x", node_path, rpl_dir,
-								iv_index);
-	dir = opendir(src_file);
+	snprintf(path, PATH_MAX, "%s%s%s", node_path, rpl_dir, rpl_journal);
 
-	if (!dir) {
-		if (mkdir(src_file, 0755) != 0)
-			l_error("Failed to create dir: %s", src_file);
-	} else
-		closedir(dir);
+	fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		l_error("Failed to open(%d): %s", errno, path);
+		return NULL;
+	}
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
+	journal = l_new(struct rpl_journal, 1);
+	journal->node = node;
+	journal->path = l_strdup(path);
+	journal->fd = fd;
+	journal->compact_at = RPL_COMPACT_MIN;
 
-	fd = open(src_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-	if (fd >= 0) {
-		snprintf(seq_txt, 7, "%6.6x", seq);
-		if (write(fd, seq_txt, 6) == 6)
-			result = true;
+	if (!journals)
+		journals = l_queue_new();
+
+	l_queue_push_tail(journals, journal);
+
+	return journal;
+}
+
+static void fsync_dir(const char *path)
+{
+	char *dir = l_strdup(path);
+	char *sep = strrchr(dir, '/');
+	int fd;
 
+	if (sep)
+		*sep = '\0';
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		fsync(fd);
 		close(fd);
 	}
 
-	if (!result)
+	l_free(dir);
+}
+
+struct compact_data {
+	int fd;
+	uint32_t cur;
+	bool all;
+	bool result;
+	unsigned int records;
+};
+
+static void compact_entry(void *a, void *b)
+{
+	struct mesh_rpl *rpl = a;
+	struct compact_data *data = b;
+
+	if (!data->result)
+		return;
+
+	/* Only the current and previous IV Index are worth keeping */
+	if (!data->all && rpl->iv_index != data->cur &&
+					rpl->iv_index != data->cur - 1)
+		return;
+
+	data->result = journal_write(data->fd, RPL_RECORD_PUT, rpl->src,
+						rpl->iv_index, rpl->seq);
+	data->records++;
+}
+
+/*
+ * Atomically replaces the journal with one record per entry of the list.
+ * The new journal reaches the storage device before it takes the place of
+ * the old one, so a crash at any point leaves a complete journal behind.
+ */
+static bool journal_compact(struct rpl_journal *journal,
+				struct l_queue *list, bool all, uint32_t cur)
+{
+	struct compact_data data = {
+		.cur = cur,
+		.all = all,
+		.result = true,
+	};
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, PATH_MAX, "%s.tmp", journal->path);
+
+	data.fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND |
+							O_CLOEXEC, 0600);
+	if (data.fd < 0) {
+		l_error("Failed to open(%d): %s", errno, path);
+		return false;
+	}
+
+	l_queue_foreach(list, compact_entry, &data);
+
+	if (!data.result || fsync(data.fd) < 0) {
+		l_error("Failed to write RPL journal: %s", path);
+		close(data.fd);
+		remove(path);
 		return false;
+	}
+
+	if (rename(path, journal->path) < 0) {
+		l_error("Failed to rename(%d): %s", errno, path);
+		close(data.fd);
+		remove(path);
+		return false;
+	}
+
+	fsync_dir(journal->path);
+
+	/* Everything in the old journal is now on disk */
+	l_timeout_remove(journal->sync_to);
+	journal->sync_to = NULL;
+	journal->pending = 0;
 
-	/* Delete RPL entry from old iv_index (if it exists) */
-	iv_index--;
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
-	if (remove(src_file) < 0 && errno != ENOENT)
-		l_error("Failed to remove(%d): %s", errno, src_file);
+	fd = journal->fd;
+	journal->fd = data.fd;
+	close(fd);
 
-	return result;
+	journal->records = data.records;
+	journal->compact_at = L_MAX(RPL_COMPACT_MIN, 2 * data.records);
+
+	return true;
 }
 
-void rpl_del_entry(struct mesh_node *node, uint16_t src)
+static void journal_compact_all(struct rpl_journal *journal)
 {
-	const char *node_path;
-	char rpl_path[PATH_MAX];
-	struct dirent *entry;
-	DIR *dir;
+	struct l_queue *list = l_queue_new();
 
-	if (!IS_UNICAST(src))
-		return;
+	journal_replay(journal, list);
+	journal_compact(journal, list, true, 0);
+	l_queue_destroy(list, l_free);
+}
 
-	node_path = node_get_storage_dir(node);
+static void journal_appended(struct rpl_journal *journal)
+{
+	unsigned int interval = mesh_get_rpl_sync_interval();
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
+	journal->records++;
+	journal->pending++;
+
+	if (journal->records >= journal->compact_at) {
+		journal_compact_all(journal);
 		return;
+	}
 
-	snprintf(rpl_path, PATH_MAX, "%s%s", node_path, rpl_dir);
-	dir = opendir(rpl_path);
+	if (!interval || journal->pending >= mesh_get_rpl_sync_entries()) {
+		journal_sync(journal);
+		return;
+	}
 
-	if (!dir)
+	if (!journal->sync_to)
+		journal->sync_to = l_timeout_create_ms(interval,
+					journal_sync_to, journal, NULL);
+}
+
+bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
+								uint32_t seq)
+{
+	struct rpl_journal *journal;
+
+	if (!IS_UNICAST(src))
+		return false;
+
+	journal = journal_get(node);
+	if (!journal)
+		return false;
+
+	if (!journal_write(journal->fd, RPL_RECORD_PUT, src, iv_index, seq)) {
+		l_error("Failed to write(%d): %s", errno, journal->path);
+		return false;
+	}
+
+	journal_appended(journal);
+
+	return true;
+}
+
+void rpl_del_entry(struct mesh_node *node, uint16_t src)
+{
+	struct rpl_journal *journal;
+
+	if (!IS_UNICAST(src))
 		return;
 
-	/* Remove all instances of src address */
-	while ((entry = readdir(dir)) != NULL) {
-		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-			snprintf(rpl_path, PATH_MAX, "%s%s/%s/%4.4x",
-					node_path, rpl_dir, entry->d_name, src);
-			if (remove(rpl_path) < 0)
-				l_error("Failed to remove(%d): %s", errno,
-								rpl_path);
-		}
+	journal = journal_get(node);
+	if (!journal)
+		return;
+
+	if (!journal_write(journal->fd, RPL_RECORD_DEL, src, 0, 0)) {
+		l_error("Failed to write(%d): %s", errno, journal->path);
+		return;
 	}
 
-	closedir(dir);
+	journal_appended(journal);
 }
 
-static bool match_src(const void *a, const void *b)
+void rpl_cleanup(struct mesh_node *node)
 {
-	const struct mesh_rpl *rpl = a;
-	uint16_t src = L_PTR_TO_UINT(b);
+	struct rpl_journal *journal;
 
-	return rpl->src == src;
+	journal = l_queue_remove_if(journals, match_node, node);
+	if (!journal)
+		return;
+
+	journal_free(journal);
+
+	if (l_queue_isempty(journals)) {
+		l_queue_destroy(journals, NULL);
+		journals = NULL;
+	}
 }
 
+/* Entries used to be stored as one file per source under IV Index dirs */
 static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 {
 	struct mesh_rpl *rpl;
@@ -195,13 +510,37 @@ static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 	closedir(dir);
 }
 
+static void del_trees(const char *node_path)
+{
+	struct dirent *entry;
+	char path[PATH_MAX];
+	DIR *dir;
+
+	snprintf(path, PATH_MAX, "%s%s", node_path, rpl_dir);
+	dir = opendir(path);
+	if (!dir)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+			snprintf(path, PATH_MAX, "%s%s/%s",
+					node_path, rpl_dir, entry->d_name);
+			del_path(path);
+		}
+	}
+
+	closedir(dir);
+}
+
 bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 {
+	struct rpl_journal *journal;
 	const char *node_path;
 	struct dirent *entry;
 	char *rpl_path;
 	size_t len;
 	DIR *dir;
+	bool legacy = false;
 
 	if (!rpl_list)
 		return false;
@@ -225,23 +564,37 @@ bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 	}
 
 	while ((entry = readdir(dir)) != NULL) {
-		/* RPL sequences are stored in files under iv_indexs */
+		/* Pick up entries from the old per-file storage format */
 		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
 			snprintf(rpl_path, len, "%s%s/%s",
 					node_path, rpl_dir, entry->d_name);
 			get_entries(rpl_path, rpl_list);
+			legacy = true;
 		}
 	}
 
 	l_free(rpl_path);
 	closedir(dir);
 
+	journal = journal_get(node);
+	if (!journal)
+		return false;
+
+	journal->records = journal_replay(journal, rpl_list);
+	journal->compact_at = L_MAX(RPL_COMPACT_MIN,
+					2 * l_queue_length(rpl_list));
+
+	/* Old entries may only go away once the journal holds them */
+	if (legacy && journal_compact(journal, rpl_list, true, 0))
+		del_trees(node_path);
+
 	return true;
 }
 
 void rpl_update(struct mesh_node *node, uint32_t cur)
 {
 	uint32_t old = cur - 1;
+	struct rpl_journal *journal;
 	const char *node_path;
 	struct dirent *entry;
 	char path[PATH_MAX];
@@ -259,6 +612,16 @@ void rpl_update(struct mesh_node *node, uint32_t cur)
 	if (mkdir(path, 0755) != 0 && errno != EEXIST)
 		l_error("Failed to create dir(%d): %s", errno, path);
 
+	/* Drop stale entries, which also flushes the journal to storage */
+	journal = journal_get(node);
+	if (journal) {
+		struct l_queue *list = l_queue_new();
+
+		journal_replay(journal, list);
+		journal_compact(journal, list, false, cur);
+		l_queue_destroy(list, l_free);
+	}
+
 	dir = opendir(path);
 	if (!dir)
 		return;
@@ -20,3 +20,4 @@ void rpl_del_entry(struct mesh_node *node, uint16_t src);
 bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list);
 void rpl_update(struct mesh_node *node, uint32_t iv_index);
 bool rpl_init(const char *node_path);
+void rpl_cleanup(struct mesh_node *node);
@@ -478,26 +478,29 @@ static struct att_conn_data *att_get_conn_data(struct packet_conn_data *conn)
 	return data;
 }
 
-static void gatt_load_db(struct gatt_db *db, const char *filename,
-						struct timespec *mtim)
+static bool gatt_load_db(struct gatt_db *db, const char *filename,
+			struct timespec *mtim,
+			int (*load)(struct gatt_db *db, const char *filename))
 {
 	struct stat st;
 
 	if (lstat(filename, &st))
-		return;
+		return false;
 
 	if (!gatt_db_isempty(db)) {
 		/* Check if file has been modified since last time */
 		if (st.st_mtim.tv_sec == mtim->tv_sec &&
 				    st.st_mtim.tv_nsec == mtim->tv_nsec)
-			return;
+			return true;
 		/* Clear db before reloading */
 		gatt_db_clear(db);
 	}
 
 	*mtim = st.st_mtim;
 
-	btd_settings_gatt_db_load(db, filename);
+	load(db, filename);
+
+	return true;
 }
 
 static void load_gatt_db(struct packet_conn_data *conn)
@@ -519,10 +522,17 @@ static void load_gatt_db(struct packet_conn_data *conn)
 	}
 
 	create_filename(filename, PATH_MAX, "/%s/attributes", local);
-	gatt_load_db(data->ldb, filename, &data->ldb_mtim);
+	gatt_load_db(data->ldb, filename, &data->ldb_mtim,
+					btd_settings_gatt_db_load);
 
-	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
-	gatt_load_db(data->rdb, filename, &data->rdb_mtim);
+	create_filename(filename, PATH_MAX, "/%s/cache/%s.gatt", local, peer);
+	if (!gatt_load_db(data->rdb, filename, &data->rdb_mtim,
+					btd_settings_gatt_cache_load)) {
+		create_filename(filename, PATH_MAX, "/%s/cache/%s", local,
+									peer);
+		gatt_load_db(data->rdb, filename, &data->rdb_mtim,
+					btd_settings_gatt_db_load);
+	}
 
 	/* If rdb cannot be loaded from file try local cache */
 	if (gatt_db_isempty(data->rdb)) {
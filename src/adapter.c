@@ -47,6 +47,7 @@
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
 #include "src/shared/timeout.h"
+#include "src/shared/stats.h"
 
 #include "btio/btio.h"
 #include "btd.h"
@@ -67,6 +68,7 @@
 #include "adv_monitor.h"
 #include "eir.h"
 #include "battery.h"
+#include "statistics.h"
 
 #define MODE_OFF		0x00
 #define MODE_CONNECTABLE	0x01
@@ -312,6 +314,10 @@ struct btd_adapter {
 	bool pincode_requested;		/* PIN requested during last bonding */
 	GSList *connections;		/* Connected devices */
 	GSList *devices;		/* Devices structure pointers */
+	GHashTable *device_index;	/* Address to list of devices */
+	GHashTable *device_aliases;	/* Previous or resolved address */
+	GHashTable *alias_keys;		/* Device to its alias address */
+	GSList *privacy_devices;	/* Devices with an IRK */
 	GSList *connect_list;		/* Devices to connect when found */
 	struct btd_device *connect_le;	/* LE device waiting to be connected */
 	sdp_list_t *services;		/* Services associated to adapter */
@@ -322,6 +328,7 @@ struct btd_adapter {
 	struct btd_adv_monitor_manager *adv_monitor_manager;
 
 	struct btd_battery_provider_manager *battery_provider_manager;
+	struct btd_statistics *statistics;
 
 	GHashTable *allowed_uuid_set;	/* Set of allowed service UUIDs */
 
@@ -600,7 +607,7 @@ static void store_adapter_info(struct btd_adapter *adapter)
 	create_file(filename, 0600);
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -1022,13 +1029,172 @@ int btd_adapter_set_name(struct btd_adapter *adapter, const char *name)
 	return set_name(adapter, name);
 }
 
+static guint bdaddr_hash(gconstpointer key)
+{
+	const bdaddr_t *bdaddr = key;
+
+	return get_le32(bdaddr->b) ^ (get_le16(bdaddr->b + 4) << 11);
+}
+
+static gboolean bdaddr_equal(gconstpointer a, gconstpointer b)
+{
+	return !bacmp(a, b);
+}
+
+static void index_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	const bdaddr_t *bdaddr = device_get_address(device);
+	gpointer key;
+	gpointer value;
+
+	if (g_hash_table_lookup_extended(adapter->device_index, bdaddr,
+							&key, &value))
+		g_hash_table_steal(adapter->device_index, bdaddr);
+	else {
+		key = util_memdup(bdaddr, sizeof(*bdaddr));
+		value = NULL;
+	}
+
+	/* Keep the most recent device first, as in the device list */
+	g_hash_table_insert(adapter->device_index, key,
+					g_slist_prepend(value, device));
+}
+
+static void unindex_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	const bdaddr_t *bdaddr = device_get_address(device);
+	gpointer key;
+	gpointer value;
+	GSList *list;
+
+	if (!g_hash_table_lookup_extended(adapter->device_index, bdaddr,
+							&key, &value))
+		return;
+
+	/* Nothing to update unless the head of the list changes */
+	list = g_slist_remove(value, device);
+	if (list == value)
+		return;
+
+	g_hash_table_steal(adapter->device_index, bdaddr);
+
+	if (list)
+		g_hash_table_insert(adapter->device_index, key, list);
+	else
+		free(key);
+}
+
+static void remove_device_alias(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	bdaddr_t *alias;
+
+	alias = g_hash_table_lookup(adapter->alias_keys, device);
+	if (!alias)
+		return;
+
+	g_hash_table_remove(adapter->alias_keys, device);
+	g_hash_table_remove(adapter->device_aliases, alias);
+}
+
+/*
+ * Each device can be found through one address besides its own, which is
+ * either the address it had before its identity was resolved or the last
+ * RPA that was resolved with its IRK.
+ */
+static void set_device_alias(struct btd_adapter *adapter,
+						struct btd_device *device,
+						const bdaddr_t *bdaddr)
+{
+	struct btd_device *old;
+	bdaddr_t *alias;
+
+	if (!bacmp(bdaddr, device_get_address(device)))
+		return;
+
+	old = g_hash_table_lookup(adapter->device_aliases, bdaddr);
+	if (old == device)
+		return;
+
+	if (old)
+		remove_device_alias(adapter, old);
+
+	remove_device_alias(adapter, device);
+
+	alias = util_memdup(bdaddr, sizeof(*bdaddr));
+	g_hash_table_insert(adapter->device_aliases, alias, device);
+	g_hash_table_insert(adapter->alias_keys, device, alias);
+}
+
+static struct btd_device *lookup_device(struct btd_adapter *adapter,
+					const struct device_addr_type *addr)
+{
+	struct btd_device *device;
+	GSList *l;
+
+	l = g_hash_table_lookup(adapter->device_index, &addr->bdaddr);
+	for (; l; l = l->next) {
+		if (!device_addr_type_cmp(l->data, addr))
+			return l->data;
+	}
+
+	device = g_hash_table_lookup(adapter->device_aliases, &addr->bdaddr);
+	if (device && !device_addr_type_cmp(device, addr))
+		return device;
+
+	/* Resolvable private addresses may belong to any device with an IRK */
+	if (addr->bdaddr_type != BDADDR_LE_RANDOM ||
+					(addr->bdaddr.b[5] >> 6) != 0x01)
+		return NULL;
+
+	l = g_slist_find_custom(adapter->privacy_devices, addr,
+							device_addr_type_cmp);
+
+	return l ? l->data : NULL;
+}
+
+/*
+ * Remember the RPA a device was seen with, so the next lookup with it
+ * doesn't have to try the IRK of every device again.
+ */
+static void update_device_alias(struct btd_adapter *adapter,
+						struct btd_device *device,
+						const bdaddr_t *bdaddr,
+						uint8_t bdaddr_type)
+{
+	if (bdaddr_type != BDADDR_LE_RANDOM || (bdaddr->b[5] >> 6) != 0x01)
+		return;
+
+	set_device_alias(adapter, device, bdaddr);
+}
+
+void btd_adapter_update_privacy(struct btd_adapter *adapter,
+						struct btd_device *device,
+						bool privacy)
+{
+	GSList *l;
+
+	if (!adapter)
+		return;
+
+	l = g_slist_find(adapter->privacy_devices, device);
+
+	if (privacy && !l)
+		adapter->privacy_devices = g_slist_prepend(
+					adapter->privacy_devices, device);
+	else if (!privacy && l)
+		adapter->privacy_devices = g_slist_delete_link(
+					adapter->privacy_devices, l);
+}
+
 struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
 							const bdaddr_t *dst,
 							uint8_t bdaddr_type)
 {
 	struct device_addr_type addr;
 	struct btd_device *device;
-	GSList *list;
 
 	if (!adapter)
 		return NULL;
@@ -1036,13 +1202,10 @@ struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
 	bacpy(&addr.bdaddr, dst);
 	addr.bdaddr_type = bdaddr_type;
 
-	list = g_slist_find_custom(adapter->devices, &addr,
-							device_addr_type_cmp);
-	if (!list)
+	device = lookup_device(adapter, &addr);
+	if (!device)
 		return NULL;
 
-	device = list->data;
-
 	/*
 	 * If we're looking up based on public address and the address
 	 * was not previously used over this bearer we may need to
@@ -4255,7 +4418,7 @@ static int generate_and_write_irk(uint8_t *irk, GKeyFile *key_file,
 								str_irk_out);
 	create_file(filename, S_IRUSR | S_IWUSR);
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -4972,6 +5135,14 @@ done:
 	mgmt_tlv_list_free(list);
 }
 
+static struct btd_device *find_device_by_bdaddr(struct btd_adapter *adapter,
+						const bdaddr_t *bdaddr)
+{
+	GSList *list = g_hash_table_lookup(adapter->device_index, bdaddr);
+
+	return list ? list->data : NULL;
+}
+
 static void load_devices(struct btd_adapter *adapter)
 {
 	char dirname[PATH_MAX];
@@ -5002,10 +5173,10 @@ static void load_devices(struct btd_adapter *adapter)
 		struct link_key_info *key_info;
 		struct smp_ltk_info *ltk_info;
 		struct smp_ltk_info *peripheral_ltk_info;
-		GSList *list;
 		struct irk_info *irk_info;
 		struct conn_param *param;
 		uint8_t bdaddr_type;
+		bdaddr_t bdaddr;
 
 		if (entry->d_type == DT_UNKNOWN)
 			entry->d_type = util_get_dt(dirname, entry->d_name);
@@ -5013,6 +5184,8 @@ static void load_devices(struct btd_adapter *adapter)
 		if (entry->d_type != DT_DIR || bachk(entry->d_name) < 0)
 			continue;
 
+		str2ba(entry->d_name, &bdaddr);
+
 		create_filename(filename, PATH_MAX, "/%s/%s/info",
 					btd_adapter_get_storage_dir(adapter),
 					entry->d_name);
@@ -5065,28 +5238,26 @@ static void load_devices(struct btd_adapter *adapter)
 			goto free;
 		}
 
+		/* Lists are built in reverse and restored once all are read */
 		if (key_info)
-			keys = g_slist_append(keys, key_info);
+			keys = g_slist_prepend(keys, key_info);
 
 		if (ltk_info)
-			ltks = g_slist_append(ltks, ltk_info);
+			ltks = g_slist_prepend(ltks, ltk_info);
 
 		if (peripheral_ltk_info)
-			ltks = g_slist_append(ltks, peripheral_ltk_info);
+			ltks = g_slist_prepend(ltks, peripheral_ltk_info);
 
 		if (irk_info)
-			irks = g_slist_append(irks, irk_info);
+			irks = g_slist_prepend(irks, irk_info);
 
 		param = get_conn_param(key_file, entry->d_name, bdaddr_type);
 		if (param)
-			params = g_slist_append(params, param);
+			params = g_slist_prepend(params, param);
 
-		list = g_slist_find_custom(adapter->devices, entry->d_name,
-							device_address_cmp);
-		if (list) {
-			device = list->data;
+		device = find_device_by_bdaddr(adapter, &bdaddr);
+		if (device)
 			goto device_exist;
-		}
 
 		device = device_create_from_storage(adapter, entry->d_name,
 							key_file);
@@ -5101,7 +5272,7 @@ static void load_devices(struct btd_adapter *adapter)
 
 		/* TODO: register services from pre-loaded list of primaries */
 
-		added_devices = g_slist_append(added_devices, device);
+		added_devices = g_slist_prepend(added_devices, device);
 
 device_exist:
 		if (key_info) {
@@ -5115,16 +5286,21 @@ free:
 
 	closedir(dir);
 
+	keys = g_slist_reverse(keys);
 	load_link_keys(adapter, keys, btd_opts.debug_keys);
 	g_slist_free_full(keys, g_free);
 
+	ltks = g_slist_reverse(ltks);
 	load_ltks(adapter, ltks);
 	g_slist_free_full(ltks, g_free);
+	irks = g_slist_reverse(irks);
 	load_irks(adapter, irks);
 	g_slist_free_full(irks, g_free);
+	params = g_slist_reverse(params);
 	load_conn_params(adapter, params);
 	g_slist_free_full(params, g_free);
 
+	added_devices = g_slist_reverse(added_devices);
 	g_slist_free_full(added_devices, probe_devices);
 }
 
@@ -5293,6 +5469,7 @@ static void adapter_add_device(struct btd_adapter *adapter,
 						struct btd_device *device)
 {
 	adapter->devices = g_slist_prepend(adapter->devices, device);
+	index_device(adapter, device);
 	device_added_drivers(adapter, device);
 }
 
@@ -5300,6 +5477,10 @@ static void adapter_remove_device(struct btd_adapter *adapter,
 						struct btd_device *device)
 {
 	adapter->devices = g_slist_remove(adapter->devices, device);
+	adapter->privacy_devices = g_slist_remove(adapter->privacy_devices,
+								device);
+	unindex_device(adapter, device);
+	remove_device_alias(adapter, device);
 	device_removed_drivers(adapter, device);
 }
 
@@ -6019,6 +6200,10 @@ static void adapter_free(gpointer user_data)
 	if (adapter->allowed_uuid_set)
 		g_hash_table_destroy(adapter->allowed_uuid_set);
 
+	g_hash_table_destroy(adapter->alias_keys);
+	g_hash_table_destroy(adapter->device_aliases);
+	g_hash_table_destroy(adapter->device_index);
+
 	g_free(adapter);
 }
 
@@ -6075,7 +6260,7 @@ static void convert_names_entry(char *key, char *value, void *user_data)
 	g_key_file_set_string(key_file, "General", "Name", value);
 
 	data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, data, length, &gerr)) {
+	if (!storage_set_contents(filename, data, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -6313,7 +6498,7 @@ static void convert_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6418,7 +6603,7 @@ static void store_sdp_record(char *local, char *peer, int handle, char *value)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6501,7 +6686,7 @@ static void convert_sdp_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6575,7 +6760,7 @@ static void convert_primaries_entry(char *key, char *value, void *user_data)
 		goto end;
 
 	create_file(filename, 0600);
-	if (!g_file_set_contents(filename, data, length, &gerr)) {
+	if (!storage_set_contents(filename, data, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_clear_error(&gerr);
@@ -6600,7 +6785,7 @@ static void convert_primaries_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6658,7 +6843,7 @@ static void convert_ccc_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6714,7 +6899,7 @@ static void convert_gatt_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6768,7 +6953,7 @@ static void convert_proximity_entry(char *key, char *value, void *user_data)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -6873,7 +7058,7 @@ static void convert_config(struct btd_adapter *adapter, const char *filename,
 	create_file(filename, 0600);
 
 	data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, data, length, &gerr)) {
+	if (!storage_set_contents(filename, data, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -7018,6 +7203,12 @@ static struct btd_adapter *btd_adapter_new(uint16_t index)
 
 	adapter->dev_id = index;
 	adapter->mgmt = mgmt_ref(mgmt_primary);
+	adapter->device_index = g_hash_table_new_full(bdaddr_hash,
+					bdaddr_equal, free,
+					(GDestroyNotify) g_slist_free);
+	adapter->device_aliases = g_hash_table_new_full(bdaddr_hash,
+					bdaddr_equal, free, NULL);
+	adapter->alias_keys = g_hash_table_new(NULL, NULL);
 	adapter->pincode_requested = false;
 	blocked = rfkill_get_blocked(index);
 	if (blocked > 0)
@@ -7076,6 +7267,12 @@ static void adapter_remove(struct btd_adapter *adapter)
 	g_slist_free(adapter->devices);
 	adapter->devices = NULL;
 
+	g_slist_free(adapter->privacy_devices);
+	adapter->privacy_devices = NULL;
+	g_hash_table_remove_all(adapter->alias_keys);
+	g_hash_table_remove_all(adapter->device_aliases);
+	g_hash_table_remove_all(adapter->device_index);
+
 	discovery_cleanup(adapter, 0);
 
 	unload_drivers(adapter);
@@ -7096,6 +7293,9 @@ static void adapter_remove(struct btd_adapter *adapter)
 	btd_battery_provider_manager_destroy(adapter->battery_provider_manager);
 	adapter->battery_provider_manager = NULL;
 
+	btd_statistics_destroy(adapter->statistics);
+	adapter->statistics = NULL;
+
 	g_slist_free(adapter->pin_callbacks);
 	adapter->pin_callbacks = NULL;
 
@@ -7184,11 +7384,12 @@ static void adapter_msd_notify(struct btd_adapter *adapter,
 	}
 }
 
-static bool is_filter_match(GSList *discovery_filter, struct eir_data *eir_data,
-								int8_t rssi)
+static bool is_filter_match(GSList *discovery_filter,
+				const struct bt_ad_view *view, int8_t rssi)
 {
 	GSList *l, *m;
 	bool got_match = false;
+	bt_uuid_t uuid;
 
 	for (l = discovery_filter; l != NULL && got_match != true;
 							l = g_slist_next(l)) {
@@ -7215,9 +7416,9 @@ static bool is_filter_match(GSList *discovery_filter, struct eir_data *eir_data,
 				/* m->data contains string representation of
 				 * uuid.
 				 */
-				if (queue_find(eir_data->services,
-							m->data,
-							g_strcmp) != NULL)
+				if (!bt_string_to_uuid(&uuid, m->data) &&
+					bt_ad_view_has_service_uuid(view,
+								&uuid))
 					got_match = true;
 			}
 		}
@@ -7227,8 +7428,8 @@ static bool is_filter_match(GSList *discovery_filter, struct eir_data *eir_data,
 			if (item->rssi == DISTANCE_VAL_INVALID ||
 			    item->rssi <= rssi ||
 			    item->pathloss == DISTANCE_VAL_INVALID ||
-			    (eir_data->tx_power != 127 &&
-			     eir_data->tx_power - rssi <= item->pathloss))
+			    (view->tx_power != 127 &&
+			     view->tx_power - rssi <= item->pathloss))
 				return true;
 
 			got_match = false;
@@ -7250,8 +7451,9 @@ static void filter_duplicate_data(void *data, void *user_data)
 }
 
 static bool device_is_discoverable(struct btd_adapter *adapter,
-					struct eir_data *eir, const char *addr,
-					uint8_t bdaddr_type, bool *auto_connect)
+					const struct bt_ad_view *view,
+					const char *addr, uint8_t bdaddr_type,
+					bool *auto_connect)
 {
 	GSList *l;
 	bool discoverable;
@@ -7259,7 +7461,7 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 	if (bdaddr_type == BDADDR_BREDR || adapter->filtered_discovery)
 		discoverable = true;
 	else if (btd_opts.filter_discoverable)
-		discoverable = eir->flags & (EIR_LIM_DISC | EIR_GEN_DISC);
+		discoverable = view->flags & (EIR_LIM_DISC | EIR_GEN_DISC);
 	else
 		discoverable = true;
 
@@ -7293,7 +7495,8 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 			return true;
 		}
 
-		if (eir->name && !strncmp(filter->pattern, eir->name,
+		if (view->name && view->name_len >= pattern_len &&
+				!memcmp(filter->pattern, view->name,
 							pattern_len)) {
 			*auto_connect = filter->auto_connect;
 			return true;
@@ -7303,7 +7506,7 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 	return discoverable;
 }
 
-void btd_adapter_device_found(struct btd_adapter *adapter,
+static void device_found(struct btd_adapter *adapter,
 					const bdaddr_t *bdaddr,
 					uint8_t bdaddr_type, int8_t rssi,
 					uint32_t flags,
@@ -7311,8 +7514,10 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 					bool monitoring)
 {
 	struct btd_device *dev;
-	struct bt_ad *ad = NULL;
+	struct bt_ad_view view;
 	struct eir_data eir_data;
+	bt_uuid_t bcaa_uuid;
+	char *name;
 	bool name_known, discoverable;
 	char addr[18];
 	bool confirm;
@@ -7330,21 +7535,23 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	name_resolve_failed = (flags & MGMT_DEV_FOUND_NAME_REQUEST_FAILED);
 	scan_rsp = (flags & MGMT_DEV_FOUND_SCAN_RSP);
 
+	/*
+	 * The report is only looked at through a view of the original data
+	 * until the device is actually updated, so reports that end up being
+	 * dropped don't allocate anything.
+	 */
+	bt_ad_view_init(&view, data, data_len);
+
 	if (!btd_adv_monitor_offload_enabled(adapter->adv_monitor_manager) ||
 				(MGMT_VERSION(mgmt_version, mgmt_revision) <
 							MGMT_VERSION(1, 22))) {
-		if (bdaddr_type != BDADDR_BREDR)
-			ad = bt_ad_new_with_data(data_len, data);
-
 		/* During the background scanning, update the device only when
 		 * the data match at least one Adv monitor
 		 */
-		if (ad) {
+		if (bdaddr_type != BDADDR_BREDR && view.len) {
 			matched_monitors = btd_adv_monitor_content_filter(
 						adapter->adv_monitor_manager,
-						ad);
-			bt_ad_unref(ad);
-			ad = NULL;
+						&view);
 			monitoring = matched_monitors ? true : false;
 		}
 	}
@@ -7352,18 +7559,16 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!adapter->discovering && !monitoring)
 		return;
 
-	memset(&eir_data, 0, sizeof(eir_data));
-	eir_parse(&eir_data, data, data_len);
-
 	ba2str(bdaddr, addr);
 
-	discoverable = device_is_discoverable(adapter, &eir_data, addr,
+	discoverable = device_is_discoverable(adapter, &view, addr,
 						bdaddr_type, &auto_connect);
 
 	/* Monitor Devices advertising Broadcast Announcements if the
 	 * adapter is capable of synchronizing to it.
 	 */
-	if (eir_get_service_data(&eir_data, BCAA_SERVICE_UUID) &&
+	bt_string_to_uuid(&bcaa_uuid, BCAA_SERVICE_UUID);
+	if (bt_ad_view_has_service_data(&view, &bcaa_uuid) &&
 					btd_adapter_has_settings(adapter,
 					MGMT_SETTING_ISO_SYNC_RECEIVER))
 		monitoring = true;
@@ -7373,23 +7578,19 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 		/* In case of being just a scan response don't attempt to create
 		 * the device.
 		 */
-		if (scan_rsp) {
-			eir_data_free(&eir_data);
-			return;
-		}
+		if (scan_rsp)
+			goto done;
 
 		/* If ISO  Socket is enabled, monitor Devices advertising RSI
 		 * since those can be coordinated sets not marked as visible but
 		 * their object are needed.
 		 */
 		if (btd_adapter_has_exp_feature(adapter, EXP_FEAT_ISO_SOCKET) &&
-						eir_data.rsi)
+				bt_ad_view_has_type(&view, BT_AD_CSIP_RSI))
 			monitoring = true;
 
-		if (!discoverable && !monitoring) {
-			eir_data_free(&eir_data);
-			return;
-		}
+		if (!discoverable && !monitoring)
+			goto done;
 
 		dev = adapter_create_device(adapter, bdaddr, bdaddr_type);
 	}
@@ -7397,10 +7598,11 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!dev) {
 		btd_error(adapter->dev_id,
 			"Unable to create object for found device %s", addr);
-		eir_data_free(&eir_data);
-		return;
+		goto done;
 	}
 
+	update_device_alias(adapter, dev, bdaddr, bdaddr_type);
+
 	device_update_last_seen(dev, bdaddr_type, !not_connectable);
 
 	/*
@@ -7409,15 +7611,18 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	 * kernels send them merged, so once we know which mgmt version
 	 * supports this we can make the non-zero check conditional.
 	 */
-	if (bdaddr_type != BDADDR_BREDR && eir_data.flags &&
-					!(eir_data.flags & EIR_BREDR_UNSUP)) {
+	if (bdaddr_type != BDADDR_BREDR && view.flags &&
+					!(view.flags & EIR_BREDR_UNSUP)) {
 		device_set_bredr_support(dev);
 		/* Update last seen for BR/EDR in case its flag is set */
 		device_update_last_seen(dev, BDADDR_BREDR, !not_connectable);
 	}
 
-	if (eir_data.name != NULL && eir_data.name_complete)
-		device_store_cached_name(dev, eir_data.name);
+	if (view.name && view.name_complete) {
+		name = eir_view_get_name(&view);
+		device_store_cached_name(dev, name);
+		g_free(name);
+	}
 
 	/*
 	 * Only skip devices that are not connected, are temporary, and there
@@ -7425,20 +7630,20 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	 */
 	if (!btd_device_is_connected(dev) &&
 		(device_is_temporary(dev) && !adapter->discovery_list) &&
-		!monitoring) {
-		eir_data_free(&eir_data);
-		return;
-	}
+		!monitoring)
+		goto done;
 
 	/* If there is no matched Adv monitors, don't continue if not
 	 * discoverable or if active discovery filter don't match.
 	 */
-	if (!eir_data.rsi && !monitoring && (!discoverable ||
-		(adapter->filtered_discovery && !is_filter_match(
-				adapter->discovery_list, &eir_data, rssi)))) {
-		eir_data_free(&eir_data);
-		return;
-	}
+	if (!bt_ad_view_has_type(&view, BT_AD_CSIP_RSI) && !monitoring &&
+		(!discoverable || (adapter->filtered_discovery &&
+		!is_filter_match(adapter->discovery_list, &view, rssi))))
+		goto done;
+
+	/* The device is going to be updated, parse the data for good */
+	memset(&eir_data, 0, sizeof(eir_data));
+	eir_parse_view(&eir_data, &view);
 
 	device_set_legacy(dev, legacy);
 
@@ -7562,6 +7767,26 @@ connect_le:
 		adapter->connect_le = dev;
 		stop_passive_scanning(adapter);
 	}
+
+	return;
+
+done:
+	queue_destroy(matched_monitors, NULL);
+}
+
+void btd_adapter_device_found(struct btd_adapter *adapter,
+					const bdaddr_t *bdaddr,
+					uint8_t bdaddr_type, int8_t rssi,
+					uint32_t flags,
+					const uint8_t *data, uint8_t data_len,
+					bool monitoring)
+{
+	uint64_t start = adapter->statistics ? stats_start() : 0;
+
+	device_found(adapter, bdaddr, bdaddr_type, rssi, flags, data,
+						data_len, monitoring);
+
+	btd_statistics_device_found(adapter->statistics, start);
 }
 
 static void device_found_callback(uint16_t index, uint16_t length,
@@ -8733,7 +8958,7 @@ static void store_link_key(struct btd_adapter *adapter,
 	g_key_file_set_integer(key_file, "LinkKey", "PINLength", pin_length);
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -8830,7 +9055,7 @@ static void store_ltk_group(struct btd_adapter *adapter, const bdaddr_t *peer,
 	create_file(filename, 0600);
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -8995,7 +9220,7 @@ static void store_irk(struct btd_adapter *adapter, const bdaddr_t *peer,
 	g_key_file_set_string(key_file, "IdentityResolvingKey", "Key", str);
 
 	store_data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, store_data, length, &gerr)) {
+	if (!storage_set_contents(filename, store_data, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -9045,7 +9270,15 @@ static void new_irk_callback(uint16_t index, uint16_t length,
 		return;
 	}
 
-	device_update_addr(device, &addr->bdaddr, addr->type, irk->val);
+	if (bacmp(&addr->bdaddr, device_get_address(device))) {
+		unindex_device(adapter, device);
+		device_update_addr(device, &addr->bdaddr, addr->type,
+								irk->val);
+		index_device(adapter, device);
+		set_device_alias(adapter, device, &ev->rpa);
+	} else
+		device_update_addr(device, &addr->bdaddr, addr->type,
+								irk->val);
 
 	if (duplicate)
 		device_merge_duplicate(device, duplicate);
@@ -9096,7 +9329,7 @@ void btd_adapter_store_conn_param(struct btd_adapter *adapter,
 	create_file(filename, 0600);
 
 	store_data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, store_data, length, &gerr)) {
+	if (!storage_set_contents(filename, store_data, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -9404,6 +9637,10 @@ static int adapter_register(struct btd_adapter *adapter)
 	adapter->battery_provider_manager =
 		btd_battery_provider_manager_create(adapter);
 
+	if (btd_opts.statistics)
+		adapter->statistics = btd_statistics_create(adapter,
+							adapter->mgmt);
+
 	/* Don't start GATT database and advertising managers on
 	 * non-LE controllers.
 	 */
@@ -9559,6 +9796,8 @@ static void connected_callback(uint16_t index, uint16_t length,
 		return;
 	}
 
+	update_device_alias(adapter, device, &ev->addr.bdaddr, ev->addr.type);
+
 	memset(&eir_data, 0, sizeof(eir_data));
 	if (eir_len > 0)
 		eir_parse(&eir_data, ev->eir, eir_len);
@@ -9754,7 +9993,7 @@ static void remove_keys(struct btd_adapter *adapter,
 	}
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -9900,7 +10139,7 @@ static bool get_static_addr(struct btd_adapter *adapter)
 						(const char **)addrs, len);
 
 	str = g_key_file_to_data(file, &len, NULL);
-	if (!g_file_set_contents(filename, str, len, &gerr)) {
+	if (!storage_set_contents(filename, str, len, &gerr)) {
 		error("Unable set contents for %s: (%s)",
 					filename, gerr->message);
 		g_error_free(gerr);
@@ -10881,6 +11120,7 @@ int adapter_init(void)
 	}
 
 	mgmt_set_debug(mgmt_primary, mgmt_debug, NULL, NULL);
+	mgmt_set_window(mgmt_primary, btd_opts.mgmt_window);
 
 	DBG("sending read version command");
 
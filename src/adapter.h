@@ -197,6 +197,9 @@ int btd_adapter_disconnect_device(struct btd_adapter *adapter,
 
 int btd_adapter_remove_bonding(struct btd_adapter *adapter,
 				const bdaddr_t *bdaddr, uint8_t bdaddr_type);
+void btd_adapter_update_privacy(struct btd_adapter *adapter,
+						struct btd_device *device,
+						bool privacy);
 
 int btd_adapter_pincode_reply(struct btd_adapter *adapter,
 					const  bdaddr_t *bdaddr,
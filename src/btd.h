@@ -136,6 +136,8 @@ struct btd_opts {
 	uint32_t	pairto;
 	uint32_t	discovto;
 	uint32_t	tmpto;
+	uint32_t	prop_window;
+	uint32_t	prop_max_rate;
 	uint8_t		privacy;
 	bool		device_privacy;
 	uint32_t	name_request_retry_delay;
@@ -151,6 +153,7 @@ struct btd_opts {
 	bool		experimental;
 	bool		testing;
 	bool		filter_discoverable;
+	bool		statistics;
 	struct queue	*kernel;
 
 	uint16_t	did_source;
@@ -160,6 +163,7 @@ struct btd_opts {
 
 	bt_mode_t	mode;
 	uint16_t	max_adapters;
+	uint8_t		mgmt_window;
 	bt_gatt_cache_t gatt_cache;
 	uint16_t	gatt_mtu;
 	uint8_t		gatt_channels;
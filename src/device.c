@@ -74,6 +74,8 @@
 
 #define RSSI_THRESHOLD		8
 #define AUTH_FAILURES_THRESHOLD	3
+#define NAME_CACHE_FLUSH_TIMEOUT	5
+#define ATT_WRITE_QUEUE_LIMIT	64
 
 static DBusConnection *dbus_conn = NULL;
 static unsigned service_state_cb_id;
@@ -194,6 +196,26 @@ enum {
 	PREFER_LAST_SEEN,
 };
 
+/* Properties updated from advertising reports while discovering */
+enum {
+	DEV_PROP_RSSI,
+	DEV_PROP_TX_POWER,
+	DEV_PROP_MANUFACTURER_DATA,
+	DEV_PROP_SERVICE_DATA,
+	DEV_PROP_ADVERTISING_DATA,
+	DEV_PROP_MAX
+};
+
+static const char *prop_names[DEV_PROP_MAX] = {
+	"RSSI",
+	"TxPower",
+	"ManufacturerData",
+	"ServiceData",
+	"AdvertisingData",
+};
+
+static struct btd_device_prop_stats prop_stats[DEV_PROP_MAX];
+
 struct btd_device {
 	int ref_count;
 
@@ -301,11 +323,19 @@ struct btd_device {
 	guint		store_id;
 
 	time_t		name_resolve_failed_time;
+	char		*cached_name;		/* Name for the cache file */
+	bool		cached_name_dirty;
 
 	int8_t		volume;
 
 	uint32_t	auth_failures;
 	guint		auth_retry_id;
+
+	unsigned int	prop_timer;		/* Pending property changes */
+	uint64_t	prop_timer_expire;
+	uint8_t		prop_pending;
+	uint64_t	prop_deadline[DEV_PROP_MAX];
+	uint64_t	prop_last[DEV_PROP_MAX];
 };
 
 static const uint16_t uuid_list[] = {
@@ -315,6 +345,10 @@ static const uint16_t uuid_list[] = {
 	0
 };
 
+/* Devices whose cached name still has to be written to storage */
+static struct queue *dirty_names;
+static unsigned int name_flush_id;
+
 static int device_browse_gatt(struct btd_device *device, DBusMessage *msg);
 static int device_browse_sdp(struct btd_device *device, DBusMessage *msg);
 
@@ -629,7 +663,7 @@ static gboolean store_device_info_cb(gpointer user_data)
 	}
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -671,7 +705,7 @@ static void store_device_info(struct btd_device *device)
 	device->store_id = g_idle_add(store_device_info_cb, device);
 }
 
-void device_store_cached_name(struct btd_device *dev, const char *name)
+static void write_cached_name(struct btd_device *dev)
 {
 	char filename[PATH_MAX];
 	char d_addr[18];
@@ -682,12 +716,6 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 	gsize length = 0;
 	gsize length_old = 0;
 
-	if (device_address_is_private(dev)) {
-		DBG("Can't store name for private addressed device %s",
-								dev->path);
-		return;
-	}
-
 	ba2str(&dev->bdaddr, d_addr);
 	create_filename(filename, PATH_MAX, "/%s/cache/%s",
 			btd_adapter_get_storage_dir(dev->adapter), d_addr);
@@ -702,12 +730,12 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 
 	data_old = g_key_file_to_data(key_file, &length_old, NULL);
 
-	g_key_file_set_string(key_file, "General", "Name", name);
+	g_key_file_set_string(key_file, "General", "Name", dev->cached_name);
 
 	data = g_key_file_to_data(key_file, &length, NULL);
 
 	if ((length != length_old) || (memcmp(data, data_old, length))) {
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_clear_error(&gerr);
@@ -719,6 +747,212 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 	g_key_file_free(key_file);
 }
 
+static void flush_cached_name(void *data)
+{
+	struct btd_device *dev = data;
+
+	dev->cached_name_dirty = false;
+	write_cached_name(dev);
+}
+
+static bool flush_cached_names(void *user_data)
+{
+	struct queue *names = dirty_names;
+
+	name_flush_id = 0;
+	dirty_names = NULL;
+
+	queue_destroy(names, flush_cached_name);
+
+	return false;
+}
+
+static void device_flush_cached_name(struct btd_device *dev)
+{
+	if (!dev->cached_name_dirty)
+		return;
+
+	queue_remove(dirty_names, dev);
+	flush_cached_name(dev);
+}
+
+/*
+ * Names are seen in every advertising report during discovery, so they are
+ * kept in memory and only written out, in batches, when they change.
+ */
+void device_store_cached_name(struct btd_device *dev, const char *name)
+{
+	if (device_address_is_private(dev)) {
+		DBG("Can't store name for private addressed device %s",
+								dev->path);
+		return;
+	}
+
+	if (!g_strcmp0(dev->cached_name, name))
+		return;
+
+	g_free(dev->cached_name);
+	dev->cached_name = g_strdup(name);
+
+	if (dev->cached_name_dirty)
+		return;
+
+	dev->cached_name_dirty = true;
+
+	if (!dirty_names)
+		dirty_names = queue_new();
+
+	queue_push_tail(dirty_names, dev);
+
+	if (!name_flush_id)
+		name_flush_id = timeout_add_seconds(NAME_CACHE_FLUSH_TIMEOUT,
+						flush_cached_names, NULL, NULL);
+}
+
+static uint64_t prop_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void prop_emit(struct btd_device *dev, unsigned int prop,
+								uint64_t now)
+{
+	dev->prop_pending &= ~BIT(prop);
+	dev->prop_last[prop] = now;
+	prop_stats[prop].emitted++;
+
+	g_dbus_emit_property_changed(dbus_conn, dev->path, DEVICE_INTERFACE,
+							prop_names[prop]);
+}
+
+static bool prop_timeout(void *user_data);
+
+static void prop_schedule(struct btd_device *dev, uint64_t now)
+{
+	uint64_t expire = UINT64_MAX;
+	unsigned int i;
+
+	for (i = 0; i < DEV_PROP_MAX; i++) {
+		if ((dev->prop_pending & BIT(i)) &&
+					dev->prop_deadline[i] < expire)
+			expire = dev->prop_deadline[i];
+	}
+
+	if (dev->prop_timer && dev->prop_timer_expire == expire)
+		return;
+
+	if (dev->prop_timer) {
+		timeout_remove(dev->prop_timer);
+		dev->prop_timer = 0;
+	}
+
+	if (expire == UINT64_MAX)
+		return;
+
+	dev->prop_timer_expire = expire;
+	dev->prop_timer = timeout_add(expire > now ? expire - now : 0,
+						prop_timeout, dev, NULL);
+}
+
+static bool prop_timeout(void *user_data)
+{
+	struct btd_device *dev = user_data;
+	uint64_t now = prop_now();
+	unsigned int i;
+
+	dev->prop_timer = 0;
+
+	for (i = 0; i < DEV_PROP_MAX; i++) {
+		if ((dev->prop_pending & BIT(i)) &&
+					dev->prop_deadline[i] <= now)
+			prop_emit(dev, i, now);
+	}
+
+	prop_schedule(dev, now);
+
+	return false;
+}
+
+/*
+ * During discovery the properties fed by advertising reports may change
+ * with every report. With DevicePropertyWindow and DevicePropertyMaxRate
+ * set, changes are held back and merged per device and property so only
+ * the latest value is signalled, once the window has passed and no sooner
+ * than the rate allows.
+ */
+static void device_prop_changed(struct btd_device *dev, unsigned int prop)
+{
+	uint64_t now, deadline;
+
+	if (!btd_opts.prop_window && !btd_opts.prop_max_rate) {
+		prop_stats[prop].emitted++;
+		g_dbus_emit_property_changed(dbus_conn, dev->path,
+					DEVICE_INTERFACE, prop_names[prop]);
+		return;
+	}
+
+	/* Already pending, the value is only read once it is emitted */
+	if (dev->prop_pending & BIT(prop)) {
+		prop_stats[prop].suppressed++;
+		return;
+	}
+
+	now = prop_now();
+	deadline = now + btd_opts.prop_window;
+
+	if (btd_opts.prop_max_rate && dev->prop_last[prop]) {
+		uint64_t next = dev->prop_last[prop] +
+					1000 / btd_opts.prop_max_rate;
+
+		if (next > deadline)
+			deadline = next;
+	}
+
+	if (deadline <= now) {
+		prop_emit(dev, prop, now);
+		return;
+	}
+
+	dev->prop_pending |= BIT(prop);
+	dev->prop_deadline[prop] = deadline;
+
+	prop_schedule(dev, now);
+}
+
+/* Emit pending changes right away, e.g. before the connection state */
+static void device_flush_props(struct btd_device *dev)
+{
+	uint64_t now;
+	unsigned int i;
+
+	if (!dev->prop_pending)
+		return;
+
+	now = prop_now();
+
+	for (i = 0; i < DEV_PROP_MAX; i++) {
+		if (dev->prop_pending & BIT(i))
+			prop_emit(dev, i, now);
+	}
+
+	prop_schedule(dev, now);
+}
+
+void btd_device_foreach_prop_stats(btd_device_prop_stats_func_t func,
+							void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < DEV_PROP_MAX; i++) {
+		prop_stats[i].name = prop_names[i];
+		func(&prop_stats[i], user_data);
+	}
+}
+
 static void device_store_cached_name_resolve(struct btd_device *dev)
 {
 	char filename[PATH_MAX];
@@ -759,7 +993,7 @@ static void device_store_cached_name_resolve(struct btd_device *dev)
 	data = g_key_file_to_data(key_file, &length, NULL);
 
 	if ((length != length_old) || (memcmp(data, data_old, length))) {
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -931,6 +1165,9 @@ static void device_free(gpointer user_data)
 	if (device->temporary_timer)
 		timeout_remove(device->temporary_timer);
 
+	if (device->prop_timer)
+		timeout_remove(device->prop_timer);
+
 	if (device->connect)
 		dbus_message_unref(device->connect);
 
@@ -954,6 +1191,10 @@ static void device_free(gpointer user_data)
 	btd_bearer_destroy(device->bredr);
 	btd_bearer_destroy(device->le);
 
+	if (device->cached_name_dirty)
+		queue_remove(dirty_names, device);
+
+	g_free(device->cached_name);
 	g_free(device->local_csrk);
 	g_free(device->remote_csrk);
 	free(device->ltk);
@@ -2461,8 +2702,7 @@ static void add_manufacturer_data(void *data, void *user_data)
 								msd->data_len))
 		return;
 
-	g_dbus_emit_property_changed(dbus_conn, dev->path,
-					DEVICE_INTERFACE, "ManufacturerData");
+	device_prop_changed(dev, DEV_PROP_MANUFACTURER_DATA);
 }
 
 void device_set_manufacturer_data(struct btd_device *dev, struct queue *queue,
@@ -2492,8 +2732,7 @@ static void add_service_data(void *data, void *user_data)
 	device_add_eir_uuids(dev, q);
 	queue_destroy(q, NULL);
 
-	g_dbus_emit_property_changed(dbus_conn, dev->path,
-					DEVICE_INTERFACE, "ServiceData");
+	device_prop_changed(dev, DEV_PROP_SERVICE_DATA);
 }
 
 void device_set_service_data(struct btd_device *dev, struct queue *queue,
@@ -2514,9 +2753,7 @@ static void add_data(void *data, void *user_data)
 		return;
 
 	if (ad->type == EIR_TRANSPORT_DISCOVERY)
-		g_dbus_emit_property_changed(dbus_conn, dev->path,
-						DEVICE_INTERFACE,
-						"AdvertisingData");
+		device_prop_changed(dev, DEV_PROP_ADVERTISING_DATA);
 }
 
 void device_set_data(struct btd_device *dev, struct queue *queue,
@@ -3033,7 +3270,7 @@ static void store_services(struct btd_device *device)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -3045,7 +3282,7 @@ static void store_services(struct btd_device *device)
 	g_key_file_free(key_file);
 }
 
-static void store_gatt_db(struct btd_device *device)
+static bool store_gatt_db(struct btd_device *device)
 {
 	char filename[PATH_MAX];
 	char dst_addr[18];
@@ -3053,20 +3290,31 @@ static void store_gatt_db(struct btd_device *device)
 	if (device_address_is_private(device)) {
 		DBG("Can't store GATT db for private addressed device %s",
 								device->path);
-		return;
+		return false;
 	}
 
 	if (!gatt_cache_is_enabled(device))
-		return;
+		return false;
 
 	ba2str(&device->bdaddr, dst_addr);
 
-	create_filename(filename, PATH_MAX, "/%s/cache/%s",
+	/*
+	 * The file is written atomically, only make sure its directory
+	 * exists so that a failed write leaves no empty cache behind.
+	 */
+	create_filename(filename, PATH_MAX, "/%s/cache",
+				btd_adapter_get_storage_dir(device->adapter));
+	if (mkdir(filename, 0700) < 0 && errno != EEXIST) {
+		error("Unable to create %s: %s (%d)", filename,
+						strerror(errno), errno);
+		return false;
+	}
+
+	create_filename(filename, PATH_MAX, "/%s/cache/%s.gatt",
 				btd_adapter_get_storage_dir(device->adapter),
 				dst_addr);
-	create_file(filename, 0600);
 
-	btd_settings_gatt_db_store(device->db, filename);
+	return btd_settings_gatt_cache_store(device->db, filename);
 }
 
 static void browse_request_complete(struct browse_req *req, uint8_t type,
@@ -3846,6 +4094,8 @@ void device_add_connection(struct btd_device *dev, uint8_t bdaddr_type,
 	/* Remove temporary timer while connected */
 	clear_temporary_timer(dev);
 
+	device_flush_props(dev);
+
 	g_dbus_emit_property_changed(dbus_conn, dev->path, DEVICE_INTERFACE,
 								"Connected");
 }
@@ -4051,6 +4301,8 @@ void device_remove_connection(struct btd_device *device, uint8_t bdaddr_type,
 
 	device_disconnected(device, reason);
 
+	device_flush_props(device);
+
 	g_dbus_emit_property_changed(dbus_conn, device->path,
 						DEVICE_INTERFACE, "Connected");
 
@@ -4305,7 +4557,7 @@ static void convert_info(struct btd_device *device, GKeyFile *key_file)
 			device_addr);
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -4623,6 +4875,43 @@ static void add_primary(struct gatt_db_attribute *attr, void *user_data)
 	*new_services = g_slist_append(*new_services, prim);
 }
 
+static void migrate_gatt_db(struct btd_device *device, const char *filename)
+{
+	GKeyFile *key_file;
+	GError *gerr = NULL;
+	char *data;
+	gsize length = 0;
+
+	DBG("Migrating %s gatt database to binary cache", filename);
+
+	/* Keep the attributes around until the binary cache has them */
+	if (!store_gatt_db(device)) {
+		warn("Unable to migrate %s gatt database", filename);
+		return;
+	}
+
+	key_file = g_key_file_new();
+	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
+		error("Unable to load key file from %s: (%s)", filename,
+								gerr->message);
+		g_clear_error(&gerr);
+		g_key_file_free(key_file);
+		return;
+	}
+
+	g_key_file_remove_group(key_file, "Attributes", NULL);
+
+	data = g_key_file_to_data(key_file, &length, NULL);
+	if (!storage_set_contents(filename, data, length, &gerr)) {
+		error("Unable set contents for %s: (%s)", filename,
+								gerr->message);
+		g_error_free(gerr);
+	}
+
+	g_free(data);
+	g_key_file_free(key_file);
+}
+
 static void load_gatt_db(struct btd_device *device, const char *local,
 							const char *peer)
 {
@@ -4634,16 +4923,32 @@ static void load_gatt_db(struct btd_device *device, const char *local,
 
 	DBG("Restoring %s gatt database from file", peer);
 
-	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
+	create_filename(filename, PATH_MAX, "/%s/cache/%s.gatt", local, peer);
 
-	err = btd_settings_gatt_db_load(device->db, filename);
+	err = btd_settings_gatt_cache_load(device->db, filename);
 	if (err < 0) {
+		/* Drop a cache that cannot be imported so it is rewritten */
+		if (err != -ENOENT) {
+			warn("Unable to load %s: %s (%d)", filename,
+							strerror(-err), err);
+			unlink(filename);
+		}
+
+		/* Fallback to the attributes stored in the text cache */
+		create_filename(filename, PATH_MAX, "/%s/cache/%s", local,
+									peer);
+
+		err = btd_settings_gatt_db_load(device->db, filename);
 		if (err == -ENOENT)
 			return;
 
+		if (!err)
+			migrate_gatt_db(device, filename);
+	}
+
+	if (err < 0)
 		warn("Error loading db from cache for %s: %s (%d)", peer,
 						strerror(-err), err);
-	}
 
 	g_slist_free_full(device->primaries, g_free);
 	device->primaries = NULL;
@@ -5071,7 +5376,7 @@ struct btd_device *device_create(struct btd_adapter *adapter,
 	str = load_cached_name(device, storage_dir, dst);
 	if (str) {
 		strcpy(device->name, str);
-		g_free(str);
+		device->cached_name = str;
 	}
 
 	load_cached_name_resolve(device, storage_dir, dst);
@@ -5207,6 +5512,10 @@ void device_set_privacy(struct btd_device *device, bool value,
 		device->irk = util_memdup(irk, 16);
 	else
 		device->irk = NULL;
+
+	/* Only devices with an IRK can resolve private addresses */
+	btd_adapter_update_privacy(device->adapter, device,
+					device->privacy && device->irk);
 }
 
 bool device_get_privacy(struct btd_device *device)
@@ -5447,6 +5756,11 @@ static void device_remove_stored(struct btd_device *device)
 				device_addr);
 	delete_folder_tree(filename);
 
+	create_filename(filename, PATH_MAX, "/%s/cache/%s.gatt",
+				btd_adapter_get_storage_dir(device->adapter),
+				device_addr);
+	unlink(filename);
+
 	create_filename(filename, PATH_MAX, "/%s/cache/%s",
 				btd_adapter_get_storage_dir(device->adapter),
 				device_addr);
@@ -5464,7 +5778,7 @@ static void device_remove_stored(struct btd_device *device)
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (length > 0) {
 		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
+		if (!storage_set_contents(filename, data, length, &gerr)) {
 			error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 			g_error_free(gerr);
@@ -5521,6 +5835,8 @@ void device_remove(struct btd_device *device, gboolean remove_stored)
 
 	clear_temporary_timer(device);
 
+	device_flush_cached_name(device);
+
 	if (device->store_id > 0) {
 		g_source_remove(device->store_id);
 		device->store_id = 0;
@@ -5990,7 +6306,7 @@ next:
 	if (sdp_key_file) {
 		data = g_key_file_to_data(sdp_key_file, &length, NULL);
 		if (length > 0) {
-			if (!g_file_set_contents(sdp_file, data, length,
+			if (!storage_set_contents(sdp_file, data, length,
 								&gerr)) {
 				error("Unable set contents for %s: (%s)",
 						sdp_file, gerr->message);
@@ -6005,7 +6321,7 @@ next:
 	if (att_key_file) {
 		data = g_key_file_to_data(att_key_file, &length, NULL);
 		if (length > 0) {
-			if (!g_file_set_contents(att_file, data, length,
+			if (!storage_set_contents(att_file, data, length,
 								&gerr)) {
 				error("Unable set contents for %s: (%s)",
 						att_file, gerr->message);
@@ -6498,6 +6814,13 @@ bool device_attach_att(struct btd_device *dev, GIOChannel *io)
 						att_disconnected_cb, dev, NULL);
 	bt_att_set_close_on_unref(dev->att, true);
 
+	/*
+	 * Bound the commands and notifications waiting for the link, the
+	 * AcquireWrite and AcquireNotify sockets stop being read instead.
+	 */
+	bt_att_set_class_limit(dev->att, BT_ATT_CLASS_WRITE,
+						ATT_WRITE_QUEUE_LIMIT);
+
 	if (dev->local_csrk)
 		bt_att_set_local_key(dev->att, dev->local_csrk->key,
 							local_counter, dev);
@@ -7051,7 +7374,7 @@ void device_store_svc_chng_ccc(struct btd_device *device, uint8_t bdaddr_type,
 	create_file(filename, 0600);
 
 	str = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, str, length, &gerr)) {
+	if (!storage_set_contents(filename, str, length, &gerr)) {
 		error("Unable set contents for %s: (%s)", filename,
 								gerr->message);
 		g_error_free(gerr);
@@ -7131,8 +7454,7 @@ void device_set_rssi_with_delta(struct btd_device *device, int8_t rssi,
 		device->rssi = rssi;
 	}
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "RSSI");
+	device_prop_changed(device, DEV_PROP_RSSI);
 }
 
 void device_set_rssi(struct btd_device *device, int8_t rssi)
@@ -7152,8 +7474,7 @@ void device_set_tx_power(struct btd_device *device, int8_t tx_power)
 
 	device->tx_power = tx_power;
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "TxPower");
+	device_prop_changed(device, DEV_PROP_TX_POWER);
 }
 
 void device_set_flags(struct btd_device *device, uint8_t flags)
@@ -244,3 +244,15 @@ void btd_device_foreach_service(struct btd_device *dev,
 				void *user_data);
 void device_remove_pending_services(struct btd_device *dev,
 					uint8_t bdaddr_type);
+
+struct btd_device_prop_stats {
+	const char *name;
+	unsigned int emitted;
+	unsigned int suppressed;	/* Merged into a pending change */
+};
+
+typedef void (*btd_device_prop_stats_func_t)(
+				const struct btd_device_prop_stats *stats,
+				void *user_data);
+void btd_device_foreach_prop_stats(btd_device_prop_stats_func_t func,
+							void *user_data);
@@ -26,6 +26,7 @@
 #include "bluetooth/sdp.h"
 
 #include "src/shared/util.h"
+#include "src/shared/ad.h"
 #include "uuid-helper.h"
 #include "eir.h"
 
@@ -241,36 +242,37 @@ static void eir_parse_data(struct eir_data *eir, uint8_t type,
 		eir->rsi = true;
 }
 
-void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
+static char *view_name2utf8(const uint8_t *data, uint8_t data_len)
 {
-	uint16_t len = 0;
+	/* Some vendors put a NUL byte terminator into the name */
+	while (data_len > 0 && data[data_len - 1] == '\0')
+		data_len--;
 
-	eir->flags = 0;
-	eir->tx_power = 127;
+	return name2utf8(data, data_len);
+}
 
-	/* No EIR data to parse */
-	if (eir_data == NULL)
-		return;
+char *eir_view_get_name(const struct bt_ad_view *view)
+{
+	if (!view || !view->name)
+		return NULL;
 
-	while (len < eir_len - 1) {
-		uint8_t field_len = eir_data[0];
-		const uint8_t *data;
-		uint8_t data_len;
+	return view_name2utf8(view->name, view->name_len);
+}
 
-		/* Check for the end of EIR */
-		if (field_len == 0)
-			break;
+void eir_parse_view(struct eir_data *eir, const struct bt_ad_view *view)
+{
+	struct bt_ad_iter iter;
 
-		len += field_len + 1;
+	eir->flags = 0;
+	eir->tx_power = 127;
 
-		/* Do not continue EIR Data parsing if got incorrect length */
-		if (len > eir_len)
-			break;
+	bt_ad_iter_init(&iter, view);
 
-		data = &eir_data[2];
-		data_len = field_len - 1;
+	while (bt_ad_iter_next(&iter)) {
+		const uint8_t *data = iter.data;
+		uint8_t data_len = iter.len;
 
-		switch (eir_data[1]) {
+		switch (iter.type) {
 		case EIR_UUID16_SOME:
 		case EIR_UUID16_ALL:
 			eir_parse_uuid16(eir, data, data_len);
@@ -294,15 +296,10 @@ void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
 		case EIR_NAME_SHORT:
 		case EIR_NAME_COMPLETE:
 		case EIR_BC_NAME:
-			/* Some vendors put a NUL byte terminator into
-			 * the name */
-			while (data_len > 0 && data[data_len - 1] == '\0')
-				data_len--;
-
 			g_free(eir->name);
 
-			eir->name = name2utf8(data, data_len);
-			eir->name_complete = eir_data[1] != EIR_NAME_SHORT;
+			eir->name = view_name2utf8(data, data_len);
+			eir->name_complete = iter.type != EIR_NAME_SHORT;
 			break;
 
 		case EIR_TX_POWER:
@@ -363,14 +360,20 @@ void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
 			break;
 
 		default:
-			eir_parse_data(eir, eir_data[1], data, data_len);
+			eir_parse_data(eir, iter.type, data, data_len);
 			break;
 		}
-
-		eir_data += field_len + 1;
 	}
 }
 
+void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
+{
+	struct bt_ad_view view;
+
+	bt_ad_view_init(&view, eir_data, eir_len);
+	eir_parse_view(eir, &view);
+}
+
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len)
 {
 
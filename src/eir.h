@@ -93,7 +93,11 @@ struct eir_data {
 };
 
 void eir_data_free(struct eir_data *eir);
+struct bt_ad_view;
+
 void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len);
+void eir_parse_view(struct eir_data *eir, const struct bt_ad_view *view);
+char *eir_view_get_name(const struct bt_ad_view *view);
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len);
 int eir_create_oob(const bdaddr_t *addr, const char *name, uint32_t cod,
 			const uint8_t *hash, const uint8_t *randomizer,
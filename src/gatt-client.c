@@ -91,6 +91,10 @@ struct sock_io {
 	struct io *io;
 	void (*destroy)(void *data);
 	void *data;
+	struct bt_att *att;
+	unsigned int ready_id;
+	uint8_t *pending;	/* Refused while the queue was full */
+	uint16_t pending_len;
 };
 
 struct characteristic {
@@ -1127,10 +1131,58 @@ fail:
 	return btd_error_not_supported(msg);
 }
 
+static bool sock_write(struct characteristic *chrc, const uint8_t *value,
+							uint16_t len)
+{
+	struct bt_gatt_client *gatt = chrc->service->client->gatt;
+
+	if (bt_gatt_client_write_without_response(gatt, chrc->value_handle,
+					chrc->props & BT_GATT_CHRC_PROP_AUTH,
+					value, len))
+		return true;
+
+	/* Only a refusal is followed by the queue becoming ready */
+	return !bt_att_class_is_blocked(bt_gatt_client_get_att(gatt),
+							BT_ATT_CLASS_WRITE);
+}
+
+static void sock_resume(struct sock_io *sock)
+{
+	bt_att_unregister_ready(sock->att, sock->ready_id);
+	bt_att_unref(sock->att);
+	sock->att = NULL;
+	sock->ready_id = 0;
+
+	free(sock->pending);
+	sock->pending = NULL;
+}
+
+static bool sock_read(struct io *io, void *user_data);
+
+static void sock_ready(uint8_t class, void *user_data)
+{
+	struct characteristic *chrc = user_data;
+	struct sock_io *sock = chrc->write_io;
+
+	/* Another producer may have filled the queue again already */
+	if (class != BT_ATT_CLASS_WRITE ||
+				bt_att_class_is_blocked(sock->att, class))
+		return;
+
+	if (chrc->service->client->gatt &&
+			!sock_write(chrc, sock->pending, sock->pending_len))
+		return;
+
+	sock_resume(sock);
+
+	io_set_read_handler(sock->io, sock_read, chrc, NULL);
+}
+
 static bool sock_read(struct io *io, void *user_data)
 {
 	struct characteristic *chrc = user_data;
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
+	struct sock_io *sock;
 	struct msghdr msg;
 	uint8_t buf[512];
 	struct iovec iov;
@@ -1158,11 +1210,22 @@ static bool sock_read(struct io *io, void *user_data)
 	if (!gatt || bytes_read == 0)
 		return false;
 
-	bt_gatt_client_write_without_response(gatt, chrc->value_handle,
-					chrc->props & BT_GATT_CHRC_PROP_AUTH,
-					buf, bytes_read);
+	if (sock_write(chrc, buf, bytes_read) || !chrc->write_io ||
+						io != chrc->write_io->io)
+		return true;
 
-	return true;
+	/*
+	 * Keep the value and stop reading until the queue drained, so the
+	 * application is held back by its socket instead.
+	 */
+	sock = chrc->write_io;
+	sock->att = bt_att_ref(bt_gatt_client_get_att(gatt));
+	sock->pending = util_memdup(buf, bytes_read);
+	sock->pending_len = bytes_read;
+	sock->ready_id = bt_att_register_ready(sock->att, sock_ready, chrc,
+									NULL);
+
+	return false;
 }
 
 static void sock_io_destroy(struct sock_io *io)
@@ -1170,6 +1233,8 @@ static void sock_io_destroy(struct sock_io *io)
 	if (io->destroy)
 		io->destroy(io->data);
 
+	sock_resume(io);
+
 	if (io->msg)
 		dbus_message_unref(io->msg);
 
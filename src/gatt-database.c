@@ -69,6 +69,7 @@ struct btd_gatt_database {
 	GIOChannel *bredr_io;
 	struct queue *records;
 	struct queue *device_states;
+	struct queue *ccc_subscribers;
 	struct queue *ccc_callbacks;
 	struct gatt_db_attribute *svc_chngd;
 	struct gatt_db_attribute *svc_chngd_ccc;
@@ -77,6 +78,7 @@ struct btd_gatt_database {
 	struct gatt_db_attribute *eatt;
 	struct queue *apps;
 	struct queue *profiles;
+	struct btd_gatt_database_stats stats;
 };
 
 struct gatt_app {
@@ -112,7 +114,10 @@ struct client_io {
 	struct bt_att *att;
 	struct external_chrc *chrc;
 	unsigned int disconn_id;
+	unsigned int ready_id;
 	struct io *io;
+	uint8_t *pending;	/* Refused while the queue was full */
+	uint16_t pending_len;
 };
 
 struct external_chrc {
@@ -166,8 +171,10 @@ struct notify {
 	uint16_t handle, ccc_handle;
 	uint8_t *value;
 	uint16_t len;
+	struct bt_att_pdu *pdu;		/* Shared by all subscribers */
 	bt_gatt_server_conf_func_t conf;
 	void *user_data;
+	bool failed;
 };
 
 #define CLI_FEAT_SIZE 1
@@ -189,10 +196,17 @@ typedef uint8_t (*btd_gatt_database_ccc_write_t) (struct pending_op *op,
 typedef void (*btd_gatt_database_destroy_t) (void *data);
 
 struct ccc_state {
+	struct device_state *state;
 	uint16_t handle;
 	uint16_t value;
 };
 
+/* States with notifications or indications enabled for a CCC */
+struct ccc_subscribers {
+	uint16_t handle;
+	struct queue *cccs;
+};
+
 struct ccc_cb_data {
 	uint16_t handle;
 	btd_gatt_database_ccc_write_t callback;
@@ -275,6 +289,73 @@ static struct ccc_state *find_ccc_state(struct device_state *dev_state,
 							UINT_TO_PTR(handle));
 }
 
+static bool ccc_subscribers_match(const void *a, const void *b)
+{
+	const struct ccc_subscribers *subs = a;
+	uint16_t handle = PTR_TO_UINT(b);
+
+	return subs->handle == handle;
+}
+
+static void ccc_subscribers_free(void *data)
+{
+	struct ccc_subscribers *subs = data;
+
+	queue_destroy(subs->cccs, NULL);
+	free(subs);
+}
+
+static struct queue *find_ccc_subscribers(struct btd_gatt_database *db,
+							uint16_t handle)
+{
+	struct ccc_subscribers *subs;
+
+	subs = queue_find(db->ccc_subscribers, ccc_subscribers_match,
+							UINT_TO_PTR(handle));
+	if (!subs)
+		return NULL;
+
+	return subs->cccs;
+}
+
+static void ccc_set_value(struct ccc_state *ccc, uint16_t value)
+{
+	struct btd_gatt_database *db = ccc->state->db;
+	bool subscribed = ccc->value & 0x0003;
+	struct ccc_subscribers *subs;
+
+	ccc->value = value;
+
+	if (subscribed == !!(value & 0x0003))
+		return;
+
+	subs = queue_find(db->ccc_subscribers, ccc_subscribers_match,
+						UINT_TO_PTR(ccc->handle));
+
+	if (subscribed) {
+		if (subs)
+			queue_remove(subs->cccs, ccc);
+		return;
+	}
+
+	if (!subs) {
+		subs = new0(struct ccc_subscribers, 1);
+		subs->handle = ccc->handle;
+		subs->cccs = queue_new();
+		queue_push_tail(db->ccc_subscribers, subs);
+	}
+
+	queue_push_tail(subs->cccs, ccc);
+}
+
+static void ccc_state_free(void *data)
+{
+	struct ccc_state *ccc = data;
+
+	ccc_set_value(ccc, 0);
+	free(ccc);
+}
+
 static struct device_state *device_state_create(struct btd_gatt_database *db,
 							const bdaddr_t *bdaddr,
 							uint8_t bdaddr_type)
@@ -294,7 +375,7 @@ static void device_state_free(void *data)
 {
 	struct device_state *state = data;
 
-	queue_destroy(state->ccc_states, free);
+	queue_destroy(state->ccc_states, ccc_state_free);
 
 	if (state->pending) {
 		free(state->pending->value);
@@ -445,6 +526,7 @@ static struct ccc_state *get_ccc_state(struct btd_gatt_database *database,
 		return ccc;
 
 	ccc = new0(struct ccc_state, 1);
+	ccc->state = dev_state;
 	ccc->handle = handle;
 	queue_push_tail(dev_state->ccc_states, ccc);
 
@@ -475,8 +557,10 @@ static void client_io_free(void *data)
 	struct client_io *client = data;
 
 	bt_att_unregister_disconnect(client->att, client->disconn_id);
+	bt_att_unregister_ready(client->att, client->ready_id);
 	bt_att_unref(client->att);
 	io_destroy(client->io);
+	free(client->pending);
 	free(client);
 }
 
@@ -631,10 +715,12 @@ static void gatt_database_free(void *data)
 
 	queue_destroy(database->records, gatt_record_free);
 	queue_destroy(database->device_states, device_state_free);
+	queue_destroy(database->ccc_subscribers, ccc_subscribers_free);
 	queue_destroy(database->apps, app_free);
 	queue_destroy(database->profiles, profile_free);
 	queue_destroy(database->ccc_callbacks, ccc_cb_free);
 	database->device_states = NULL;
+	database->ccc_subscribers = NULL;
 	database->ccc_callbacks = NULL;
 
 	gatt_db_unref(database->db);
@@ -1092,7 +1178,7 @@ static void gatt_ccc_write_cb(struct gatt_db_attribute *attrib,
 	}
 
 	if (!ecode)
-		ccc->value = val;
+		ccc_set_value(ccc, val);
 
 done:
 	gatt_db_attribute_write_result(attrib, id, ecode);
@@ -1398,28 +1484,20 @@ static void state_set_pending(struct device_state *state, struct notify *notify)
 	/* Copy notify contents to pending */
 	state->pending = new0(struct notify, 1);
 	memcpy(state->pending, notify, sizeof(*notify));
+	state->pending->pdu = NULL;
 	state->pending->value = malloc(notify->len);
 	memcpy(state->pending->value, notify->value, notify->len);
 }
 
-static void send_notification_to_device(void *data, void *user_data)
+static void send_notification_to_ccc(void *data, void *user_data)
 {
-	struct device_state *device_state = data;
+	struct ccc_state *ccc = data;
+	struct device_state *device_state = ccc->state;
 	struct notify *notify = user_data;
-	struct ccc_state *ccc;
 	struct btd_device *device;
 	struct bt_gatt_server *server;
 
-	if (notify->conf == service_changed_conf) {
-		if (device_state->cli_feat[0] &
-				BT_GATT_CHRC_CLI_FEAT_ROBUST_CACHING) {
-			device_state->change_aware = false;
-			notify->user_data = device_state;
-		}
-	}
-
-	ccc = find_ccc_state(device_state, notify->ccc_handle);
-	if (!ccc || !(ccc->value & 0x0003))
+	if (!(ccc->value & 0x0003))
 		return;
 
 	device = btd_adapter_find_device(notify->database->adapter,
@@ -1447,15 +1525,39 @@ static void send_notification_to_device(void *data, void *user_data)
 	 * notification/indication when it becomes connected.
 	 */
 	if (!(ccc->value & 0x0002)) {
+		bool multiple = device_state->cli_feat[0] &
+					BT_GATT_CHRC_CLI_FEAT_NFY_MULTI;
+
 		DBG("GATT server sending notification");
-		bt_gatt_server_send_notification(server,
+
+		__sync_fetch_and_add(&notify->database->stats.notifications, 1);
+
+		/*
+		 * The shared PDU is only skipped when it couldn't be allocated,
+		 * any other failure, e.g. the notification class being at its
+		 * limit, would fail the same way below.
+		 */
+		if (notify->pdu && !multiple) {
+			if (!bt_gatt_server_send_notification_pdu(server,
+							notify->pdu)) {
+				error("Unable to send notification 0x%04x",
+							notify->handle);
+				notify->failed = true;
+			}
+			return;
+		}
+
+		if (!bt_gatt_server_send_notification(server,
 					notify->handle, notify->value,
-					notify->len, device_state->cli_feat[0] &
-					BT_GATT_CHRC_CLI_FEAT_NFY_MULTI);
+					notify->len, multiple))
+			notify->failed = true;
 		return;
 	}
 
 	DBG("GATT server sending indication");
+
+	__sync_fetch_and_add(&notify->database->stats.indications, 1);
+
 	bt_gatt_server_send_indication(server, notify->handle, notify->value,
 						notify->len, notify->conf,
 						notify->user_data, NULL);
@@ -1471,6 +1573,57 @@ remove:
 	}
 }
 
+static void send_notification_to_device(void *data, void *user_data)
+{
+	struct device_state *device_state = data;
+	struct notify *notify = user_data;
+	struct ccc_state *ccc;
+
+	if (notify->conf == service_changed_conf) {
+		if (device_state->cli_feat[0] &
+				BT_GATT_CHRC_CLI_FEAT_ROBUST_CACHING) {
+			device_state->change_aware = false;
+			notify->user_data = device_state;
+		}
+	}
+
+	ccc = find_ccc_state(device_state, notify->ccc_handle);
+	if (!ccc)
+		return;
+
+	send_notification_to_ccc(ccc, notify);
+}
+
+/*
+ * Notifications only go to the subscribers of the CCC, with the PDU encoded
+ * once for all of them. Service Changed is sent through every device state
+ * since it also updates the change awareness of unsubscribed clients.
+ */
+static void send_notification_to_subscribers(struct notify *notify)
+{
+	struct btd_gatt_database *database = notify->database;
+	struct queue *subscribers;
+
+	if (notify->conf == service_changed_conf) {
+		queue_foreach(database->device_states,
+					send_notification_to_device, notify);
+		return;
+	}
+
+	subscribers = find_ccc_subscribers(database, notify->ccc_handle);
+	if (queue_isempty(subscribers))
+		return;
+
+	notify->pdu = bt_gatt_server_notification_pdu_new(notify->handle,
+							notify->value,
+							notify->len);
+
+	queue_foreach(subscribers, send_notification_to_ccc, notify);
+
+	bt_att_pdu_unref(notify->pdu);
+	notify->pdu = NULL;
+}
+
 static void gatt_notify_cb(struct gatt_db_attribute *attrib,
 					struct gatt_db_attribute *ccc,
 					const uint8_t *value, size_t len,
@@ -1500,8 +1653,7 @@ static void gatt_notify_cb(struct gatt_db_attribute *attrib,
 
 		send_notification_to_device(state, &notify);
 	} else
-		queue_foreach(database->device_states,
-				send_notification_to_device, &notify);
+		send_notification_to_subscribers(&notify);
 }
 
 static void register_core_services(struct btd_gatt_database *database)
@@ -1532,8 +1684,7 @@ static void send_notification_to_devices(struct btd_gatt_database *database,
 	notify.conf = conf;
 	notify.user_data = user_data;
 
-	queue_foreach(database->device_states, send_notification_to_device,
-								&notify);
+	send_notification_to_subscribers(&notify);
 }
 
 static void send_service_changed(struct btd_gatt_database *database,
@@ -1606,7 +1757,8 @@ static void remove_device_ccc(void *data, void *user_data)
 {
 	struct device_state *state = data;
 
-	queue_remove_all(state->ccc_states, ccc_match_service, user_data, free);
+	queue_remove_all(state->ccc_states, ccc_match_service, user_data,
+							ccc_state_free);
 }
 
 static bool match_gatt_record(const void *data, const void *user_data)
@@ -2625,14 +2777,64 @@ static void sock_io_conf(void *user_data)
 	io_set_write_handler(io, sock_io_write, NULL, NULL);
 }
 
-static bool sock_io_read(struct io *io, void *user_data)
+/* Returns false if the value was refused as the ATT queue is full */
+static bool sock_io_notify(struct client_io *client,
+					struct device_state *state,
+					uint8_t *value, uint16_t len)
+{
+	struct external_chrc *chrc = client->chrc;
+	struct notify notify;
+
+	memset(&notify, 0, sizeof(notify));
+
+	notify.database = chrc->service->app->database;
+	notify.handle = gatt_db_attribute_get_handle(chrc->attrib);
+	notify.ccc_handle = gatt_db_attribute_get_handle(chrc->ccc);
+	notify.value = value;
+	notify.len = len;
+	notify.conf = sock_io_conf;
+	notify.user_data = client->io;
+
+	send_notification_to_device(state, &notify);
+
+	return !notify.failed ||
+		!bt_att_class_is_blocked(client->att, BT_ATT_CLASS_WRITE);
+}
+
+static bool sock_io_read(struct io *io, void *user_data);
+
+static void sock_io_ready(uint8_t class, void *user_data)
 {
 	struct client_io *client = user_data;
 	struct external_chrc *chrc = client->chrc;
+	struct device_state *state;
+
+	/* Another producer may have filled the queue again already */
+	if (class != BT_ATT_CLASS_WRITE ||
+				bt_att_class_is_blocked(client->att, class))
+		return;
+
+	state = find_device_state_by_att(chrc->service->app->database,
+							client->att);
+	if (state && !sock_io_notify(client, state, client->pending,
+							client->pending_len))
+		return;
+
+	bt_att_unregister_ready(client->att, client->ready_id);
+	client->ready_id = 0;
+
+	free(client->pending);
+	client->pending = NULL;
+
+	io_set_read_handler(client->io, sock_io_read, client, NULL);
+}
+
+static bool sock_io_read(struct io *io, void *user_data)
+{
+	struct client_io *client = user_data;
 	uint8_t buf[512];
 	int fd = io_get_fd(io);
 	ssize_t bytes_read;
-	struct notify notify;
 	struct device_state *state;
 
 	if (fd < 0) {
@@ -2644,24 +2846,24 @@ static bool sock_io_read(struct io *io, void *user_data)
 	if (bytes_read <= 0)
 		return false;
 
-	memset(&notify, 0, sizeof(notify));
-
-	notify.database = client->chrc->service->app->database;
-	notify.handle = gatt_db_attribute_get_handle(chrc->attrib);
-	notify.ccc_handle = gatt_db_attribute_get_handle(chrc->ccc);
-	notify.value = (void *) buf;
-	notify.len = bytes_read;
-	notify.conf = sock_io_conf;
-	notify.user_data = io;
-
-
-	state = find_device_state_by_att(notify.database, client->att);
+	state = find_device_state_by_att(client->chrc->service->app->database,
+							client->att);
 	if (!state)
 		return false;
 
-	send_notification_to_device(state, &notify);
+	if (sock_io_notify(client, state, buf, bytes_read))
+		return true;
 
-	return true;
+	/*
+	 * Keep the value and stop reading until the queue drained, so the
+	 * application is held back by its socket instead.
+	 */
+	client->pending = util_memdup(buf, bytes_read);
+	client->pending_len = bytes_read;
+	client->ready_id = bt_att_register_ready(client->att, sock_io_ready,
+								client, NULL);
+
+	return false;
 }
 
 static struct io *sock_io_new(int fd, void *user_data)
@@ -4052,6 +4254,7 @@ struct btd_gatt_database *btd_gatt_database_new(struct btd_adapter *adapter)
 	database->db = gatt_db_new();
 	database->records = queue_new();
 	database->device_states = queue_new();
+	database->ccc_subscribers = queue_new();
 	database->apps = queue_new();
 	database->profiles = queue_new();
 	database->ccc_callbacks = queue_new();
@@ -4176,6 +4379,22 @@ btd_gatt_database_get_adapter(struct btd_gatt_database *database)
 	return database->adapter;
 }
 
+bool btd_gatt_database_get_stats(struct btd_gatt_database *database,
+				struct btd_gatt_database_stats *stats)
+{
+	struct gatt_db_stats db_stats;
+
+	if (!database || !stats)
+		return false;
+
+	*stats = database->stats;
+
+	if (gatt_db_get_stats(database->db, &db_stats))
+		stats->hash_updates = db_stats.hash_updates;
+
+	return true;
+}
+
 struct gatt_db *btd_gatt_database_get_db(struct btd_gatt_database *database)
 {
 	if (!database)
@@ -4246,9 +4465,10 @@ static void restore_ccc(struct btd_gatt_database *database,
 	queue_push_tail(database->device_states, dev_state);
 
 	ccc = new0(struct ccc_state, 1);
+	ccc->state = dev_state;
 	ccc->handle = gatt_db_attribute_get_handle(database->svc_chngd_ccc);
-	ccc->value = value;
 	queue_push_tail(dev_state->ccc_states, ccc);
+	ccc_set_value(ccc, value);
 }
 
 static void restore_state(struct btd_device *device, void *data)
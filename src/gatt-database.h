@@ -18,6 +18,15 @@ struct gatt_db *btd_gatt_database_get_db(struct btd_gatt_database *database);
 struct btd_adapter *
 btd_gatt_database_get_adapter(struct btd_gatt_database *database);
 
+struct btd_gatt_database_stats {
+	unsigned int notifications;	/* Sent to each subscribed client */
+	unsigned int indications;
+	unsigned int hash_updates;	/* Database Hash computations */
+};
+
+bool btd_gatt_database_get_stats(struct btd_gatt_database *database,
+				struct btd_gatt_database_stats *stats);
+
 void btd_gatt_database_att_disconnected(struct btd_gatt_database *database,
 						struct btd_device *device);
 void btd_gatt_database_server_connected(struct btd_gatt_database *database,
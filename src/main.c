@@ -42,9 +42,11 @@
 
 #include "shared/att-types.h"
 #include "shared/mainloop.h"
+#include "shared/io.h"
 #include "shared/timeout.h"
 #include "shared/queue.h"
 #include "shared/crypto.h"
+#include "shared/stats.h"
 #include "bluetooth/uuid.h"
 #include "shared/util.h"
 #include "btd.h"
@@ -54,6 +56,7 @@
 #include "dbus-common.h"
 #include "agent.h"
 #include "profile.h"
+#include "statistics.h"
 
 #define BLUEZ_NAME "org.bluez"
 
@@ -92,6 +95,10 @@ static const char *supported_options[] = {
 	"KernelExperimental",
 	"RemoteNameRequestRetryDelay",
 	"FilterDiscoverable",
+	"MgmtCommandWindow",
+	"DevicePropertyWindow",
+	"DevicePropertyMaxRate",
+	"Statistics",
 	NULL
 };
 
@@ -1116,6 +1123,17 @@ static void parse_general(GKeyFile *config)
 					0, UINT32_MAX);
 	parse_config_bool(config, "General", "FilterDiscoverable",
 						&btd_opts.filter_discoverable);
+	parse_config_u8(config, "General", "MgmtCommandWindow",
+						&btd_opts.mgmt_window,
+						0, UINT8_MAX);
+	parse_config_u32(config, "General", "DevicePropertyWindow",
+						&btd_opts.prop_window,
+						0, 60000);
+	parse_config_u32(config, "General", "DevicePropertyMaxRate",
+						&btd_opts.prop_max_rate,
+						0, 1000);
+	parse_config_bool(config, "General", "Statistics",
+						&btd_opts.statistics);
 }
 
 static void parse_gatt_cache(GKeyFile *config)
@@ -1489,6 +1507,47 @@ static void signal_callback(int signum, void *user_data)
 	}
 }
 
+static bool stats_signal_read(struct io *io, void *user_data)
+{
+	struct signalfd_siginfo si;
+
+	if (read(io_get_fd(io), &si, sizeof(si)) != sizeof(si))
+		return false;
+
+	btd_statistics_dump();
+
+	return true;
+}
+
+/*
+ * SIGUSR1 dumps the statistics. It is handled here rather than in the
+ * shared signal handling, since other users of the mainloop expect the
+ * default action.
+ */
+static struct io *setup_stats_signal(void)
+{
+	struct io *io;
+	sigset_t mask;
+	int fd;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		return NULL;
+
+	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	io = io_new(fd);
+
+	io_set_close_on_destroy(io, true);
+	io_set_read_handler(io, stats_signal_read, NULL, NULL);
+
+	return io;
+}
+
 static char *option_debug = NULL;
 static char *option_plugin = NULL;
 static char *option_noplugin = NULL;
@@ -1609,6 +1668,7 @@ int main(int argc, char *argv[])
 	uint16_t sdp_mtu = 0;
 	uint32_t sdp_flags = 0;
 	int gdbus_flags = 0;
+	struct io *stats_io = NULL;
 
 	init_defaults();
 
@@ -1652,6 +1712,8 @@ int main(int argc, char *argv[])
 
 	parse_config(main_conf);
 
+	stats_set_enabled(btd_opts.statistics);
+
 	if (connect_dbus() < 0) {
 		error("Unable to get on D-Bus");
 		exit(1);
@@ -1706,8 +1768,13 @@ int main(int argc, char *argv[])
 	mainloop_sd_notify("STATUS=Running");
 	mainloop_sd_notify("READY=1");
 
+	if (btd_opts.statistics)
+		stats_io = setup_stats_signal();
+
 	mainloop_run_with_signal(signal_callback, NULL);
 
+	io_destroy(stats_io);
+
 	mainloop_sd_notify("STATUS=Quitting");
 
 	plugin_cleanup();
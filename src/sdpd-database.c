@@ -27,12 +27,42 @@
 
 static sdp_list_t *service_db;
 static sdp_list_t *access_db;
+static sdp_list_t *pdu_db;
 
 typedef struct {
 	uint32_t handle;
 	bdaddr_t device;
 } sdp_access_t;
 
+/*
+ * Encoded attribute list of a record, valid while the generation matches
+ * db_generation.
+ */
+typedef struct {
+	uint32_t handle;
+	const sdp_record_t *record;
+	unsigned int generation;
+	sdp_buf_t pdu;
+} sdp_pdu_cache_t;
+
+/*
+ * UUID to record index, built on demand from the record patterns. The
+ * record lists are in handle order, just like service_db.
+ */
+#define UUID_INDEX_SIZE 64
+
+typedef struct {
+	uuid_t *uuid;
+	sdp_list_t *records;
+	int count;
+} sdp_uuid_index_t;
+
+static sdp_list_t *uuid_index[UUID_INDEX_SIZE];
+
+/* Bumped whenever a record is added, removed or modified */
+static unsigned int db_generation = 1;
+static unsigned int index_generation;
+
 /*
  * Ordering function called when inserting a service record.
  * The service repository is a linked list in sorted order
@@ -69,6 +99,42 @@ static void access_free(void *p)
 	free(p);
 }
 
+static int pdu_cache_sort(const void *r1, const void *r2)
+{
+	const sdp_pdu_cache_t *rec1 = r1;
+	const sdp_pdu_cache_t *rec2 = r2;
+
+	return rec1->handle - rec2->handle;
+}
+
+static void pdu_cache_free(void *p)
+{
+	sdp_pdu_cache_t *cache = p;
+
+	free(cache->pdu.data);
+	free(cache);
+}
+
+static void uuid_index_free(void *p)
+{
+	sdp_uuid_index_t *entry = p;
+
+	sdp_list_free(entry->records, NULL);
+	free(entry);
+}
+
+static void uuid_index_clear(void)
+{
+	int i;
+
+	for (i = 0; i < UUID_INDEX_SIZE; i++) {
+		sdp_list_free(uuid_index[i], uuid_index_free);
+		uuid_index[i] = NULL;
+	}
+
+	index_generation = 0;
+}
+
 /*
  * Reset the service repository by deleting its contents
  */
@@ -79,6 +145,22 @@ void sdp_svcdb_reset(void)
 
 	sdp_list_free(access_db, access_free);
 	access_db = NULL;
+
+	sdp_list_free(pdu_db, pdu_cache_free);
+	pdu_db = NULL;
+
+	uuid_index_clear();
+	db_generation++;
+}
+
+/*
+ * Records are modified in place after they have been added, e.g. when the
+ * handle or the database state attribute is set, so cached data can only
+ * be invalidated once the caller is done with its changes.
+ */
+void sdp_svcdb_update(void)
+{
+	db_generation++;
 }
 
 typedef struct _indexed {
@@ -176,6 +258,8 @@ void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec)
 	dev->handle = rec->handle;
 
 	access_db = sdp_list_insert_sorted(access_db, dev, access_sort);
+
+	db_generation++;
 }
 
 static sdp_list_t *record_locate(uint32_t handle)
@@ -208,6 +292,15 @@ static sdp_list_t *access_locate(uint32_t handle)
 	return NULL;
 }
 
+static sdp_list_t *pdu_cache_locate(uint32_t handle)
+{
+	sdp_pdu_cache_t c;
+
+	c.handle = handle;
+
+	return sdp_list_find(pdu_db, &c, pdu_cache_sort);
+}
+
 /*
  * Given a service record handle, find the record associated with it.
  */
@@ -241,6 +334,16 @@ int sdp_record_remove(uint32_t handle)
 	if (r)
 		service_db = sdp_list_remove(service_db, r);
 
+	db_generation++;
+
+	p = pdu_cache_locate(handle);
+	if (p) {
+		sdp_pdu_cache_t *cache = p->data;
+
+		pdu_db = sdp_list_remove(pdu_db, cache);
+		pdu_cache_free(cache);
+	}
+
 	p = access_locate(handle);
 	if (p == NULL || p->data == NULL)
 		return 0;
@@ -261,6 +364,143 @@ sdp_list_t *sdp_get_record_list(void)
 	return service_db;
 }
 
+static unsigned int uuid_hash(const uuid_t *uuid128)
+{
+	const uint8_t *data = uuid128->value.uuid128.data;
+	unsigned int i, hash = 0;
+
+	for (i = 0; i < sizeof(uuid128->value.uuid128.data); i++)
+		hash = hash * 31 + data[i];
+
+	return hash % UUID_INDEX_SIZE;
+}
+
+static sdp_uuid_index_t *uuid_index_find(const uuid_t *uuid128)
+{
+	sdp_list_t *p;
+
+	for (p = uuid_index[uuid_hash(uuid128)]; p; p = p->next) {
+		sdp_uuid_index_t *entry = p->data;
+
+		if (!sdp_uuid128_cmp(entry->uuid, uuid128))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void uuid_index_build(void)
+{
+	sdp_list_t *r, *p;
+
+	uuid_index_clear();
+
+	for (r = service_db; r; r = r->next) {
+		sdp_record_t *rec = r->data;
+
+		for (p = rec->pattern; p; p = p->next) {
+			uuid_t *uuid = p->data;
+			sdp_uuid_index_t *entry;
+
+			if (!uuid)
+				continue;
+
+			entry = uuid_index_find(uuid);
+			if (!entry) {
+				unsigned int hash = uuid_hash(uuid);
+
+				entry = malloc(sizeof(*entry));
+				if (!entry)
+					continue;
+
+				entry->uuid = uuid;
+				entry->records = NULL;
+				entry->count = 0;
+				uuid_index[hash] = sdp_list_append(
+							uuid_index[hash], entry);
+			}
+
+			entry->records = sdp_list_append(entry->records, rec);
+			entry->count++;
+		}
+	}
+
+	index_generation = db_generation;
+}
+
+/*
+ * Return the records that may match all UUIDs of the search pattern, in
+ * sorted order. This is the shortest list of records containing one of
+ * the UUIDs, so callers still need to match the whole pattern.
+ */
+sdp_list_t *sdp_get_uuid_record_list(sdp_list_t *search)
+{
+	sdp_uuid_index_t *best = NULL;
+
+	if (!search)
+		return service_db;
+
+	if (index_generation != db_generation)
+		uuid_index_build();
+
+	for (; search; search = search->next) {
+		sdp_uuid_index_t *entry;
+		uuid_t *uuid128;
+
+		if (!search->data)
+			return NULL;
+
+		uuid128 = sdp_uuid_to_uuid128(search->data);
+		entry = uuid_index_find(uuid128);
+		bt_free(uuid128);
+
+		/* No record contains this UUID */
+		if (!entry)
+			return NULL;
+
+		if (!best || entry->count < best->count)
+			best = entry;
+	}
+
+	return best->records;
+}
+
+/*
+ * Return the attribute list of a record encoded as PDU. The buffer belongs
+ * to the repository and is only valid until the next change of it.
+ */
+const sdp_buf_t *sdp_record_get_pdu(const sdp_record_t *rec)
+{
+	sdp_list_t *p = pdu_cache_locate(rec->handle);
+	sdp_pdu_cache_t *cache;
+
+	if (p) {
+		cache = p->data;
+		if (cache->record == rec && cache->generation == db_generation)
+			return &cache->pdu;
+
+		free(cache->pdu.data);
+	} else {
+		cache = malloc(sizeof(*cache));
+		if (!cache)
+			return NULL;
+
+		cache->handle = rec->handle;
+		pdu_db = sdp_list_insert_sorted(pdu_db, cache, pdu_cache_sort);
+	}
+
+	cache->record = rec;
+	cache->generation = db_generation;
+
+	if (sdp_gen_record_pdu(rec, &cache->pdu) < 0) {
+		pdu_db = sdp_list_remove(pdu_db, cache);
+		free(cache);
+		return NULL;
+	}
+
+	return &cache->pdu;
+}
+
 int sdp_check_access(uint32_t handle, bdaddr_t *device)
 {
 	sdp_list_t *p = access_locate(handle);
@@ -459,8 +459,8 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 	buf->data_size += sizeof(uint16_t);
 
 	if (cstate == NULL) {
-		/* for every record in the DB, do a pattern search */
-		sdp_list_t *list = sdp_get_record_list();
+		/* for every record containing the UUIDs, do a pattern search */
+		sdp_list_t *list = sdp_get_uuid_record_list(pattern);
 
 		handleSize = 0;
 		for (; list && rsp_count < expected; list = list->next) {
@@ -594,7 +594,7 @@ done:
  */
 static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 {
-	sdp_buf_t pdu;
+	const sdp_buf_t *pdu;
 
 	if (!rec)
 		return SDP_INVALID_RECORD_HANDLE;
@@ -606,7 +606,8 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 
 	SDPDBG("Entries in attr seq : %d", sdp_list_len(seq));
 
-	sdp_gen_record_pdu(rec, &pdu);
+	/* Encoded once and shared until the record changes */
+	pdu = sdp_record_get_pdu(rec);
 
 	for (; seq; seq = seq->next) {
 		struct attrid *aid = seq->data;
@@ -629,10 +630,11 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 			SDPDBG("Low id : 0x%x", low);
 			SDPDBG("High id : 0x%x", high);
 
-			if (low == 0x0000 && high == 0xffff && pdu.data_size <= buf->buf_size) {
+			if (low == 0x0000 && high == 0xffff && pdu &&
+					pdu->data_size <= buf->buf_size) {
 				/* copy it */
-				memcpy(buf->data, pdu.data, pdu.data_size);
-				buf->data_size = pdu.data_size;
+				memcpy(buf->data, pdu->data, pdu->data_size);
+				buf->data_size = pdu->data_size;
 				break;
 			}
 			/* (else) sub-range of attributes */
@@ -647,13 +649,10 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 		} else {
 			error("Unexpected data type : 0x%x", aid->dtd);
 			error("Expect uint16_t or uint32_t");
-			free(pdu.data);
 			return SDP_INVALID_SYNTAX;
 		}
 	}
 
-	free(pdu.data);
-
 	return 0;
 }
 
@@ -906,7 +905,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 		goto done;
 	}
 
-	svcList = sdp_get_record_list();
+	svcList = sdp_get_uuid_record_list(pattern);
 
 	tmpbuf.data = malloc(USHRT_MAX);
 	tmpbuf.data_size = 0;
@@ -305,6 +305,9 @@ static void update_db_timestamp(void)
 		sdp_data_t *d = sdp_data_alloc(SDP_UINT32, &dbts);
 		sdp_attr_replace(server, SDP_ATTR_SVCDB_STATE, d);
 	}
+
+	/* Every change of the repository ends up here */
+	sdp_svcdb_update();
 }
 
 void set_fixed_db_timestamp(uint32_t dbts)
@@ -52,10 +52,13 @@ void sdp_svcdb_reset(void);
 void sdp_svcdb_collect_all(int sock);
 void sdp_svcdb_set_collectable(sdp_record_t *rec, int sock);
 void sdp_svcdb_collect(sdp_record_t *rec);
+void sdp_svcdb_update(void);
 sdp_record_t *sdp_record_find(uint32_t handle);
 void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec);
 int sdp_record_remove(uint32_t handle);
 sdp_list_t *sdp_get_record_list(void);
+sdp_list_t *sdp_get_uuid_record_list(sdp_list_t *search);
+const sdp_buf_t *sdp_record_get_pdu(const sdp_record_t *rec);
 int sdp_check_access(uint32_t handle, bdaddr_t *device);
 uint32_t sdp_next_handle(void);
 
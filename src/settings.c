@@ -12,7 +12,13 @@
 #endif
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -524,3 +530,93 @@ void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename)
 	g_free(data);
 	g_key_file_free(key_file);
 }
+
+int btd_settings_gatt_cache_load(struct gatt_db *db, const char *filename)
+{
+	struct stat st;
+	void *data;
+	int fd, err = 0;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		goto done;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		err = -errno;
+		goto done;
+	}
+
+	if (!gatt_db_import(db, data, st.st_size)) {
+		DBG("Unable to import cache from %s", filename);
+		err = -EIO;
+	}
+
+	munmap(data, st.st_size);
+
+done:
+	close(fd);
+	return err;
+}
+
+static bool gatt_cache_is_current(const char *filename, const uint8_t *hash)
+{
+	uint8_t hdr[32], zero[16] = {};
+	const uint8_t *cur;
+	ssize_t len;
+	int fd;
+
+	/* Databases without a hash cannot be told apart */
+	if (!hash || !memcmp(hash, zero, sizeof(zero)))
+		return false;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	len = read(fd, hdr, sizeof(hdr));
+	close(fd);
+
+	if (len < 0)
+		return false;
+
+	cur = gatt_db_export_get_hash(hdr, len);
+
+	return cur && !memcmp(cur, hash, 16);
+}
+
+/* Returns true if the file holds the current database afterwards */
+bool btd_settings_gatt_cache_store(struct gatt_db *db, const char *filename)
+{
+	GError *gerr = NULL;
+	uint8_t *data;
+	size_t len;
+	bool ret = true;
+
+	data = gatt_db_export(db, &len);
+	if (!data)
+		return false;
+
+	/* The cache is keyed by the Database Hash, skip if it didn't change */
+	if (gatt_cache_is_current(filename, gatt_db_export_get_hash(data,
+								len))) {
+		free(data);
+		return true;
+	}
+
+	if (!g_file_set_contents(filename, (char *) data, len, &gerr)) {
+		DBG("Unable set contents for %s: (%s)", filename,
+								gerr->message);
+		g_error_free(gerr);
+		ret = false;
+	}
+
+	free(data);
+
+	return ret;
+}
@@ -1479,3 +1479,596 @@ struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 
 	return info.matched_pattern;
 }
+
+void bt_ad_view_init(struct bt_ad_view *view, const uint8_t *data,
+								size_t len)
+{
+	size_t offset = 0;
+
+	memset(view, 0, sizeof(*view));
+	view->data = data;
+	view->tx_power = 127;
+
+	if (!data)
+		return;
+
+	while (offset + 1 < len) {
+		uint8_t field_len = data[offset];
+		uint8_t type = data[offset + 1];
+		const uint8_t *field = &data[offset + 2];
+
+		/* Stop at the end of data or at the first malformed field */
+		if (!field_len || offset + field_len + 1 > len)
+			break;
+
+		view->types[type / 8] |= 1 << (type % 8);
+
+		switch (type) {
+		case BT_AD_FLAGS:
+			if (field_len > 1)
+				view->flags = field[0];
+			break;
+		case BT_AD_TX_POWER:
+			if (field_len > 1)
+				view->tx_power = (int8_t) field[0];
+			break;
+		case BT_AD_NAME_SHORT:
+		case BT_AD_NAME_COMPLETE:
+		case BT_AD_BROADCAST_NAME:
+			view->name = field;
+			view->name_len = field_len - 1;
+			view->name_complete = type != BT_AD_NAME_SHORT;
+			break;
+		}
+
+		offset += field_len + 1;
+	}
+
+	view->len = offset;
+}
+
+bool bt_ad_view_has_type(const struct bt_ad_view *view, uint8_t type)
+{
+	if (!view)
+		return false;
+
+	return view->types[type / 8] & (1 << (type % 8));
+}
+
+void bt_ad_iter_init(struct bt_ad_iter *iter, const struct bt_ad_view *view)
+{
+	memset(iter, 0, sizeof(*iter));
+	iter->view = view;
+}
+
+bool bt_ad_iter_next(struct bt_ad_iter *iter)
+{
+	const struct bt_ad_view *view = iter->view;
+
+	if (!view || iter->offset >= view->len)
+		return false;
+
+	iter->len = view->data[iter->offset] - 1;
+	iter->type = view->data[iter->offset + 1];
+	iter->data = &view->data[iter->offset + 2];
+	iter->pos = 0;
+	iter->offset += iter->len + 2;
+
+	return true;
+}
+
+bool bt_ad_iter_next_type(struct bt_ad_iter *iter, uint8_t type)
+{
+	if (!bt_ad_view_has_type(iter->view, type))
+		return false;
+
+	while (bt_ad_iter_next(iter)) {
+		if (iter->type == type)
+			return true;
+	}
+
+	return false;
+}
+
+static bool view_get_uuid(const uint8_t *data, uint8_t len, bt_uuid_t *uuid)
+{
+	uint128_t value;
+
+	switch (len) {
+	case 2:
+		return !bt_uuid16_create(uuid, get_le16(data));
+	case 4:
+		return !bt_uuid32_create(uuid, get_le32(data));
+	case 16:
+		bswap_128(data, &value);
+		return !bt_uuid128_create(uuid, value);
+	}
+
+	return false;
+}
+
+bool bt_ad_iter_next_uuid(struct bt_ad_iter *iter, bt_uuid_t *uuid)
+{
+	do {
+		uint8_t size;
+
+		switch (iter->type) {
+		case BT_AD_UUID16_SOME:
+		case BT_AD_UUID16_ALL:
+			size = 2;
+			break;
+		case BT_AD_UUID32_SOME:
+		case BT_AD_UUID32_ALL:
+			size = 4;
+			break;
+		case BT_AD_UUID128_SOME:
+		case BT_AD_UUID128_ALL:
+			size = 16;
+			break;
+		default:
+			continue;
+		}
+
+		/* Trailing octets not forming a whole UUID are ignored */
+		while (iter->pos + size <= iter->len) {
+			const uint8_t *data = iter->data + iter->pos;
+
+			iter->pos += size;
+
+			if (view_get_uuid(data, size, uuid))
+				return true;
+		}
+	} while (bt_ad_iter_next(iter));
+
+	return false;
+}
+
+bool bt_ad_iter_next_service_data(struct bt_ad_iter *iter, bt_uuid_t *uuid,
+					const uint8_t **data, uint8_t *len)
+{
+	while (bt_ad_iter_next(iter)) {
+		uint8_t size;
+
+		switch (iter->type) {
+		case BT_AD_SERVICE_DATA16:
+			size = 2;
+			break;
+		case BT_AD_SERVICE_DATA32:
+			size = 4;
+			break;
+		case BT_AD_SERVICE_DATA128:
+			size = 16;
+			break;
+		default:
+			continue;
+		}
+
+		if (iter->len < size || !view_get_uuid(iter->data, size, uuid))
+			continue;
+
+		*data = iter->data + size;
+		*len = iter->len - size;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool bt_ad_iter_next_manufacturer_data(struct bt_ad_iter *iter, uint16_t *id,
+					const uint8_t **data, uint8_t *len)
+{
+	while (bt_ad_iter_next_type(iter, BT_AD_MANUFACTURER_DATA)) {
+		if (iter->len < 2)
+			continue;
+
+		*id = get_le16(iter->data);
+		*data = iter->data + 2;
+		*len = iter->len - 2;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool bt_ad_view_has_service_uuid(const struct bt_ad_view *view,
+						const bt_uuid_t *uuid)
+{
+	struct bt_ad_iter iter;
+	bt_uuid_t value;
+
+	if (!view || !uuid)
+		return false;
+
+	bt_ad_iter_init(&iter, view);
+
+	while (bt_ad_iter_next_uuid(&iter, &value)) {
+		if (!bt_uuid_cmp(&value, uuid))
+			return true;
+	}
+
+	return false;
+}
+
+bool bt_ad_view_has_service_data(const struct bt_ad_view *view,
+						const bt_uuid_t *uuid)
+{
+	struct bt_ad_iter iter;
+	bt_uuid_t value;
+	const uint8_t *data;
+	uint8_t len;
+
+	if (!view || !uuid)
+		return false;
+
+	bt_ad_iter_init(&iter, view);
+
+	while (bt_ad_iter_next_service_data(&iter, &value, &data, &len)) {
+		if (!bt_uuid_cmp(&value, uuid))
+			return true;
+	}
+
+	return false;
+}
+
+static bool view_match_pattern(const struct bt_ad_view *view,
+					const struct bt_ad_pattern *pattern)
+{
+	struct bt_ad_iter iter;
+	bt_uuid_t uuid;
+	const uint8_t *data;
+	uint8_t len;
+
+	bt_ad_iter_init(&iter, view);
+
+	switch (pattern->type) {
+	case BT_AD_SERVICE_DATA16:
+	case BT_AD_SERVICE_DATA32:
+	case BT_AD_SERVICE_DATA128:
+		/* Service data is matched past its UUID, as bt_ad does */
+		while (bt_ad_iter_next_service_data(&iter, &uuid, &data,
+								&len)) {
+			if (len >= pattern->offset + pattern->len &&
+					!memcmp(data + pattern->offset,
+						pattern->data, pattern->len))
+				return true;
+		}
+		break;
+	default:
+		while (bt_ad_iter_next_type(&iter, pattern->type)) {
+			if (iter.len >= pattern->offset + pattern->len &&
+					!memcmp(iter.data + pattern->offset,
+						pattern->data, pattern->len))
+				return true;
+		}
+		break;
+	}
+
+	return false;
+}
+
+struct bt_ad_pattern *bt_ad_view_pattern_match(const struct bt_ad_view *view,
+							struct queue *patterns)
+{
+	const struct queue_entry *entry;
+
+	if (!view || !view->len)
+		return NULL;
+
+	for (entry = queue_get_entries(patterns); entry; entry = entry->next) {
+		struct bt_ad_pattern *pattern = entry->data;
+
+		if (view_match_pattern(view, pattern))
+			return pattern;
+	}
+
+	return NULL;
+}
+
+/*
+ * All patterns are indexed by AD type, offset and the first pattern byte,
+ * so each field of a report only needs to look at the patterns whose first
+ * byte matches, for every offset in use with its type. Service data
+ * patterns are matched past the UUID regardless of the UUID size, as
+ * bt_ad_view_pattern_match does, and share a single type slot.
+ */
+struct matcher_entry {
+	struct matcher_owner *owner;
+	struct bt_ad_pattern pattern;
+	struct matcher_entry *next;
+	struct matcher_entry **pprev;
+};
+
+struct matcher_offset {
+	unsigned int count;
+	struct matcher_entry *buckets[256];
+};
+
+struct matcher_type {
+	uint32_t offset_mask;
+	struct matcher_offset *offsets[BT_AD_MAX_DATA_LEN];
+};
+
+struct matcher_owner {
+	void *match_data;
+	unsigned int generation;
+	unsigned int num_entries;
+	struct matcher_entry *entries;
+};
+
+struct bt_ad_matcher {
+	struct matcher_type *types[256];
+	struct queue *owners;
+	unsigned int generation;
+};
+
+static uint8_t matcher_type(uint8_t type)
+{
+	switch (type) {
+	case BT_AD_SERVICE_DATA32:
+	case BT_AD_SERVICE_DATA128:
+		return BT_AD_SERVICE_DATA16;
+	}
+
+	return type;
+}
+
+struct bt_ad_matcher *bt_ad_matcher_new(void)
+{
+	struct bt_ad_matcher *matcher;
+
+	matcher = new0(struct bt_ad_matcher, 1);
+	matcher->owners = queue_new();
+
+	return matcher;
+}
+
+static void matcher_unlink(struct bt_ad_matcher *matcher,
+					struct matcher_entry *entry)
+{
+	uint8_t type = matcher_type(entry->pattern.type);
+	uint8_t offset = entry->pattern.offset;
+	struct matcher_type *t = matcher->types[type];
+	struct matcher_offset *o = t->offsets[offset];
+
+	*entry->pprev = entry->next;
+	if (entry->next)
+		entry->next->pprev = entry->pprev;
+
+	if (--o->count)
+		return;
+
+	free(o);
+	t->offsets[offset] = NULL;
+	t->offset_mask &= ~(1U << offset);
+
+	if (t->offset_mask)
+		return;
+
+	free(t);
+	matcher->types[type] = NULL;
+}
+
+static void matcher_link(struct bt_ad_matcher *matcher,
+					struct matcher_entry *entry)
+{
+	uint8_t type = matcher_type(entry->pattern.type);
+	uint8_t offset = entry->pattern.offset;
+	struct matcher_type *t = matcher->types[type];
+	struct matcher_offset *o;
+	struct matcher_entry **head;
+
+	if (!t) {
+		t = new0(struct matcher_type, 1);
+		matcher->types[type] = t;
+	}
+
+	o = t->offsets[offset];
+	if (!o) {
+		o = new0(struct matcher_offset, 1);
+		t->offsets[offset] = o;
+		t->offset_mask |= 1U << offset;
+	}
+
+	o->count++;
+
+	head = &o->buckets[entry->pattern.data[0]];
+	entry->next = *head;
+	if (entry->next)
+		entry->next->pprev = &entry->next;
+
+	*head = entry;
+	entry->pprev = head;
+}
+
+static void matcher_owner_free(void *data)
+{
+	struct matcher_owner *owner = data;
+
+	free(owner->entries);
+	free(owner);
+}
+
+static void matcher_owner_remove(void *data, void *user_data)
+{
+	struct matcher_owner *owner = data;
+	struct bt_ad_matcher *matcher = user_data;
+	unsigned int i;
+
+	for (i = 0; i < owner->num_entries; i++)
+		matcher_unlink(matcher, &owner->entries[i]);
+
+	matcher_owner_free(owner);
+}
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher)
+{
+	if (!matcher)
+		return;
+
+	queue_foreach(matcher->owners, matcher_owner_remove, matcher);
+	queue_destroy(matcher->owners, NULL);
+	free(matcher);
+}
+
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data)
+{
+	const struct queue_entry *entry;
+	struct matcher_owner *owner;
+	unsigned int i = 0;
+
+	if (!matcher || queue_isempty(patterns))
+		return false;
+
+	for (entry = queue_get_entries(patterns); entry; entry = entry->next) {
+		struct bt_ad_pattern *pattern = entry->data;
+
+		if (!pattern->len || pattern->offset >= BT_AD_MAX_DATA_LEN)
+			return false;
+	}
+
+	owner = new0(struct matcher_owner, 1);
+	owner->match_data = match_data;
+	owner->num_entries = queue_length(patterns);
+	owner->entries = new0(struct matcher_entry, owner->num_entries);
+
+	for (entry = queue_get_entries(patterns); entry; entry = entry->next) {
+		struct matcher_entry *e = &owner->entries[i++];
+
+		e->owner = owner;
+		memcpy(&e->pattern, entry->data, sizeof(e->pattern));
+		matcher_link(matcher, e);
+	}
+
+	queue_push_tail(matcher->owners, owner);
+
+	return true;
+}
+
+static bool match_owner(const void *data, const void *match_data)
+{
+	const struct matcher_owner *owner = data;
+
+	return owner->match_data == match_data;
+}
+
+bool bt_ad_matcher_remove(struct bt_ad_matcher *matcher, void *match_data)
+{
+	struct matcher_owner *owner;
+
+	if (!matcher)
+		return false;
+
+	owner = queue_remove_if(matcher->owners, match_owner, match_data);
+	if (!owner)
+		return false;
+
+	matcher_owner_remove(owner, matcher);
+
+	return true;
+}
+
+static unsigned int matcher_match_field(struct matcher_type *t,
+					const uint8_t *data, uint8_t len,
+					unsigned int generation,
+					bt_ad_matcher_func_t func,
+					void *user_data)
+{
+	uint32_t mask = t->offset_mask;
+	unsigned int count = 0;
+
+	while (mask) {
+		unsigned int offset = __builtin_ctz(mask);
+		struct matcher_entry *e;
+
+		/* Offsets are visited in ascending order */
+		if (offset >= len)
+			break;
+
+		mask &= mask - 1;
+
+		e = t->offsets[offset]->buckets[data[offset]];
+
+		for (; e; e = e->next) {
+			struct bt_ad_pattern *pattern = &e->pattern;
+
+			if (e->owner->generation == generation)
+				continue;
+
+			if (len < offset + pattern->len ||
+					memcmp(data + offset + 1,
+						pattern->data + 1,
+						pattern->len - 1))
+				continue;
+
+			e->owner->generation = generation;
+			count++;
+
+			if (func)
+				func(e->owner->match_data, user_data);
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Calls func once for each set of patterns, as passed to bt_ad_matcher_add,
+ * that has at least one pattern matching the view. Returns the number of
+ * sets matched.
+ */
+unsigned int bt_ad_matcher_match(struct bt_ad_matcher *matcher,
+					const struct bt_ad_view *view,
+					bt_ad_matcher_func_t func,
+					void *user_data)
+{
+	struct bt_ad_iter iter;
+	unsigned int count = 0;
+
+	if (!matcher || !view || !view->len)
+		return 0;
+
+	/* Owners are marked with the generation so each matches only once */
+	if (!++matcher->generation)
+		matcher->generation++;
+
+	bt_ad_iter_init(&iter, view);
+
+	while (bt_ad_iter_next(&iter)) {
+		struct matcher_type *t;
+		const uint8_t *data = iter.data;
+		uint8_t len = iter.len;
+
+		t = matcher->types[matcher_type(iter.type)];
+		if (!t)
+			continue;
+
+		switch (iter.type) {
+		case BT_AD_SERVICE_DATA16:
+			if (len < 2)
+				continue;
+			data += 2;
+			len -= 2;
+			break;
+		case BT_AD_SERVICE_DATA32:
+			if (len < 4)
+				continue;
+			data += 4;
+			len -= 4;
+			break;
+		case BT_AD_SERVICE_DATA128:
+			if (len < 16)
+				continue;
+			data += 16;
+			len -= 16;
+			break;
+		}
+
+		count += matcher_match_field(t, data, len, matcher->generation,
+							func, user_data);
+	}
+
+	return count;
+}
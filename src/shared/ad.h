@@ -60,6 +60,7 @@
 #define BT_AD_MESH_DATA			0x2a
 #define BT_AD_MESH_BEACON		0x2b
 #define BT_AD_CSIP_RSI			0x2e
+#define BT_AD_BROADCAST_NAME		0x30
 #define BT_AD_3D_INFO_DATA		0x3d
 #define BT_AD_MANUFACTURER_DATA		0xff
 
@@ -98,6 +99,31 @@ struct bt_ad_pattern {
 	uint8_t data[BT_AD_MAX_DATA_LEN];
 };
 
+/*
+ * Read only view of advertising data built in a single pass without any
+ * allocation, all pointers refer to the original buffer which must outlive
+ * the view.
+ */
+struct bt_ad_view {
+	const uint8_t *data;
+	size_t len;
+	uint8_t types[32];
+	uint8_t flags;
+	int8_t tx_power;
+	const uint8_t *name;
+	uint8_t name_len;
+	bool name_complete;
+};
+
+struct bt_ad_iter {
+	const struct bt_ad_view *view;
+	size_t offset;
+	uint8_t type;
+	uint8_t len;
+	const uint8_t *data;
+	uint8_t pos;
+};
+
 struct bt_ad *bt_ad_new(void);
 
 bool bt_ad_set_max_len(struct bt_ad *ad, uint8_t len);
@@ -190,3 +216,49 @@ struct bt_ad_pattern *bt_ad_pattern_new(uint8_t type, size_t offset,
 
 struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 							struct queue *patterns);
+
+void bt_ad_view_init(struct bt_ad_view *view, const uint8_t *data,
+								size_t len);
+
+bool bt_ad_view_has_type(const struct bt_ad_view *view, uint8_t type);
+
+bool bt_ad_view_has_service_uuid(const struct bt_ad_view *view,
+						const bt_uuid_t *uuid);
+
+bool bt_ad_view_has_service_data(const struct bt_ad_view *view,
+						const bt_uuid_t *uuid);
+
+struct bt_ad_pattern *bt_ad_view_pattern_match(const struct bt_ad_view *view,
+							struct queue *patterns);
+
+void bt_ad_iter_init(struct bt_ad_iter *iter, const struct bt_ad_view *view);
+
+bool bt_ad_iter_next(struct bt_ad_iter *iter);
+
+bool bt_ad_iter_next_type(struct bt_ad_iter *iter, uint8_t type);
+
+bool bt_ad_iter_next_uuid(struct bt_ad_iter *iter, bt_uuid_t *uuid);
+
+bool bt_ad_iter_next_service_data(struct bt_ad_iter *iter, bt_uuid_t *uuid,
+					const uint8_t **data, uint8_t *len);
+
+bool bt_ad_iter_next_manufacturer_data(struct bt_ad_iter *iter, uint16_t *id,
+					const uint8_t **data, uint8_t *len);
+
+struct bt_ad_matcher;
+
+typedef void (*bt_ad_matcher_func_t)(void *match_data, void *user_data);
+
+struct bt_ad_matcher *bt_ad_matcher_new(void);
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher);
+
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data);
+
+bool bt_ad_matcher_remove(struct bt_ad_matcher *matcher, void *match_data);
+
+unsigned int bt_ad_matcher_match(struct bt_ad_matcher *matcher,
+					const struct bt_ad_view *view,
+					bt_ad_matcher_func_t func,
+					void *user_data);
@@ -12,14 +12,17 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/socket.h>
 
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
 #include "src/shared/util.h"
 #include "src/shared/timeout.h"
+#include "src/shared/stats.h"
 #include "bluetooth/bluetooth.h"
 #include "bluetooth/l2cap.h"
 #include "bluetooth/uuid.h"
@@ -34,6 +37,17 @@
 /* Length of signature in write signed packet */
 #define BT_ATT_SIGNATURE_LEN		12
 
+/* Number of send ops kept for reuse */
+#define ATT_OP_POOL_SIZE		16
+
+/* Maximum number of buffers passed to bt_att_sendv */
+#define ATT_IOV_MAX			4
+
+/* PDUs read and written per wakeup, and the memory for reading them */
+#define ATT_RX_BATCH			8
+#define ATT_TX_BATCH			8
+#define ATT_RX_BUF_SIZE			8192
+
 struct att_send_op;
 
 struct bt_att_chan {
@@ -52,8 +66,28 @@ struct bt_att_chan {
 
 	bool in_req;			/* There's a pending incoming request */
 
-	uint8_t *buf;
+	uint8_t *buf;			/* Receive slots of buf_mtu bytes */
+	uint16_t buf_mtu;
+	unsigned int buf_slots;
 	uint16_t mtu;
+
+	unsigned int sent[BT_ATT_CLASS_MAX];
+	uint64_t sent_bytes;
+};
+
+/* Weighted round robin state of a traffic class */
+struct att_class {
+	unsigned int weight;
+	unsigned int credits;		/* Left in the current round */
+	unsigned int limit;		/* Queued PDUs, 0 for no limit */
+	bool blocked;			/* PDU refused since last ready */
+};
+
+/* Commands and notifications don't hold back responses to the remote */
+static const unsigned int class_weights[BT_ATT_CLASS_MAX] = {
+	[BT_ATT_CLASS_REQ] = 1,
+	[BT_ATT_CLASS_IND] = 1,
+	[BT_ATT_CLASS_WRITE] = 4,
 };
 
 struct bt_att {
@@ -66,6 +100,7 @@ struct bt_att {
 	struct queue *notify_list;	/* List of registered callbacks */
 	struct queue *disconn_list;	/* List of disconnect handlers */
 	struct queue *exchange_list;	/* List of MTU changed handlers */
+	struct queue *ready_list;	/* List of class ready handlers */
 
 	unsigned int next_send_id;	/* IDs for "send" ops */
 	unsigned int next_reg_id;	/* IDs for registered callbacks */
@@ -75,6 +110,9 @@ struct bt_att {
 	struct queue *write_queue;	/* Queue of PDUs ready to send */
 	bool in_disc;			/* Cleanup queues on disconnect_cb */
 
+	struct att_class classes[BT_ATT_CLASS_MAX];
+	uint8_t next_class;		/* Class to serve first */
+
 	bt_att_timeout_func_t timeout_callback;
 	bt_att_destroy_func_t timeout_destroy;
 	void *timeout_data;
@@ -92,6 +130,11 @@ struct bt_att {
 
 	struct sign_info *local_sign;
 	struct sign_info *remote_sign;
+
+	struct bt_att_stats stats;
+
+	struct att_send_op *op_pool;	/* Send ops ready for reuse */
+	unsigned int op_pool_len;
 };
 
 struct sign_info {
@@ -191,6 +234,16 @@ static uint8_t get_req_opcode(uint8_t rsp_opcode)
 	return 0;
 }
 
+/*
+ * Encoded PDU which can be queued on several bearers at once, such as the
+ * same notification being sent to many clients, without a copy for each.
+ */
+struct bt_att_pdu {
+	int ref_count;
+	uint16_t len;
+	uint8_t data[];
+};
+
 struct att_send_op {
 	unsigned int id;
 	unsigned int timeout_id;
@@ -198,24 +251,97 @@ struct att_send_op {
 	uint8_t opcode;
 	void *pdu;
 	uint16_t len;
+	struct bt_att_pdu *shared;	/* Owns pdu if set */
+	uint8_t *buf;			/* Encoded pdu, kept while pooled */
+	uint16_t buf_size;
+	struct iovec iov[ATT_IOV_MAX + 1];	/* What gets written */
+	int iovcnt;
 	bool retry;
+	uint64_t start;			/* Written at, if stats are enabled */
+	struct bt_att *att;
+	struct bt_att_chan *chan;	/* Pending on, if request/indication */
 	bt_att_response_func_t callback;
 	bt_att_destroy_func_t destroy;
 	void *user_data;
+	struct att_send_op *next;	/* Next in the pool */
 };
 
+static struct att_send_op *get_att_send_op(struct bt_att *att)
+{
+	struct att_send_op *op = att->op_pool;
+	uint8_t *buf;
+	uint16_t buf_size;
+
+	if (!op) {
+		op = new0(struct att_send_op, 1);
+		op->att = att;
+		return op;
+	}
+
+	att->op_pool = op->next;
+	att->op_pool_len--;
+
+	buf = op->buf;
+	buf_size = op->buf_size;
+
+	memset(op, 0, sizeof(*op));
+	op->att = att;
+	op->buf = buf;
+	op->buf_size = buf_size;
+
+	return op;
+}
+
+static void free_att_send_op(struct att_send_op *op)
+{
+	struct bt_att *att = op->att;
+
+	if (op->shared)
+		bt_att_pdu_unref(op->shared);
+
+	op->shared = NULL;
+
+	if (att->op_pool_len < ATT_OP_POOL_SIZE) {
+		op->next = att->op_pool;
+		att->op_pool = op;
+		att->op_pool_len++;
+		return;
+	}
+
+	free(op->buf);
+	free(op);
+}
+
+static void att_op_pool_free(struct bt_att *att)
+{
+	while (att->op_pool) {
+		struct att_send_op *op = att->op_pool;
+
+		att->op_pool = op->next;
+		free(op->buf);
+		free(op);
+	}
+
+	att->op_pool_len = 0;
+}
+
 static void destroy_att_send_op(void *data)
 {
 	struct att_send_op *op = data;
+	bt_att_destroy_func_t destroy = op->destroy;
+	void *user_data = op->user_data;
 
 	if (op->timeout_id)
 		timeout_remove(op->timeout_id);
 
-	if (op->destroy)
-		op->destroy(op->user_data);
+	/*
+	 * Return the op to the pool before calling destroy since it may drop
+	 * the last reference to the bt_att the pool belongs to.
+	 */
+	free_att_send_op(op);
 
-	free(op->pdu);
-	free(op);
+	if (destroy)
+		destroy(user_data);
 }
 
 static void cancel_att_send_op(void *data)
@@ -272,6 +398,14 @@ struct att_exchange {
 	void *user_data;
 };
 
+struct att_ready {
+	unsigned int id;
+	bool removed;
+	bt_att_ready_func_t callback;
+	bt_att_destroy_func_t destroy;
+	void *user_data;
+};
+
 static void destroy_att_disconn(void *data)
 {
 	struct att_disconn *disconn = data;
@@ -292,6 +426,16 @@ static void destroy_att_exchange(void *data)
 	free(exchange);
 }
 
+static void destroy_att_ready(void *data)
+{
+	struct att_ready *ready = data;
+
+	if (ready->destroy)
+		ready->destroy(ready->user_data);
+
+	free(ready);
+}
+
 static bool match_disconn_id(const void *a, const void *b)
 {
 	const struct att_disconn *disconn = a;
@@ -346,10 +490,22 @@ static bool encode_pdu(struct bt_att *att, struct att_send_op *op,
 	if (pdu_len > att->mtu)
 		return false;
 
+	/* Size the buffer for the MTU so any later PDU fits when reused */
+	if (op->buf_size < pdu_len) {
+		uint8_t *buf = realloc(op->buf, att->mtu);
+
+		if (!buf)
+			return false;
+
+		op->buf = buf;
+		op->buf_size = att->mtu;
+	}
+
 	op->len = pdu_len;
-	op->pdu = malloc(op->len);
-	if (!op->pdu)
-		return false;
+	op->pdu = op->buf;
+	op->iov[0].iov_base = op->pdu;
+	op->iov[0].iov_len = op->len;
+	op->iovcnt = 1;
 
 	((uint8_t *) op->pdu)[0] = op->opcode;
 	if (pdu_len > 1)
@@ -359,7 +515,7 @@ static bool encode_pdu(struct bt_att *att, struct att_send_op *op,
 		return true;
 
 	if (!sign->counter(&sign_cnt, sign->user_data))
-		goto fail;
+		return false;
 
 	if ((bt_crypto_sign_att(att->crypto, sign->key, op->pdu, 1 + length,
 				sign_cnt, &((uint8_t *) op->pdu)[1 + length])))
@@ -367,15 +523,11 @@ static bool encode_pdu(struct bt_att *att, struct att_send_op *op,
 
 	DBG(att, "ATT unable to generate signature");
 
-fail:
-	free(op->pdu);
 	return false;
 }
 
-static struct att_send_op *create_att_send_op(struct bt_att *att,
+static struct att_send_op *new_att_send_op(struct bt_att *att,
 						uint8_t opcode,
-						const void *pdu,
-						uint16_t length,
 						bt_att_response_func_t callback,
 						void *user_data,
 						bt_att_destroy_func_t destroy)
@@ -383,9 +535,6 @@ static struct att_send_op *create_att_send_op(struct bt_att *att,
 	struct att_send_op *op;
 	enum att_op_type type;
 
-	if (length && !pdu)
-		return NULL;
-
 	type = get_op_type(opcode);
 	if (type == ATT_OP_TYPE_UNKNOWN)
 		return NULL;
@@ -403,62 +552,225 @@ static struct att_send_op *create_att_send_op(struct bt_att *att,
 	if (!callback && (type == ATT_OP_TYPE_REQ || type == ATT_OP_TYPE_IND))
 		return NULL;
 
-	op = new0(struct att_send_op, 1);
+	op = get_att_send_op(att);
 	op->type = type;
 	op->opcode = opcode;
 	op->callback = callback;
 	op->destroy = destroy;
 	op->user_data = user_data;
 
+	return op;
+}
+
+static struct att_send_op *create_att_send_op(struct bt_att *att,
+						uint8_t opcode,
+						const void *pdu,
+						uint16_t length,
+						bt_att_response_func_t callback,
+						void *user_data,
+						bt_att_destroy_func_t destroy)
+{
+	struct att_send_op *op;
+
+	if (length && !pdu)
+		return NULL;
+
+	op = new_att_send_op(att, opcode, callback, user_data, destroy);
+	if (!op)
+		return NULL;
+
 	if (!encode_pdu(att, op, pdu, length)) {
-		free(op);
+		free_att_send_op(op);
 		return NULL;
 	}
 
 	return op;
 }
 
-static struct att_send_op *pick_next_send_op(struct bt_att_chan *chan)
+static uint8_t op_class(const struct att_send_op *op)
+{
+	switch (op->type) {
+	case ATT_OP_TYPE_REQ:
+		return BT_ATT_CLASS_REQ;
+	case ATT_OP_TYPE_IND:
+		return BT_ATT_CLASS_IND;
+	case ATT_OP_TYPE_CMD:
+	case ATT_OP_TYPE_NFY:
+	case ATT_OP_TYPE_UNKNOWN:
+	case ATT_OP_TYPE_RSP:
+	case ATT_OP_TYPE_CONF:
+	default:
+		return BT_ATT_CLASS_WRITE;
+	}
+}
+
+static struct queue *class_queue(struct bt_att *att, uint8_t class)
+{
+	switch (class) {
+	case BT_ATT_CLASS_REQ:
+		return att->req_queue;
+	case BT_ATT_CLASS_IND:
+		return att->ind_queue;
+	default:
+		return att->write_queue;
+	}
+}
+
+static unsigned int chan_outstanding(struct bt_att_chan *chan)
+{
+	unsigned int bytes = 0;
+
+	if (chan->pending_req)
+		bytes += chan->pending_req->len;
+
+	if (chan->pending_ind)
+		bytes += chan->pending_ind->len;
+
+	return bytes;
+}
+
+static bool chan_accepts(struct bt_att_chan *chan, uint8_t class,
+						const struct att_send_op *op)
+{
+	if (op->len > chan->mtu)
+		return false;
+
+	switch (class) {
+	case BT_ATT_CLASS_REQ:
+		if (chan->pending_req)
+			return false;
+
+		/* Don't send Exchange MTU over EATT */
+		return op->opcode != BT_ATT_OP_MTU_REQ ||
+						chan->type != BT_ATT_EATT;
+	case BT_ATT_CLASS_IND:
+		return !chan->pending_ind;
+	default:
+		return true;
+	}
+}
+
+static void wakeup_chan_writer(void *data, void *user_data);
+
+/*
+ * Leave the operation to another channel that can send it with fewer bytes
+ * awaiting a response relative to its MTU. Commands and notifications are
+ * not acknowledged, for those a channel with a full socket simply doesn't
+ * get to write.
+ */
+static bool chan_is_best(struct bt_att_chan *chan, uint8_t class,
+						const struct att_send_op *op)
+{
+	const struct queue_entry *entry;
+	uint64_t load = chan_outstanding(chan);
+
+	for (entry = queue_get_entries(chan->att->chans); entry;
+							entry = entry->next) {
+		struct bt_att_chan *other = entry->data;
+
+		if (other == chan || !chan_accepts(other, class, op))
+			continue;
+
+		if ((uint64_t) chan_outstanding(other) * chan->mtu <
+							load * other->mtu) {
+			wakeup_chan_writer(other, NULL);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Sets from to the queue the operation was taken from */
+static struct att_send_op *pick_next_send_op(struct bt_att_chan *chan,
+							struct queue **from)
 {
 	struct bt_att *att = chan->att;
 	struct att_send_op *op;
+	bool exhausted = false;
+	unsigned int i;
 
 	/* Check if there is anything queued on the channel */
 	op = queue_pop_head(chan->queue);
-	if (op)
+	if (op) {
+		*from = chan->queue;
 		return op;
+	}
 
-	/* See if any operations are already in the write queue */
-	op = queue_peek_head(att->write_queue);
-	if (op && op->len <= chan->mtu)
-		return queue_pop_head(att->write_queue);
-
-	/* If there is no pending request, pick an operation from the
-	 * request queue.
+	/*
+	 * Serve the classes in weighted round robin, so a flood of commands
+	 * doesn't starve requests and indications or the other way around.
 	 */
-	if (!chan->pending_req) {
-		op = queue_peek_head(att->req_queue);
-		if (op && op->len <= chan->mtu) {
-			/* Don't send Exchange MTU over EATT */
-			if (op->opcode == BT_ATT_OP_MTU_REQ &&
-					chan->type == BT_ATT_EATT)
-				goto indicate;
-
-			return queue_pop_head(att->req_queue);
+	for (i = 0; i < BT_ATT_CLASS_MAX; i++) {
+		uint8_t class = (att->next_class + i) % BT_ATT_CLASS_MAX;
+		struct att_class *c = &att->classes[class];
+		struct queue *queue = class_queue(att, class);
+
+		op = queue_peek_head(queue);
+		if (!op || !chan_accepts(chan, class, op))
+			continue;
+
+		if (!c->credits) {
+			exhausted = true;
+			continue;
 		}
-	}
 
-indicate:
-	/* There is either a request pending or no requests queued. If there is
-	 * no pending indication, pick an operation from the indication queue.
-	 */
-	if (!chan->pending_ind) {
-		op = queue_peek_head(att->ind_queue);
-		if (op && op->len <= chan->mtu)
-			return queue_pop_head(att->ind_queue);
+		if (!chan_is_best(chan, class, op))
+			continue;
+
+		/* Stay with the class until it runs out of credits */
+		if (--c->credits)
+			att->next_class = class;
+		else
+			att->next_class = (class + 1) % BT_ATT_CLASS_MAX;
+
+		*from = queue;
+		return queue_pop_head(queue);
 	}
 
-	return NULL;
+	if (!exhausted)
+		return NULL;
+
+	/* Everything left is out of credits, start a new round */
+	for (i = 0; i < BT_ATT_CLASS_MAX; i++)
+		att->classes[i].credits = att->classes[i].weight;
+
+	return pick_next_send_op(chan, from);
+}
+
+static void ready_handler(void *data, void *user_data)
+{
+	struct att_ready *ready = data;
+	uint8_t class = PTR_TO_UINT(user_data);
+
+	if (ready->removed)
+		return;
+
+	if (ready->callback)
+		ready->callback(class, ready->user_data);
+}
+
+static void class_ready(struct bt_att *att, uint8_t class)
+{
+	struct att_class *c = &att->classes[class];
+
+	if (!c->blocked)
+		return;
+
+	if (c->limit && queue_length(class_queue(att, class)) >= c->limit)
+		return;
+
+	c->blocked = false;
+
+	queue_foreach(att->ready_list, ready_handler, UINT_TO_PTR(class));
+}
+
+static void classes_ready(struct bt_att *att)
+{
+	uint8_t class;
+
+	for (class = 0; class < BT_ATT_CLASS_MAX; class++)
+		class_ready(att, class);
 }
 
 static void disc_att_send_op(void *data)
@@ -471,27 +783,18 @@ static void disc_att_send_op(void *data)
 	destroy_att_send_op(op);
 }
 
-struct timeout_data {
-	struct bt_att_chan *chan;
-	unsigned int id;
-};
-
+/* The timeout is removed whenever the op is destroyed */
 static bool timeout_cb(void *user_data)
 {
-	struct timeout_data *timeout = user_data;
-	struct bt_att_chan *chan = timeout->chan;
+	struct att_send_op *op = user_data;
+	struct bt_att_chan *chan = op->chan;
 	struct bt_att *att = chan->att;
-	struct att_send_op *op = NULL;
 
-	if (chan->pending_req && chan->pending_req->id == timeout->id) {
-		op = chan->pending_req;
+	if (chan->pending_req == op)
 		chan->pending_req = NULL;
-	} else if (chan->pending_ind && chan->pending_ind->id == timeout->id) {
-		op = chan->pending_ind;
+	else if (chan->pending_ind == op)
 		chan->pending_ind = NULL;
-	}
-
-	if (!op)
+	else
 		return false;
 
 	DBG(att, "(chan %p) Operation timed out: 0x%02x", chan,
@@ -520,49 +823,56 @@ static void write_watch_destroy(void *user_data)
 	chan->writer_active = false;
 }
 
-static ssize_t bt_att_chan_write(struct bt_att_chan *chan, uint8_t opcode,
-					const void *pdu, uint16_t len)
+/* Returns the number of PDUs written */
+static int bt_att_chan_write(struct bt_att_chan *chan,
+					struct att_send_op **ops, int count)
 {
 	struct bt_att *att = chan->att;
-	ssize_t ret;
-	struct iovec iov;
+	struct mmsghdr msgs[ATT_TX_BATCH];
+	int i, j, ret;
+
+	memset(msgs, 0, sizeof(msgs));
 
-	iov.iov_base = (void *) pdu;
-	iov.iov_len = len;
+	for (i = 0; i < count; i++) {
+		VERBOSE(att, "(chan %p) ATT op 0x%02x", chan, ops[i]->opcode);
 
-	VERBOSE(att, "(chan %p) ATT op 0x%02x", chan, opcode);
+		msgs[i].msg_hdr.msg_iov = ops[i]->iov;
+		msgs[i].msg_hdr.msg_iovlen = ops[i]->iovcnt;
+	}
 
-	ret = io_send(chan->io, &iov, 1);
+	ret = io_sendmmsg(chan->io, msgs, count);
 	if (ret < 0) {
+		/* Nothing fitted, try again once writable */
+		if (ret == -EAGAIN)
+			return 0;
+
 		DBG(att, "(chan %p) write failed: %s", chan,
 						strerror(-ret));
 		return ret;
 	}
 
-	if (att->debug_level)
-		util_hexdump('<', pdu, ret, att->debug_callback,
-						att->debug_data);
+	if (!att->debug_level)
+		return ret;
+
+	/* Gathered PDUs are dumped in pieces */
+	for (i = 0; i < ret; i++) {
+		for (j = 0; j < ops[i]->iovcnt; j++)
+			util_hexdump('<', ops[i]->iov[j].iov_base,
+					ops[i]->iov[j].iov_len,
+					att->debug_callback, att->debug_data);
+	}
 
 	return ret;
 }
 
-static bool can_write_data(struct io *io, void *user_data)
+static void write_done(struct bt_att_chan *chan, struct att_send_op *op)
 {
-	struct bt_att_chan *chan = user_data;
-	struct att_send_op *op;
-	struct timeout_data *timeout;
-
-	op = pick_next_send_op(chan);
-	if (!op)
-		return false;
+	struct bt_att *att = chan->att;
+	uint8_t class = op_class(op);
 
-	if (bt_att_chan_write(chan, op->opcode, op->pdu, op->len) < 0) {
-		if (op->callback)
-			op->callback(BT_ATT_OP_ERROR_RSP, NULL, 0,
-							op->user_data);
-		destroy_att_send_op(op);
-		return true;
-	}
+	att->stats.sent[class]++;
+	chan->sent[class]++;
+	chan->sent_bytes += op->len;
 
 	/* Based on the operation type, set either the pending request or the
 	 * pending indication. If it came from the write queue, then there is
@@ -571,9 +881,11 @@ static bool can_write_data(struct io *io, void *user_data)
 	switch (op->type) {
 	case ATT_OP_TYPE_REQ:
 		chan->pending_req = op;
+		op->start = stats_start();
 		break;
 	case ATT_OP_TYPE_IND:
 		chan->pending_ind = op;
+		op->start = stats_start();
 		break;
 	case ATT_OP_TYPE_RSP:
 		/* Set in_req to false to indicate that no request is pending */
@@ -585,14 +897,67 @@ static bool can_write_data(struct io *io, void *user_data)
 	case ATT_OP_TYPE_UNKNOWN:
 	default:
 		destroy_att_send_op(op);
-		return true;
+		class_ready(att, class);
+		return;
 	}
 
-	timeout = new0(struct timeout_data, 1);
-	timeout->chan = chan;
-	timeout->id = op->id;
+	op->chan = chan;
 	op->timeout_id = timeout_add(ATT_TIMEOUT_INTERVAL, timeout_cb,
-								timeout, free);
+								op, NULL);
+
+	class_ready(att, class);
+}
+
+static bool can_write_data(struct io *io, void *user_data)
+{
+	struct bt_att_chan *chan = user_data;
+	struct att_send_op *ops[ATT_TX_BATCH];
+	struct queue *from[ATT_TX_BATCH];
+	struct att_send_op *op;
+	int i, count, sent;
+
+	/*
+	 * Batch the PDUs that can be sent right away. What gets picked after
+	 * a request or indication depends on it being pending, so it ends the
+	 * batch.
+	 */
+	for (count = 0; count < ATT_TX_BATCH;) {
+		op = pick_next_send_op(chan, &from[count]);
+		if (!op)
+			break;
+
+		ops[count++] = op;
+
+		if (op->type == ATT_OP_TYPE_REQ || op->type == ATT_OP_TYPE_IND)
+			break;
+	}
+
+	if (!count)
+		return false;
+
+	sent = bt_att_chan_write(chan, ops, count);
+
+	/*
+	 * Put back what wasn't written, in order, where it came from so any
+	 * channel can send it and class limits still account for it.
+	 */
+	for (i = count - 1; i >= (sent < 0 ? 1 : sent); i--)
+		queue_push_head(from[i], ops[i]);
+
+	if (sent < 0) {
+		op = ops[0];
+
+		if (op->callback)
+			op->callback(BT_ATT_OP_ERROR_RSP, NULL, 0,
+							op->user_data);
+		destroy_att_send_op(op);
+		classes_ready(chan->att);
+
+		return true;
+	}
+
+	for (i = 0; i < sent; i++)
+		write_done(chan, ops[i]);
 
 	/* Return true as there may be more operations ready to write. */
 	return true;
@@ -712,6 +1077,8 @@ static bool disconnect_cb(struct io *io, void *user_data)
 
 	att->in_disc = false;
 
+	classes_ready(att);
+
 	queue_foreach(att->disconn_list, disconn_handler, INT_TO_PTR(err));
 
 	bt_att_unregister_all(att);
@@ -909,6 +1276,8 @@ fail:
 	rsp_opcode = BT_ATT_OP_ERROR_RSP;
 
 done:
+	stats_hist_end(&att->stats.rtt, op->start);
+
 	if (op->callback)
 		op->callback(rsp_opcode, rsp_pdu, rsp_pdu_len, op->user_data);
 
@@ -934,6 +1303,8 @@ static void handle_conf(struct bt_att_chan *chan, uint8_t *pdu, ssize_t pdu_len)
 		return;
 	}
 
+	stats_hist_end(&att->stats.rtt, op->start);
+
 	if (op->callback)
 		op->callback(BT_ATT_OP_HANDLE_CONF, NULL, 0, op->user_data);
 
@@ -993,7 +1364,7 @@ static bool handle_signed(struct bt_att *att, uint8_t *pdu, ssize_t pdu_len)
 
 	/* Validate counter */
 	if (!sign->counter(&sign_cnt, sign->user_data))
-		goto fail;
+		return false;
 
 	/* Verify received signature */
 	if (!bt_crypto_verify_att_sign(att->crypto, sign->key, pdu, pdu_len))
@@ -1074,30 +1445,22 @@ not_supported:
 	bt_att_unref(att);
 }
 
-static bool can_read_data(struct io *io, void *user_data)
+/* Returns false if the bearer is being shut down */
+static bool handle_pdu(struct bt_att_chan *chan, uint8_t *pdu,
+							ssize_t bytes_read)
 {
-	struct bt_att_chan *chan = user_data;
 	struct bt_att *att = chan->att;
 	uint8_t opcode;
-	uint8_t *pdu;
-	ssize_t bytes_read;
-
-	bytes_read = read(chan->fd, chan->buf, chan->mtu);
-	if (bytes_read < 0)
-		return false;
 
 	VERBOSE(att, "(chan %p) ATT received: %zd", chan, bytes_read);
 
-	att_hexdump(att, '>', chan->buf, bytes_read);
+	att_hexdump(att, '>', pdu, bytes_read);
 
 	if (bytes_read < ATT_MIN_PDU_LEN)
 		return true;
 
-	pdu = chan->buf;
 	opcode = pdu[0];
 
-	bt_att_ref(att);
-
 	/* Act on the received PDU based on the opcode type */
 	switch (get_op_type(opcode)) {
 	case ATT_OP_TYPE_RSP:
@@ -1121,7 +1484,6 @@ static bool can_read_data(struct io *io, void *user_data)
 					"another is pending: 0x%02x",
 					chan, opcode);
 			io_shutdown(chan->io);
-			bt_att_unref(chan->att);
 
 			return false;
 		}
@@ -1143,11 +1505,75 @@ static bool can_read_data(struct io *io, void *user_data)
 		break;
 	}
 
-	bt_att_unref(att);
+	return true;
+}
+
+/*
+ * Receive buffers are only replaced here, as handlers of the PDUs in them
+ * may change the MTU.
+ */
+static bool chan_update_buf(struct bt_att_chan *chan)
+{
+	unsigned int slots;
+	uint8_t *buf;
+
+	if (chan->buf && chan->buf_mtu == chan->mtu)
+		return true;
+
+	slots = ATT_RX_BUF_SIZE / chan->mtu;
+	if (slots > ATT_RX_BATCH)
+		slots = ATT_RX_BATCH;
+	else if (!slots)
+		slots = 1;
+
+	buf = malloc(slots * chan->mtu);
+	if (!buf)
+		return false;
+
+	free(chan->buf);
+	chan->buf = buf;
+	chan->buf_mtu = chan->mtu;
+	chan->buf_slots = slots;
 
 	return true;
 }
 
+static bool can_read_data(struct io *io, void *user_data)
+{
+	struct bt_att_chan *chan = user_data;
+	struct bt_att *att = chan->att;
+	struct mmsghdr msgs[ATT_RX_BATCH];
+	struct iovec iov[ATT_RX_BATCH];
+	bool ret = true;
+	int i, count;
+
+	if (!chan_update_buf(chan))
+		return false;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < (int) chan->buf_slots; i++) {
+		iov[i].iov_base = chan->buf + i * chan->buf_mtu;
+		iov[i].iov_len = chan->buf_mtu;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* Drain a bounded number of PDUs so other sources still get served */
+	count = io_recvmmsg(io, msgs, chan->buf_slots);
+	if (count < 0)
+		return count == -EAGAIN;
+
+	bt_att_ref(att);
+
+	for (i = 0; i < count && ret; i++)
+		ret = handle_pdu(chan, iov[i].iov_base, msgs[i].msg_len);
+
+	bt_att_unref(att);
+
+	return ret;
+}
+
 static bool is_io_l2cap_based(int fd)
 {
 	int domain;
@@ -1195,8 +1621,12 @@ static void bt_att_free(struct bt_att *att)
 	queue_destroy(att->notify_list, NULL);
 	queue_destroy(att->disconn_list, NULL);
 	queue_destroy(att->exchange_list, NULL);
+	queue_destroy(att->ready_list, destroy_att_ready);
 	queue_destroy(att->chans, bt_att_chan_free);
 
+	/* Destroying the channels may have returned ops to the pool */
+	att_op_pool_free(att);
+
 	free(att);
 }
 
@@ -1248,6 +1678,8 @@ static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
 	if (!chan->io)
 		goto fail;
 
+	io_set_stats(chan->io, "att");
+
 	if (!io_set_read_handler(chan->io, can_read_data, chan, NULL))
 		goto fail;
 
@@ -1269,8 +1701,7 @@ static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
 	if (chan->mtu < BT_ATT_DEFAULT_LE_MTU)
 		goto fail;
 
-	chan->buf = malloc(chan->mtu);
-	if (!chan->buf)
+	if (!chan_update_buf(chan))
 		goto fail;
 
 	chan->queue = queue_new();
@@ -1303,6 +1734,7 @@ struct bt_att *bt_att_new(int fd, bool ext_signed)
 {
 	struct bt_att *att;
 	struct bt_att_chan *chan;
+	unsigned int i;
 
 	chan = bt_att_chan_new(fd, io_get_type(fd));
 	if (!chan)
@@ -1319,9 +1751,15 @@ struct bt_att *bt_att_new(int fd, bool ext_signed)
 	att->req_queue = queue_new();
 	att->ind_queue = queue_new();
 	att->write_queue = queue_new();
+
+	for (i = 0; i < BT_ATT_CLASS_MAX; i++) {
+		att->classes[i].weight = class_weights[i];
+		att->classes[i].credits = class_weights[i];
+	}
 	att->notify_list = queue_new();
 	att->disconn_list = queue_new();
 	att->exchange_list = queue_new();
+	att->ready_list = queue_new();
 
 	bt_att_attach_chan(att, chan);
 
@@ -1411,6 +1849,77 @@ int bt_att_get_channels(struct bt_att *att)
 	return queue_length(att->chans);
 }
 
+bool bt_att_get_stats(struct bt_att *att, struct bt_att_stats *stats)
+{
+	if (!att || !stats)
+		return false;
+
+	*stats = att->stats;
+	stats->req_queue = queue_length(att->req_queue);
+	stats->ind_queue = queue_length(att->ind_queue);
+	stats->write_queue = queue_length(att->write_queue);
+
+	return true;
+}
+
+bool bt_att_foreach_chan_stats(struct bt_att *att,
+					bt_att_chan_stats_func_t func,
+					void *user_data)
+{
+	const struct queue_entry *entry;
+
+	if (!att || !func)
+		return false;
+
+	for (entry = queue_get_entries(att->chans); entry;
+						entry = entry->next) {
+		struct bt_att_chan *chan = entry->data;
+		struct bt_att_chan_stats stats;
+
+		memset(&stats, 0, sizeof(stats));
+		stats.type = chan->type;
+		stats.mtu = chan->mtu;
+		stats.outstanding = chan_outstanding(chan);
+		memcpy(stats.sent, chan->sent, sizeof(stats.sent));
+		stats.sent_bytes = chan->sent_bytes;
+
+		func(&stats, user_data);
+	}
+
+	return true;
+}
+
+/*
+ * Sending PDUs of the class fails while limit PDUs are queued. Once one was
+ * refused, the handlers registered with bt_att_register_ready are called as
+ * soon as there is room again.
+ */
+bool bt_att_set_class_limit(struct bt_att *att, uint8_t class,
+							unsigned int limit)
+{
+	if (!att || class >= BT_ATT_CLASS_MAX)
+		return false;
+
+	att->classes[class].limit = limit;
+
+	/* Lifting the limit may make room right away */
+	class_ready(att, class);
+
+	return true;
+}
+
+/*
+ * Whether a PDU of the class was refused and the ready handlers are still to
+ * be called, so that producers can tell refusals apart from other failures.
+ */
+bool bt_att_class_is_blocked(struct bt_att *att, uint8_t class)
+{
+	if (!att || class >= BT_ATT_CLASS_MAX)
+		return false;
+
+	return att->classes[class].blocked;
+}
+
 bool bt_att_set_debug(struct bt_att *att, uint8_t level,
 			bt_att_debug_func_t callback, void *user_data,
 			bt_att_destroy_func_t destroy)
@@ -1452,7 +1961,6 @@ static void exchange_handler(void *data, void *user_data)
 bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu)
 {
 	struct bt_att_chan *chan;
-	void *buf;
 
 	if (!att)
 		return false;
@@ -1465,14 +1973,8 @@ bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu)
 	if (!chan)
 		return -ENOTCONN;
 
-	buf = malloc(mtu);
-	if (!buf)
-		return false;
-
-	free(chan->buf);
-
+	/* The receive buffers follow on the next read */
 	chan->mtu = mtu;
-	chan->buf = buf;
 
 	if (chan->mtu > att->mtu) {
 		att->mtu = chan->mtu;
@@ -1641,21 +2143,75 @@ bool bt_att_unregister_exchange(struct bt_att *att, unsigned int id)
 	return true;
 }
 
-unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
-				const void *pdu, uint16_t length,
-				bt_att_response_func_t callback, void *user_data,
-				bt_att_destroy_func_t destroy)
+unsigned int bt_att_register_ready(struct bt_att *att,
+					bt_att_ready_func_t callback,
+					void *user_data,
+					bt_att_destroy_func_t destroy)
 {
-	struct att_send_op *op;
-	bool result;
+	struct att_ready *ready;
 
 	if (!att || queue_isempty(att->chans))
 		return 0;
 
-	op = create_att_send_op(att, opcode, pdu, length, callback, user_data,
-								destroy);
-	if (!op)
+	ready = new0(struct att_ready, 1);
+	ready->callback = callback;
+	ready->destroy = destroy;
+	ready->user_data = user_data;
+
+	if (att->next_reg_id < 1)
+		att->next_reg_id = 1;
+
+	ready->id = att->next_reg_id++;
+
+	if (!queue_push_tail(att->ready_list, ready)) {
+		free(ready);
 		return 0;
+	}
+
+	return ready->id;
+}
+
+bool bt_att_unregister_ready(struct bt_att *att, unsigned int id)
+{
+	struct att_ready *ready;
+
+	if (!att || !id)
+		return false;
+
+	/* Check if disconnect is running */
+	if (queue_isempty(att->chans)) {
+		ready = queue_find(att->ready_list, match_disconn_id,
+							UINT_TO_PTR(id));
+		if (!ready)
+			return false;
+
+		ready->removed = true;
+		return true;
+	}
+
+	ready = queue_remove_if(att->ready_list, match_disconn_id,
+							UINT_TO_PTR(id));
+	if (!ready)
+		return false;
+
+	destroy_att_ready(ready);
+	return true;
+}
+
+static void update_max(unsigned int *max, struct queue *queue)
+{
+	unsigned int len = queue_length(queue);
+
+	if (len > *max)
+		*max = len;
+}
+
+static unsigned int queue_att_send_op(struct bt_att *att,
+						struct att_send_op *op)
+{
+	uint8_t class = op_class(op);
+	struct att_class *c = &att->classes[class];
+	bool result;
 
 	if (att->next_send_id < 1)
 		att->next_send_id = 1;
@@ -1663,20 +2219,30 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	op->id = att->next_send_id++;
 
 	/* Always use fixed channel for BT_ATT_OP_MTU_REQ */
-	if (opcode == BT_ATT_OP_MTU_REQ) {
+	if (op->opcode == BT_ATT_OP_MTU_REQ) {
 		struct bt_att_chan *chan = queue_peek_tail(att->chans);
 
 		result = queue_push_tail(chan->queue, op);
 		goto done;
 	}
 
+	/* Refuse until the class drained enough, the producer is told then */
+	if (c->limit && queue_length(class_queue(att, class)) >= c->limit) {
+		att->stats.refused[class]++;
+		c->blocked = true;
+		free_att_send_op(op);
+		return 0;
+	}
+
 	/* Add the op to the correct queue based on its type */
 	switch (op->type) {
 	case ATT_OP_TYPE_REQ:
 		result = queue_push_tail(att->req_queue, op);
+		update_max(&att->stats.max_req_queue, att->req_queue);
 		break;
 	case ATT_OP_TYPE_IND:
 		result = queue_push_tail(att->ind_queue, op);
+		update_max(&att->stats.max_ind_queue, att->ind_queue);
 		break;
 	case ATT_OP_TYPE_CMD:
 	case ATT_OP_TYPE_NFY:
@@ -1685,13 +2251,13 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	case ATT_OP_TYPE_CONF:
 	default:
 		result = queue_push_tail(att->write_queue, op);
+		update_max(&att->stats.max_write_queue, att->write_queue);
 		break;
 	}
 
 done:
 	if (!result) {
-		free(op->pdu);
-		free(op);
+		free_att_send_op(op);
 		return 0;
 	}
 
@@ -1700,6 +2266,153 @@ done:
 	return op->id;
 }
 
+unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
+				const void *pdu, uint16_t length,
+				bt_att_response_func_t callback, void *user_data,
+				bt_att_destroy_func_t destroy)
+{
+	struct att_send_op *op;
+
+	if (!att || queue_isempty(att->chans))
+		return 0;
+
+	op = create_att_send_op(att, opcode, pdu, length, callback, user_data,
+								destroy);
+	if (!op)
+		return 0;
+
+	return queue_att_send_op(att, op);
+}
+
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, uint16_t length)
+{
+	struct bt_att_pdu *pdu;
+
+	if (length == UINT16_MAX)
+		return NULL;
+
+	pdu = malloc(sizeof(*pdu) + 1 + length);
+	if (!pdu)
+		return NULL;
+
+	pdu->ref_count = 1;
+	pdu->len = 1 + length;
+	pdu->data[0] = opcode;
+	memset(pdu->data + 1, 0, length);
+
+	return pdu;
+}
+
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return NULL;
+
+	__sync_fetch_and_add(&pdu->ref_count, 1);
+
+	return pdu;
+}
+
+void bt_att_pdu_unref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return;
+
+	if (__sync_sub_and_fetch(&pdu->ref_count, 1))
+		return;
+
+	free(pdu);
+}
+
+uint8_t *bt_att_pdu_get_params(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return NULL;
+
+	return pdu->data + 1;
+}
+
+uint16_t bt_att_pdu_get_length(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return 0;
+
+	return pdu->len - 1;
+}
+
+/*
+ * Queues a PDU built with bt_att_pdu_new. The PDU is referenced rather than
+ * copied so it must not be modified afterwards. Signed PDUs can't be shared
+ * as the signature depends on the bearer.
+ */
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu,
+				bt_att_response_func_t callback, void *user_data,
+				bt_att_destroy_func_t destroy)
+{
+	struct att_send_op *op;
+
+	if (!att || !pdu || queue_isempty(att->chans))
+		return 0;
+
+	if (pdu->data[0] & ATT_OP_SIGNED_MASK || pdu->len > att->mtu)
+		return 0;
+
+	op = new_att_send_op(att, pdu->data[0], callback, user_data, destroy);
+	if (!op)
+		return 0;
+
+	op->shared = bt_att_pdu_ref(pdu);
+	op->pdu = pdu->data;
+	op->len = pdu->len;
+	op->iov[0].iov_base = op->pdu;
+	op->iov[0].iov_len = op->len;
+	op->iovcnt = 1;
+
+	return queue_att_send_op(att, op);
+}
+
+/*
+ * Queues a PDU whose parameters are gathered from the given buffers when it
+ * is written rather than copied. The buffers must remain valid until destroy
+ * is called, so only PDUs that don't expect a response can be sent this way.
+ */
+unsigned int bt_att_sendv(struct bt_att *att, uint8_t opcode,
+				const struct iovec *iov, int iovcnt,
+				void *user_data, bt_att_destroy_func_t destroy)
+{
+	struct att_send_op *op;
+	size_t len = 1;
+	int i;
+
+	if (!att || queue_isempty(att->chans))
+		return 0;
+
+	if (iovcnt < 0 || iovcnt > ATT_IOV_MAX || (iovcnt && !iov))
+		return 0;
+
+	/* The signature would need the whole PDU */
+	if (opcode & ATT_OP_SIGNED_MASK)
+		return 0;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (len > att->mtu)
+		return 0;
+
+	op = new_att_send_op(att, opcode, NULL, user_data, destroy);
+	if (!op)
+		return 0;
+
+	op->len = len;
+	op->iov[0].iov_base = &op->opcode;
+	op->iov[0].iov_len = 1;
+	memcpy(&op->iov[1], iov, iovcnt * sizeof(*iov));
+	op->iovcnt = 1 + iovcnt;
+
+	return queue_att_send_op(att, op);
+}
+
 int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 				const void *pdu, uint16_t length,
 				bt_att_response_func_t callback,
@@ -1759,8 +2472,7 @@ done:
 	}
 
 	if (!result) {
-		free(op->pdu);
-		free(op);
+		free_att_send_op(op);
 		return -ENOMEM;
 	}
 
@@ -1786,8 +2498,7 @@ unsigned int bt_att_chan_send(struct bt_att_chan *chan, uint8_t opcode,
 		return -EINVAL;
 
 	if (!queue_push_tail(chan->queue, op)) {
-		free(op->pdu);
-		free(op);
+		free_att_send_op(op);
 		return 0;
 	}
 
@@ -1886,6 +2597,7 @@ bool bt_att_cancel(struct bt_att *att, unsigned int id)
 {
 	const struct queue_entry *entry;
 	struct att_send_op *op;
+	uint8_t class;
 
 	if (!att || !id)
 		return false;
@@ -1922,9 +2634,11 @@ bool bt_att_cancel(struct bt_att *att, unsigned int id)
 		return false;
 
 done:
+	class = op_class(op);
 	destroy_att_send_op(op);
 
 	wakeup_writer(att);
+	class_ready(att, class);
 
 	return true;
 }
@@ -1957,6 +2671,8 @@ bool bt_att_cancel_all(struct bt_att *att)
 			cancel_att_send_op(chan->pending_ind);
 	}
 
+	classes_ready(att);
+
 	return true;
 }
 
@@ -2062,6 +2778,7 @@ bool bt_att_unregister_all(struct bt_att *att)
 	queue_remove_all(att->notify_list, NULL, NULL, destroy_att_notify);
 	queue_remove_all(att->disconn_list, NULL, NULL, destroy_att_disconn);
 	queue_remove_all(att->exchange_list, NULL, NULL, destroy_att_exchange);
+	queue_remove_all(att->ready_list, NULL, NULL, destroy_att_ready);
 
 	return true;
 }
@@ -10,14 +10,17 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "src/shared/att-types.h"
+#include "src/shared/stats.h"
 
 #define BT_ATT_DEBUG		0x00
 #define BT_ATT_DEBUG_VERBOSE	0x01
 #define BT_ATT_DEBUG_HEXDUMP	0x02
 
 struct bt_att;
+struct bt_att_pdu;
 struct bt_att_chan;
 
 struct bt_att *bt_att_new(int fd, bool ext_signed);
@@ -33,6 +36,40 @@ int bt_att_attach_fd(struct bt_att *att, int fd);
 
 int bt_att_get_channels(struct bt_att *att);
 
+/* Traffic classes of the queues shared by all channels */
+#define BT_ATT_CLASS_REQ	0x00	/* Requests */
+#define BT_ATT_CLASS_IND	0x01	/* Indications */
+#define BT_ATT_CLASS_WRITE	0x02	/* Commands, notifications and others */
+#define BT_ATT_CLASS_MAX	0x03
+
+struct bt_att_stats {
+	unsigned int req_queue;		/* Queued requests */
+	unsigned int ind_queue;		/* Queued indications */
+	unsigned int write_queue;	/* Queued commands and notifications */
+	unsigned int max_req_queue;
+	unsigned int max_ind_queue;
+	unsigned int max_write_queue;
+	unsigned int sent[BT_ATT_CLASS_MAX];	/* PDUs written */
+	unsigned int refused[BT_ATT_CLASS_MAX];	/* Over the queue limit */
+	struct stats_hist rtt;		/* Request/indication round trip */
+};
+
+struct bt_att_chan_stats {
+	uint8_t type;
+	uint16_t mtu;
+	unsigned int outstanding;	/* Bytes awaiting response */
+	unsigned int sent[BT_ATT_CLASS_MAX];	/* PDUs written */
+	uint64_t sent_bytes;
+};
+
+typedef void (*bt_att_chan_stats_func_t)(const struct bt_att_chan_stats *stats,
+							void *user_data);
+
+bool bt_att_get_stats(struct bt_att *att, struct bt_att_stats *stats);
+bool bt_att_foreach_chan_stats(struct bt_att *att,
+					bt_att_chan_stats_func_t func,
+					void *user_data);
+
 typedef void (*bt_att_response_func_t)(uint8_t opcode, const void *pdu,
 					uint16_t length, void *user_data);
 typedef void (*bt_att_notify_func_t)(struct bt_att_chan *chan, uint16_t mtu,
@@ -45,6 +82,7 @@ typedef void (*bt_att_timeout_func_t)(unsigned int id, uint8_t opcode,
 typedef void (*bt_att_disconnect_func_t)(int err, void *user_data);
 typedef void (*bt_att_exchange_func_t)(uint16_t mtu, void *user_data);
 typedef bool (*bt_att_counter_func_t)(uint32_t *sign_cnt, void *user_data);
+typedef void (*bt_att_ready_func_t)(uint8_t class, void *user_data);
 
 /* DB sync callback - notifies upper layer of DB_OUT_OF_SYNC error */
 typedef void (*bt_att_db_sync_func_t)(const struct bt_att_pdu_error_rsp *error,
@@ -67,11 +105,30 @@ bool bt_att_set_db_sync_cb(struct bt_att *att, bt_att_db_sync_func_t callback,
 						void *user_data,
 						bt_att_destroy_func_t destroy);
 
+bool bt_att_set_class_limit(struct bt_att *att, uint8_t class,
+							unsigned int limit);
+bool bt_att_class_is_blocked(struct bt_att *att, uint8_t class);
+
 unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 					const void *pdu, uint16_t length,
 					bt_att_response_func_t callback,
 					void *user_data,
 					bt_att_destroy_func_t destroy);
+
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, uint16_t length);
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu);
+void bt_att_pdu_unref(struct bt_att_pdu *pdu);
+uint8_t *bt_att_pdu_get_params(struct bt_att_pdu *pdu);
+uint16_t bt_att_pdu_get_length(struct bt_att_pdu *pdu);
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu,
+					bt_att_response_func_t callback,
+					void *user_data,
+					bt_att_destroy_func_t destroy);
+unsigned int bt_att_sendv(struct bt_att *att, uint8_t opcode,
+					const struct iovec *iov, int iovcnt,
+					void *user_data,
+					bt_att_destroy_func_t destroy);
+
 int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 					const void *pdu, uint16_t length,
 					bt_att_response_func_t callback,
@@ -108,6 +165,11 @@ unsigned int bt_att_register_exchange(struct bt_att *att,
 					void *user_data,
 					bt_att_destroy_func_t destroy);
 bool bt_att_unregister_exchange(struct bt_att *att, unsigned int id);
+unsigned int bt_att_register_ready(struct bt_att *att,
+					bt_att_ready_func_t callback,
+					void *user_data,
+					bt_att_destroy_func_t destroy);
+bool bt_att_unregister_ready(struct bt_att *att, unsigned int id);
 bool bt_att_unregister_all(struct bt_att *att);
 
 int bt_att_get_security(struct bt_att *att, uint8_t *enc_size);
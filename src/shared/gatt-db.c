@@ -33,6 +33,12 @@
 #define ATTRIBUTE_TIMEOUT 5000
 #define HASH_UPDATE_TIMEOUT 100
 
+/* Handles are indexed in pages of 256, see struct gatt_db_index */
+#define INDEX_SHIFT 8
+#define INDEX_PAGE_SIZE (1 << INDEX_SHIFT)
+#define INDEX_PAGE_MASK (INDEX_PAGE_SIZE - 1)
+#define INDEX_NUM_PAGES (0x10000 >> INDEX_SHIFT)
+
 static const bt_uuid_t primary_service_uuid = { .type = BT_UUID16,
 					.value.u16 = GATT_PRIM_SVC_UUID };
 static const bt_uuid_t secondary_service_uuid = { .type = BT_UUID16,
@@ -53,13 +59,27 @@ struct gatt_db_ccc {
 	void *user_data;
 };
 
+/*
+ * Maps a page of handles to the services covering it. A service spanning
+ * the whole page is stored directly so that large services, like the ones
+ * discovered up to 0xffff, don't need per handle entries.
+ */
+struct gatt_db_index {
+	struct gatt_db_service *service;
+	struct gatt_db_service **page;
+	unsigned int count;
+};
+
 struct gatt_db {
 	int ref_count;
 	struct bt_crypto *crypto;
 	uint8_t hash[16];
 	unsigned int hash_id;
+	bool hash_dirty;
+	struct gatt_db_stats stats;
 	uint16_t last_handle;
 	struct queue *services;
+	struct gatt_db_index *index;
 
 	struct queue *notify_list;
 	unsigned int next_notify_id;
@@ -131,6 +151,10 @@ struct gatt_db_service {
 	bool claimed;
 	uint16_t num_handles;
 	struct gatt_db_attribute **attributes;
+
+	/* Hash input of the service, NULL until the next hash update */
+	uint8_t *hash_data;
+	size_t hash_len;
 };
 
 static void set_attribute_data(struct gatt_db_attribute *attribute,
@@ -190,6 +214,13 @@ static void attribute_notify_destroy(void *data)
 	free(notify);
 }
 
+static void service_hash_invalidate(struct gatt_db_service *service)
+{
+	free(service->hash_data);
+	service->hash_data = NULL;
+	service->hash_len = 0;
+}
+
 static void attribute_destroy(struct gatt_db_attribute *attribute)
 {
 	/* Attribute was not initialized by user */
@@ -214,6 +245,8 @@ static struct gatt_db_attribute *new_attribute(struct gatt_db_service *service,
 
 	attribute = new0(struct gatt_db_attribute, 1);
 
+	service_hash_invalidate(service);
+
 	attribute->service = service;
 	attribute->handle = handle;
 	attribute->uuid = *type;
@@ -237,6 +270,127 @@ failed:
 	return NULL;
 }
 
+static void gatt_db_service_get_handles(const struct gatt_db_service *service,
+							uint16_t *start_handle,
+							uint16_t *end_handle)
+{
+	if (start_handle)
+		*start_handle = service->attributes[0]->handle;
+
+	if (end_handle)
+		*end_handle = service->attributes[0]->handle +
+						service->num_handles - 1;
+}
+
+static void index_set(struct gatt_db *db, struct gatt_db_service *service,
+						struct gatt_db_service *value)
+{
+	uint16_t start, end;
+	unsigned int i;
+
+	gatt_db_service_get_handles(service, &start, &end);
+
+	for (i = start >> INDEX_SHIFT; i <= (unsigned int) end >> INDEX_SHIFT;
+									i++) {
+		struct gatt_db_index *index = &db->index[i];
+		unsigned int first = i << INDEX_SHIFT;
+		unsigned int last = first + INDEX_PAGE_MASK;
+		unsigned int j;
+
+		if (start > first)
+			first = start;
+
+		if (end < last)
+			last = end;
+
+		if (!(first & INDEX_PAGE_MASK) &&
+				(last & INDEX_PAGE_MASK) == INDEX_PAGE_MASK) {
+			index->service = value;
+			continue;
+		}
+
+		if (!index->page)
+			index->page = new0(struct gatt_db_service *,
+							INDEX_PAGE_SIZE);
+
+		for (j = first; j <= last; j++)
+			index->page[j & INDEX_PAGE_MASK] = value;
+
+		if (value) {
+			index->count += last - first + 1;
+			continue;
+		}
+
+		index->count -= last - first + 1;
+		if (!index->count) {
+			free(index->page);
+			index->page = NULL;
+		}
+	}
+}
+
+static void index_add(struct gatt_db *db, struct gatt_db_service *service)
+{
+	if (!db->index)
+		db->index = new0(struct gatt_db_index, INDEX_NUM_PAGES);
+
+	index_set(db, service, service);
+}
+
+static void index_remove(struct gatt_db *db, struct gatt_db_service *service)
+{
+	if (db->index)
+		index_set(db, service, NULL);
+}
+
+static struct gatt_db_service *index_find(struct gatt_db *db, uint16_t handle)
+{
+	struct gatt_db_index *index;
+
+	if (!db->index)
+		return NULL;
+
+	index = &db->index[handle >> INDEX_SHIFT];
+	if (index->service)
+		return index->service;
+
+	if (index->page)
+		return index->page[handle & INDEX_PAGE_MASK];
+
+	return NULL;
+}
+
+/* Returns the first service covering a handle in [start, end] */
+static struct gatt_db_service *index_next(struct gatt_db *db,
+						unsigned int start,
+						unsigned int end)
+{
+	struct gatt_db_index *index;
+
+	if (!db->index)
+		return NULL;
+
+	while (start <= end) {
+		index = &db->index[start >> INDEX_SHIFT];
+
+		if (index->service)
+			return index->service;
+
+		if (!index->page) {
+			start = (start | INDEX_PAGE_MASK) + 1;
+			continue;
+		}
+
+		do {
+			if (index->page[start & INDEX_PAGE_MASK])
+				return index->page[start & INDEX_PAGE_MASK];
+		} while ((start++ & INDEX_PAGE_MASK) != INDEX_PAGE_MASK &&
+								start <= end);
+	}
+
+	return NULL;
+}
+
 struct gatt_db *gatt_db_ref(struct gatt_db *db)
 {
 	if (!db)
@@ -316,6 +470,7 @@ static void service_clone(void *data, void *user_data)
 	}
 
 	queue_push_tail(db->services, clone);
+	index_add(db, clone);
 }
 
 struct gatt_db *gatt_db_clone(struct gatt_db *db)
@@ -368,89 +523,139 @@ static void handle_notify(void *data, void *user_data)
 		notify->service_removed(notify_data->attr, notify->user_data);
 }
 
-struct hash_data {
-	struct iovec *iov;
-	uint16_t i;
-};
-
-static void gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
+static size_t hash_attribute_len(const struct gatt_db_attribute *attr)
 {
-	struct hash_data *hash = user_data;
-	uint8_t *data;
-	size_t len;
-
 	if (!attr || !attr->value)
-		return;
+		return 0;
 
 	if (bt_uuid_len(&attr->uuid) != 2)
-		return;
+		return 0;
 
 	switch (attr->uuid.value.u16) {
 	case GATT_PRIM_SVC_UUID:
 	case GATT_SND_SVC_UUID:
 	case GATT_INCLUDE_UUID:
 	case GATT_CHARAC_UUID:
-		/* Allocate space for handle + type + value */
-		len = 2 + 2 + attr->value_len;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
-		memcpy(data + 4, attr->value, attr->value_len);
-		break;
+		/* Handle + type + value */
+		return 2 + 2 + attr->value_len;
 	case GATT_CHARAC_USER_DESC_UUID:
 	case GATT_CLIENT_CHARAC_CFG_UUID:
 	case GATT_SERVER_CHARAC_CFG_UUID:
 	case GATT_CHARAC_FMT_UUID:
 	case GATT_CHARAC_AGREG_FMT_UUID:
-		/* Allocate space for handle + type  */
-		len = 2 + 2;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
-		break;
+		/* Handle + type */
+		return 2 + 2;
 	default:
+		return 0;
+	}
+}
+
+/*
+ * Serializes the attributes of a service that are part of the Database
+ * Hash. The result is kept until the service changes so that only changed
+ * services need to be serialized again.
+ */
+static void service_gen_hash(struct gatt_db_service *service)
+{
+	uint8_t *data;
+	size_t len = 0;
+	int i;
+
+	if (service->hash_data)
 		return;
+
+	for (i = 0; i < service->num_handles; i++)
+		len += hash_attribute_len(service->attributes[i]);
+
+	service->hash_data = malloc(len);
+	service->hash_len = len;
+	service->db->stats.hash_segments++;
+
+	for (i = 0, data = service->hash_data; i < service->num_handles; i++) {
+		struct gatt_db_attribute *attr = service->attributes[i];
+		size_t attr_len = hash_attribute_len(attr);
+
+		if (!attr_len)
+			continue;
+
+		put_le16(attr->handle, data);
+		bt_uuid_to_le(&attr->uuid, data + 2);
+		memcpy(data + 4, attr->value, attr_len - 4);
+		data += attr_len;
 	}
+}
 
-	hash->iov[hash->i].iov_base = data;
-	hash->iov[hash->i].iov_len = len;
+struct hash_data {
+	uint8_t *data;
+	size_t len;
+};
 
-	hash->i++;
+static void service_hash_len(struct gatt_db_attribute *attr, void *user_data)
+{
+	struct hash_data *hash = user_data;
 
-	return;
+	service_gen_hash(attr->service);
+	hash->len += attr->service->hash_len;
 }
 
-static void service_gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
+static void service_hash_copy(struct gatt_db_attribute *attr, void *user_data)
 {
-	gatt_db_service_foreach(attr, NULL, gen_hash_m, user_data);
+	struct hash_data *hash = user_data;
+	struct gatt_db_service *service = attr->service;
+
+	memcpy(hash->data + hash->len, service->hash_data, service->hash_len);
+	hash->len += service->hash_len;
 }
 
 static bool db_hash_update(void *user_data)
 {
 	struct gatt_db *db = user_data;
 	struct hash_data hash;
-	uint16_t i;
+	struct iovec iov;
 
 	db->hash_id = 0;
+	db->hash_dirty = false;
 
 	if (gatt_db_isempty(db))
 		return false;
 
-	hash.iov = new0(struct iovec, db->last_handle + 1);
-	hash.i = 0;
+	/*
+	 * The active services are concatenated so the CMAC takes a single
+	 * buffer no matter how many attributes the database has.
+	 */
+	memset(&hash, 0, sizeof(hash));
+	gatt_db_foreach_service(db, NULL, service_hash_len, &hash);
+
+	hash.data = malloc(hash.len);
+	hash.len = 0;
+	gatt_db_foreach_service(db, NULL, service_hash_copy, &hash);
 
-	gatt_db_foreach_service(db, NULL, service_gen_hash_m, &hash);
-	bt_crypto_gatt_hash(db->crypto, hash.iov, db->last_handle + 1,
-				db->hash);
+	iov.iov_base = hash.data;
+	iov.iov_len = hash.len;
 
-	for (i = 0; i < hash.i; i++)
-		free(hash.iov[i].iov_base);
+	bt_crypto_gatt_hash(db->crypto, &iov, 1, db->hash);
+	db->stats.hash_updates++;
 
-	free(hash.iov);
+	free(hash.data);
 
 	return false;
 }
 
+static void db_hash_schedule(struct gatt_db *db)
+{
+	if (!db->crypto)
+		return;
+
+	db->hash_dirty = true;
+
+	/* Restart the timer so a burst of changes is hashed only once */
+	if (db->hash_id)
+		timeout_remove(db->hash_id);
+
+	db->hash_id = timeout_add(HASH_UPDATE_TIMEOUT, db_hash_update, db,
+									NULL);
+}
+
 static void handle_attribute_notify(void *data, void *user_data)
 {
 	struct attribute_notify *notify = data;
@@ -483,6 +688,9 @@ static void notify_service_changed(struct gatt_db *db,
 	if (!added)
 		notify_attribute_changed(service);
 
+	/* Trigger hash update */
+	db_hash_schedule(db);
+
 	if (queue_isempty(db->notify_list))
 		return;
 
@@ -493,11 +701,6 @@ static void notify_service_changed(struct gatt_db *db,
 
 	queue_foreach(db->notify_list, handle_notify, &data);
 
-	/* Trigger hash update */
-	if (!db->hash_id && db->crypto)
-		db->hash_id = timeout_add(HASH_UPDATE_TIMEOUT, db_hash_update,
-								db, NULL);
-
 	gatt_db_unref(db);
 }
 
@@ -506,6 +709,9 @@ static void gatt_db_service_destroy(void *data)
 	struct gatt_db_service *service = data;
 	int i;
 
+	if (service->db)
+		index_remove(service->db, service);
+
 	if (service->active)
 		notify_service_changed(service->db, service, false);
 
@@ -513,6 +719,7 @@ static void gatt_db_service_destroy(void *data)
 		attribute_destroy(service->attributes[i]);
 
 	free(service->attributes);
+	free(service->hash_data);
 	free(service);
 }
 
@@ -530,10 +737,13 @@ static void gatt_db_destroy(struct gatt_db *db)
 	queue_destroy(db->notify_list, notify_destroy);
 	db->notify_list = NULL;
 
+	/* Removing active services schedules a hash update */
+	queue_destroy(db->services, gatt_db_service_destroy);
+
 	if (db->hash_id)
 		timeout_remove(db->hash_id);
 
-	queue_destroy(db->services, gatt_db_service_destroy);
+	free(db->index);
 	free(db->ccc);
 	free(db);
 }
@@ -652,18 +862,6 @@ bool gatt_db_clear(struct gatt_db *db)
 	return gatt_db_clear_range(db, 1, UINT16_MAX);
 }
 
-static void gatt_db_service_get_handles(const struct gatt_db_service *service,
-							uint16_t *start_handle,
-							uint16_t *end_handle)
-{
-	if (start_handle)
-		*start_handle = service->attributes[0]->handle;
-
-	if (end_handle)
-		*end_handle = service->attributes[0]->handle +
-						service->num_handles - 1;
-}
-
 struct clear_range {
 	uint16_t start, end;
 };
@@ -715,7 +913,7 @@ uint8_t *gatt_db_get_hash(struct gatt_db *db)
 		return NULL;
 
 	/* Generate hash if if has not been generated yet */
-	if (db->hash_id || !memcmp(db->hash, hash, 16)) {
+	if (db->hash_dirty || !memcmp(db->hash, hash, 16)) {
 		timeout_remove(db->hash_id);
 		db_hash_update(db);
 	}
@@ -723,6 +921,16 @@ uint8_t *gatt_db_get_hash(struct gatt_db *db)
 	return db->hash;
 }
 
+bool gatt_db_get_stats(struct gatt_db *db, struct gatt_db_stats *stats)
+{
+	if (!db || !stats)
+		return false;
+
+	*stats = db->stats;
+
+	return true;
+}
+
 bool gatt_db_hash_support(struct gatt_db *db)
 {
 	if (!db || !db->crypto)
@@ -754,6 +962,10 @@ static struct gatt_db_service *find_insert_loc(struct gatt_db *db,
 		if (end >= cur_start && end <= cur_end)
 			return service;
 
+		/* Services cannot overlap, each handle maps to one of them */
+		if (start < cur_start && end > cur_end)
+			return service;
+
 		if (end < cur_start)
 			return NULL;
 
@@ -783,7 +995,17 @@ struct gatt_db_attribute *gatt_db_insert_service(struct gatt_db *db,
 	if (num_handles < 1 || (handle + num_handles - 1) > UINT16_MAX)
 		return NULL;
 
-	service = find_insert_loc(db, handle, handle + num_handles - 1, &after);
+	/*
+	 * Services past the last handle in use can be appended right away,
+	 * which is the common case when restoring a database from storage.
+	 */
+	if (handle > db->last_handle) {
+		service = NULL;
+		after = queue_peek_tail(db->services);
+	} else
+		service = find_insert_loc(db, handle, handle + num_handles - 1,
+									&after);
+
 	if (service) {
 		const bt_uuid_t *type;
 		bt_uuid_t value;
@@ -824,6 +1046,7 @@ struct gatt_db_attribute *gatt_db_insert_service(struct gatt_db *db,
 	service->db = db;
 	service->attributes[0]->handle = handle;
 	service->num_handles = num_handles;
+	index_add(db, service);
 
 	/* Fast-forward last_handle if the new service was added to the end */
 	db->last_handle = MAX(handle + num_handles - 1, db->last_handle);
@@ -1633,12 +1856,11 @@ static void foreach_service_in_range(void *data, void *user_data)
 	foreach_data->func(service->attributes[0], foreach_data->user_data);
 }
 
-static void foreach_in_range(void *data, void *user_data)
+static void foreach_in_service(struct gatt_db_service *service,
+					struct foreach_data *foreach_data)
 {
-	struct gatt_db_service *service = data;
-	struct foreach_data *foreach_data = user_data;
 	uint16_t svc_start, svc_end;
-	int i;
+	int i, last;
 
 	if (!service->active)
 		return;
@@ -1653,21 +1875,19 @@ static void foreach_in_range(void *data, void *user_data)
 		if (svc_start < foreach_data->start)
 			return;
 
-		return foreach_service_in_range(data, user_data);
+		return foreach_service_in_range(service, foreach_data);
 	}
 
-	for (i = 0; i < service->num_handles; i++) {
+	/* Attributes are stored at their offset from the service handle */
+	i = MAX(foreach_data->start, svc_start) - svc_start;
+	last = MIN(foreach_data->end, svc_end) - svc_start;
+
+	for (; i <= last && i < service->num_handles; i++) {
 		struct gatt_db_attribute *attribute = service->attributes[i];
 
 		if (!attribute)
 			continue;
 
-		if (attribute->handle < foreach_data->start)
-			continue;
-
-		if (attribute->handle > foreach_data->end)
-			return;
-
 		if (foreach_data->uuid && bt_uuid_cmp(foreach_data->uuid,
 							&attribute->uuid))
 			continue;
@@ -1676,6 +1896,22 @@ static void foreach_in_range(void *data, void *user_data)
 	}
 }
 
+static void foreach_in_range(struct gatt_db *db,
+					struct foreach_data *foreach_data)
+{
+	struct gatt_db_service *service;
+	unsigned int handle = foreach_data->start;
+	uint16_t svc_end;
+
+	while ((service = index_next(db, handle, foreach_data->end))) {
+		/* Move on before the callbacks get a chance to free it */
+		gatt_db_service_get_handles(service, NULL, &svc_end);
+		handle = svc_end + 1;
+
+		foreach_in_service(service, foreach_data);
+	}
+}
+
 void gatt_db_foreach_service_in_range(struct gatt_db *db,
 						const bt_uuid_t *uuid,
 						gatt_db_attribute_cb_t func,
@@ -1695,7 +1931,7 @@ void gatt_db_foreach_service_in_range(struct gatt_db *db,
 	data.end = end_handle;
 	data.attr = false;
 
-	queue_foreach(db->services, foreach_in_range, &data);
+	foreach_in_range(db, &data);
 }
 
 void gatt_db_foreach_in_range(struct gatt_db *db, const bt_uuid_t *uuid,
@@ -1716,7 +1952,7 @@ void gatt_db_foreach_in_range(struct gatt_db *db, const bt_uuid_t *uuid,
 	data.end = end_handle;
 	data.attr = true;
 
-	queue_foreach(db->services, foreach_in_range, &data);
+	foreach_in_range(db, &data);
 }
 
 void gatt_db_service_foreach(struct gatt_db_attribute *attrib,
@@ -1761,12 +1997,13 @@ static int gatt_db_attribute_get_index(const struct gatt_db_attribute *attrib)
 		return -1;
 
 	service = attrib->service;
-	for (index = 0; index < service->num_handles; index++) {
-		if (service->attributes[index] == attrib)
-			return index;
-	}
+	index = attrib->handle - service->attributes[0]->handle;
+
+	if (index < 0 || index >= service->num_handles ||
+					service->attributes[index] != attrib)
+		return -1;
 
-	return -1;
+	return index;
 }
 
 struct gatt_db_attribute *
@@ -1840,17 +2077,6 @@ void gatt_db_service_foreach_incl(struct gatt_db_attribute *attrib,
 								user_data);
 }
 
-static bool find_service_for_handle(const void *data, const void *user_data)
-{
-	const struct gatt_db_service *service = data;
-	uint16_t handle = PTR_TO_UINT(user_data);
-	uint16_t start, end;
-
-	gatt_db_service_get_handles(service, &start, &end);
-
-	return (start <= handle) && (handle <= end);
-}
-
 struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 							uint16_t handle)
 {
@@ -1859,8 +2085,7 @@ struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 	if (!db || !handle)
 		return NULL;
 
-	service = queue_find(db->services, find_service_for_handle,
-						UINT_TO_PTR(handle));
+	service = index_find(db, handle);
 	if (!service)
 		return NULL;
 
@@ -1870,25 +2095,16 @@ struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 struct gatt_db_attribute *gatt_db_get_attribute(struct gatt_db *db,
 							uint16_t handle)
 {
-	struct gatt_db_attribute *attrib;
 	struct gatt_db_service *service;
-	int i;
 
-	attrib = gatt_db_get_service(db, handle);
-	if (!attrib)
+	if (!db || !handle)
 		return NULL;
 
-	service = attrib->service;
-
-	for (i = 0; i < service->num_handles; i++) {
-		if (!service->attributes[i])
-			continue;
-
-		if (service->attributes[i]->handle == handle)
-			return service->attributes[i];
-	}
+	service = index_find(db, handle);
+	if (!service)
+		return NULL;
 
-	return NULL;
+	return service->attributes[handle - service->attributes[0]->handle];
 }
 
 static bool find_service_with_uuid(const void *data, const void *user_data)
@@ -2226,6 +2442,7 @@ bool gatt_db_attribute_set_fixed_length(struct gatt_db_attribute *attrib,
 	}
 
 	attrib->value_len = len;
+	service_hash_invalidate(service);
 
 	return true;
 }
@@ -2387,6 +2604,7 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 	}
 
 	memcpy(&attrib->value[offset], value, len);
+	service_hash_invalidate(attrib->service);
 
 done:
 	if (func)
@@ -2483,6 +2701,7 @@ bool gatt_db_attribute_reset(struct gatt_db_attribute *attrib)
 	free(attrib->value);
 	attrib->value = NULL;
 	attrib->value_len = 0;
+	service_hash_invalidate(attrib->service);
 
 	return true;
 }
@@ -2549,3 +2768,312 @@ bool gatt_db_attribute_unregister(struct gatt_db_attribute *attrib,
 
 	return true;
 }
+
+/*
+ * Binary export format used to cache remote databases. All fields are
+ * little endian. The header is followed by one record per service,
+ * included service, characteristic and descriptor in handle order.
+ */
+#define DB_EXPORT_MAGIC		0x43544147	/* "GATC" */
+#define DB_EXPORT_VERSION	1
+#define DB_EXPORT_HDR_LEN	28
+#define DB_EXPORT_REC_LEN	9
+
+enum db_export_type {
+	DB_EXPORT_PRIMARY = 0x01,
+	DB_EXPORT_SECONDARY,
+	DB_EXPORT_INCLUDED,
+	DB_EXPORT_CHARACTERISTIC,
+	DB_EXPORT_DESCRIPTOR,
+};
+
+struct db_export_record {
+	uint8_t type;
+	uint8_t properties;
+	uint16_t handle;
+	uint16_t aux;
+	uint8_t uuid_len;
+	uint16_t value_len;
+	const uint8_t *uuid;
+	const uint8_t *value;
+};
+
+struct db_export {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+	uint32_t count;
+};
+
+static void db_export_append(struct db_export *exp, const void *data,
+								size_t len)
+{
+	if (!len)
+		return;
+
+	if (exp->len + len > exp->size) {
+		exp->size = MAX(exp->size * 2, exp->len + len);
+		exp->data = realloc(exp->data, exp->size);
+	}
+
+	memcpy(exp->data + exp->len, data, len);
+	exp->len += len;
+}
+
+static void db_export_record(struct db_export *exp,
+					const struct db_export_record *rec)
+{
+	uint8_t hdr[DB_EXPORT_REC_LEN];
+
+	hdr[0] = rec->type;
+	hdr[1] = rec->properties;
+	put_le16(rec->handle, &hdr[2]);
+	put_le16(rec->aux, &hdr[4]);
+	hdr[6] = rec->uuid_len;
+	put_le16(rec->value_len, &hdr[7]);
+
+	db_export_append(exp, hdr, sizeof(hdr));
+	db_export_append(exp, rec->uuid, rec->uuid_len);
+	db_export_append(exp, rec->value, rec->value_len);
+
+	exp->count++;
+}
+
+static void db_export_service(struct gatt_db_service *service,
+						struct db_export *exp)
+{
+	struct gatt_db_attribute *attr = service->attributes[0];
+	struct db_export_record rec;
+	uint8_t uuid[16];
+	uint16_t value_handle = 0;
+	int i;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = bt_uuid_cmp(&attr->uuid, &primary_service_uuid) ?
+				DB_EXPORT_SECONDARY : DB_EXPORT_PRIMARY;
+	rec.handle = attr->handle;
+	rec.aux = service->num_handles;
+	rec.uuid_len = attr->value_len;
+	rec.uuid = attr->value;
+	db_export_record(exp, &rec);
+
+	for (i = 1; i < service->num_handles; i++) {
+		attr = service->attributes[i];
+		if (!attr || attr->handle == value_handle)
+			continue;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.handle = attr->handle;
+
+		if (!bt_uuid_cmp(&attr->uuid, &included_service_uuid)) {
+			rec.type = DB_EXPORT_INCLUDED;
+			rec.aux = get_le16(attr->value);
+		} else if (!bt_uuid_cmp(&attr->uuid, &characteristic_uuid)) {
+			struct gatt_db_attribute *value;
+
+			rec.type = DB_EXPORT_CHARACTERISTIC;
+			rec.properties = attr->value[0];
+			rec.aux = value_handle = get_le16(&attr->value[1]);
+			rec.uuid_len = attr->value_len - 3;
+			rec.uuid = &attr->value[3];
+
+			value = gatt_db_get_attribute(service->db, value_handle);
+			if (value && value->value) {
+				rec.value_len = value->value_len;
+				rec.value = value->value;
+			}
+		} else {
+			rec.type = DB_EXPORT_DESCRIPTOR;
+			rec.uuid_len = uuid_to_le(&attr->uuid, uuid);
+			rec.uuid = uuid;
+
+			if (attr->value) {
+				rec.value_len = attr->value_len;
+				rec.value = attr->value;
+			}
+		}
+
+		db_export_record(exp, &rec);
+	}
+}
+
+static void db_export_hash(struct gatt_db_attribute *attrib, void *user_data)
+{
+	uint8_t *hash = user_data;
+
+	if (attrib->value && attrib->value_len == 16)
+		memcpy(hash, attrib->value, 16);
+}
+
+uint8_t *gatt_db_export(struct gatt_db *db, size_t *len)
+{
+	struct db_export exp;
+	uint8_t hdr[DB_EXPORT_HDR_LEN];
+	bt_uuid_t uuid;
+
+	if (!db || !len)
+		return NULL;
+
+	memset(&exp, 0, sizeof(exp));
+	memset(hdr, 0, sizeof(hdr));
+
+	put_le32(DB_EXPORT_MAGIC, hdr);
+	put_le16(DB_EXPORT_VERSION, &hdr[4]);
+
+	/* Key the export with the Database Hash the database contains */
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+	gatt_db_find_by_type(db, 0x0001, 0xffff, &uuid, db_export_hash,
+								&hdr[8]);
+
+	db_export_append(&exp, hdr, sizeof(hdr));
+	queue_foreach(db->services, (queue_foreach_func_t) db_export_service,
+									&exp);
+	put_le32(exp.count, &exp.data[24]);
+
+	*len = exp.len;
+
+	return exp.data;
+}
+
+const uint8_t *gatt_db_export_get_hash(const void *data, size_t len)
+{
+	const uint8_t *ptr = data;
+
+	if (!data || len < DB_EXPORT_HDR_LEN ||
+				get_le32(ptr) != DB_EXPORT_MAGIC ||
+				get_le16(&ptr[4]) != DB_EXPORT_VERSION)
+		return NULL;
+
+	return &ptr[8];
+}
+
+static const uint8_t *db_import_record(const uint8_t *ptr,
+					const uint8_t *end,
+					struct db_export_record *rec)
+{
+	if (end - ptr < DB_EXPORT_REC_LEN)
+		return NULL;
+
+	rec->type = ptr[0];
+	rec->properties = ptr[1];
+	rec->handle = get_le16(&ptr[2]);
+	rec->aux = get_le16(&ptr[4]);
+	rec->uuid_len = ptr[6];
+	rec->value_len = get_le16(&ptr[7]);
+	ptr += DB_EXPORT_REC_LEN;
+
+	if (end - ptr < rec->uuid_len + rec->value_len)
+		return NULL;
+
+	rec->uuid = ptr;
+	rec->value = ptr + rec->uuid_len;
+
+	return ptr + rec->uuid_len + rec->value_len;
+}
+
+static bool db_import_attribute(struct gatt_db_attribute *service,
+					const struct db_export_record *rec)
+{
+	struct gatt_db_attribute *attr;
+	bt_uuid_t uuid;
+
+	switch (rec->type) {
+	case DB_EXPORT_INCLUDED:
+		attr = gatt_db_get_attribute(service->service->db, rec->aux);
+		if (!attr)
+			return false;
+
+		attr = service_insert_included(service->service, rec->handle,
+									attr);
+		return attr != NULL;
+	case DB_EXPORT_CHARACTERISTIC:
+		if (!le_to_uuid(rec->uuid, rec->uuid_len, &uuid))
+			return false;
+
+		attr = service_insert_characteristic(service->service,
+							rec->handle, rec->aux,
+							&uuid, 0,
+							rec->properties,
+							NULL, NULL, NULL);
+		if (!attr || attr->handle != rec->aux)
+			return false;
+		break;
+	case DB_EXPORT_DESCRIPTOR:
+		if (!le_to_uuid(rec->uuid, rec->uuid_len, &uuid))
+			return false;
+
+		attr = service_insert_descriptor(service->service,
+							rec->handle, &uuid, 0,
+							NULL, NULL, NULL);
+		if (!attr || attr->handle != rec->handle)
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	if (!rec->value_len)
+		return true;
+
+	return gatt_db_attribute_write(attr, 0, rec->value, rec->value_len,
+						0, NULL, NULL, NULL);
+}
+
+bool gatt_db_import(struct gatt_db *db, const void *data, size_t len)
+{
+	const uint8_t *start, *end, *ptr;
+	struct gatt_db_attribute *service = NULL;
+	struct db_export_record rec;
+	bt_uuid_t uuid;
+	uint32_t count, i;
+
+	if (!db || !gatt_db_export_get_hash(data, len))
+		return false;
+
+	start = (const uint8_t *) data + DB_EXPORT_HDR_LEN;
+	end = (const uint8_t *) data + len;
+	count = get_le32((const uint8_t *) data + 24);
+
+	/* Services go first so that included services can be resolved */
+	for (i = 0, ptr = start; i < count; i++) {
+		ptr = db_import_record(ptr, end, &rec);
+		if (!ptr)
+			goto fail;
+
+		if (rec.type != DB_EXPORT_PRIMARY &&
+					rec.type != DB_EXPORT_SECONDARY)
+			continue;
+
+		if (!le_to_uuid(rec.uuid, rec.uuid_len, &uuid))
+			goto fail;
+
+		if (!gatt_db_insert_service(db, rec.handle, &uuid,
+					rec.type == DB_EXPORT_PRIMARY, rec.aux))
+			goto fail;
+	}
+
+	for (i = 0, ptr = start; i < count; i++) {
+		ptr = db_import_record(ptr, end, &rec);
+
+		if (rec.type == DB_EXPORT_PRIMARY ||
+					rec.type == DB_EXPORT_SECONDARY) {
+			if (service)
+				gatt_db_service_set_active(service, true);
+
+			service = gatt_db_get_attribute(db, rec.handle);
+			continue;
+		}
+
+		if (!service || !db_import_attribute(service, &rec))
+			goto fail;
+	}
+
+	if (service)
+		gatt_db_service_set_active(service, true);
+
+	return true;
+
+fail:
+	gatt_db_clear(db);
+	return false;
+}
@@ -32,6 +32,17 @@ bool gatt_db_clear_range(struct gatt_db *db, uint16_t start_handle,
 bool gatt_db_hash_support(struct gatt_db *db);
 uint8_t *gatt_db_get_hash(struct gatt_db *db);
 
+struct gatt_db_stats {
+	unsigned int hash_updates;	/* Database Hash computations */
+	unsigned int hash_segments;	/* Services serialized for the hash */
+};
+
+bool gatt_db_get_stats(struct gatt_db *db, struct gatt_db_stats *stats);
+
+uint8_t *gatt_db_export(struct gatt_db *db, size_t *len);
+const uint8_t *gatt_db_export_get_hash(const void *data, size_t len);
+bool gatt_db_import(struct gatt_db *db, const void *data, size_t len);
+
 struct gatt_db_attribute *gatt_db_insert_service(struct gatt_db *db,
 							uint16_t handle,
 							const bt_uuid_t *uuid,
@@ -1832,6 +1832,73 @@ error:
 	return false;
 }
 
+/*
+ * Encodes a notification once so that it can be sent to several clients
+ * with bt_gatt_server_send_notification_pdu.
+ */
+struct bt_att_pdu *bt_gatt_server_notification_pdu_new(uint16_t handle,
+						const uint8_t *value,
+						uint16_t length)
+{
+	struct bt_att_pdu *pdu;
+	uint8_t *params;
+
+	if (length && !value)
+		return NULL;
+
+	if (length > UINT16_MAX - 3)
+		return NULL;
+
+	pdu = bt_att_pdu_new(BT_ATT_OP_HANDLE_NFY, 2 + length);
+	if (!pdu)
+		return NULL;
+
+	params = bt_att_pdu_get_params(pdu);
+	put_le16(handle, params);
+
+	if (length)
+		memcpy(params + 2, value, length);
+
+	return pdu;
+}
+
+static void notification_pdu_unref(void *user_data)
+{
+	bt_att_pdu_unref(user_data);
+}
+
+/*
+ * The value is truncated to the MTU of the client like with
+ * bt_gatt_server_send_notification, in that case the parameters are gathered
+ * from the shared PDU when written rather than copied.
+ */
+bool bt_gatt_server_send_notification_pdu(struct bt_gatt_server *server,
+						struct bt_att_pdu *pdu)
+{
+	struct iovec iov;
+	uint16_t mtu;
+
+	if (!server || !pdu)
+		return false;
+
+	mtu = bt_att_get_mtu(server->att);
+
+	if (bt_att_pdu_get_length(pdu) < mtu)
+		return !!bt_att_send_pdu(server->att, pdu, NULL, NULL, NULL);
+
+	iov.iov_base = bt_att_pdu_get_params(pdu);
+	iov.iov_len = mtu - 1;
+
+	if (bt_att_sendv(server->att, BT_ATT_OP_HANDLE_NFY, &iov, 1,
+						bt_att_pdu_ref(pdu),
+						notification_pdu_unref))
+		return true;
+
+	bt_att_pdu_unref(pdu);
+
+	return false;
+}
+
 struct ind_data {
 	bt_gatt_server_conf_func_t callback;
 	bt_gatt_server_destroy_func_t destroy;
@@ -43,6 +43,12 @@ bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length, bool multiple);
 
+struct bt_att_pdu *bt_gatt_server_notification_pdu_new(uint16_t handle,
+						const uint8_t *value,
+						uint16_t length);
+bool bt_gatt_server_send_notification_pdu(struct bt_gatt_server *server,
+						struct bt_att_pdu *pdu);
+
 bool bt_gatt_server_send_indication(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length,
@@ -12,6 +12,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <errno.h>
 #include <sys/socket.h>
@@ -181,6 +182,12 @@ bool io_set_ignore_errqueue(struct io *io, bool do_ignore)
 	return false;
 }
 
+bool io_set_stats(struct io *io, const char *name)
+{
+	/* TODO: unimplemented */
+	return false;
+}
+
 bool io_set_read_handler(struct io *io, io_callback_func_t callback,
 				void *user_data, io_destroy_func_t destroy)
 {
@@ -296,6 +303,89 @@ ssize_t io_send(struct io *io, const struct iovec *iov, int iovcnt)
 	return ret;
 }
 
+/*
+ * Sends the messages without blocking and returns how many were sent. File
+ * descriptors that aren't sockets get the messages written one at a time.
+ */
+int io_sendmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	unsigned int i;
+	ssize_t len;
+	int ret;
+
+	if (!io || !io->l_io)
+		return -ENOTCONN;
+
+	fd = l_io_get_fd(io->l_io);
+	if (fd < 0)
+		return -ENOTCONN;
+
+	do {
+		ret = sendmmsg(fd, msgs, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK)
+		return -errno;
+
+	for (i = 0; i < vlen; i++) {
+		do {
+			len = writev(fd, msgs[i].msg_hdr.msg_iov,
+						msgs[i].msg_hdr.msg_iovlen);
+		} while (len < 0 && errno == EINTR);
+
+		if (len < 0)
+			return i ? (int) i : -errno;
+
+		msgs[i].msg_len = len;
+	}
+
+	return vlen;
+}
+
+/*
+ * Receives the messages queued up to vlen without blocking. File descriptors
+ * that aren't sockets are read once into the first message.
+ */
+int io_recvmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	ssize_t len;
+	int ret;
+
+	if (!io || !io->l_io)
+		return -ENOTCONN;
+
+	fd = l_io_get_fd(io->l_io);
+	if (fd < 0)
+		return -ENOTCONN;
+
+	do {
+		ret = recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, NULL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK || !vlen)
+		return -errno;
+
+	do {
+		len = readv(fd, msgs[0].msg_hdr.msg_iov,
+						msgs[0].msg_hdr.msg_iovlen);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -errno;
+
+	msgs[0].msg_len = len;
+
+	return 1;
+}
+
 bool io_shutdown(struct io *io)
 {
 	int fd;
@@ -12,12 +12,14 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <errno.h>
 #include <sys/socket.h>
 
 #include <glib.h>
 
 #include "src/shared/io.h"
+#include "src/shared/stats.h"
 
 #define	IO_ERR_WATCH_RATELIMIT		(500 * G_TIME_SPAN_MILLISECOND)
 
@@ -33,6 +35,7 @@ struct io {
 	int ref_count;
 	GIOChannel *channel;
 	bool err_watch;
+	struct stats_hist *stats;
 	struct io_watch *read_watch;
 	struct io_watch *write_watch;
 	struct io_watch *disconnect_watch;
@@ -158,10 +161,22 @@ bool io_set_close_on_destroy(struct io *io, bool do_close)
 	return true;
 }
 
+bool io_set_stats(struct io *io, const char *name)
+{
+	if (!io)
+		return false;
+
+	io->stats = stats_source(name);
+
+	return true;
+}
+
 static gboolean watch_callback(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
 	struct io_watch *watch = user_data;
+	struct stats_hist *stats = watch->io->stats;
+	uint64_t start;
 	bool result, destroy;
 
 	destroy = watch == watch->io->disconnect_watch;
@@ -169,11 +184,16 @@ static gboolean watch_callback(GIOChannel *channel, GIOCondition cond,
 	if (!destroy && (cond & (G_IO_ERR | G_IO_NVAL)))
 		return FALSE;
 
+	start = stats ? stats_start() : 0;
+
 	if (watch->callback)
 		result = watch->callback(watch->io, watch->user_data);
 	else
 		result = false;
 
+	if (stats)
+		stats_hist_end(stats, start);
+
 	return result ? TRUE : FALSE;
 }
 
@@ -302,6 +322,85 @@ ssize_t io_send(struct io *io, const struct iovec *iov, int iovcnt)
 	return ret;
 }
 
+/*
+ * Sends the messages without blocking and returns how many were sent. File
+ * descriptors that aren't sockets get the messages written one at a time.
+ */
+int io_sendmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	unsigned int i;
+	ssize_t len;
+	int ret;
+
+	if (!io || !io->channel)
+		return -ENOTCONN;
+
+	fd = io_get_fd(io);
+
+	do {
+		ret = sendmmsg(fd, msgs, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK)
+		return -errno;
+
+	for (i = 0; i < vlen; i++) {
+		do {
+			len = writev(fd, msgs[i].msg_hdr.msg_iov,
+						msgs[i].msg_hdr.msg_iovlen);
+		} while (len < 0 && errno == EINTR);
+
+		if (len < 0)
+			return i ? (int) i : -errno;
+
+		msgs[i].msg_len = len;
+	}
+
+	return vlen;
+}
+
+/*
+ * Receives the messages queued up to vlen without blocking. File descriptors
+ * that aren't sockets are read once into the first message.
+ */
+int io_recvmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	ssize_t len;
+	int ret;
+
+	if (!io || !io->channel)
+		return -ENOTCONN;
+
+	fd = io_get_fd(io);
+
+	do {
+		ret = recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, NULL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK || !vlen)
+		return -errno;
+
+	do {
+		len = readv(fd, msgs[0].msg_hdr.msg_iov,
+						msgs[0].msg_hdr.msg_iovlen);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -errno;
+
+	msgs[0].msg_len = len;
+
+	return 1;
+}
+
 bool io_shutdown(struct io *io)
 {
 	if (!io || !io->channel)
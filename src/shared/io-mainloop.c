@@ -12,6 +12,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <errno.h>
 #include <sys/socket.h>
@@ -19,12 +20,14 @@
 #include "src/shared/mainloop.h"
 #include "src/shared/util.h"
 #include "src/shared/io.h"
+#include "src/shared/stats.h"
 
 struct io {
 	int ref_count;
 	int fd;
 	uint32_t events;
 	bool close_on_destroy;
+	struct stats_hist *stats;
 	io_callback_func_t read_callback;
 	io_destroy_func_t read_destroy;
 	void *read_data;
@@ -79,6 +82,7 @@ static void io_cleanup(void *user_data)
 static void io_callback(int fd, uint32_t events, void *user_data)
 {
 	struct io *io = user_data;
+	uint64_t start = io->stats ? stats_start() : 0;
 
 	io_ref(io);
 
@@ -136,6 +140,9 @@ static void io_callback(int fd, uint32_t events, void *user_data)
 		}
 	}
 
+	if (io->stats)
+		stats_hist_end(io->stats, start);
+
 	io_unref(io);
 }
 
@@ -198,6 +205,16 @@ bool io_set_ignore_errqueue(struct io *io, bool do_ignore)
 	return false;
 }
 
+bool io_set_stats(struct io *io, const char *name)
+{
+	if (!io)
+		return false;
+
+	io->stats = stats_source(name);
+
+	return true;
+}
+
 bool io_set_read_handler(struct io *io, io_callback_func_t callback,
 				void *user_data, io_destroy_func_t destroy)
 {
@@ -308,6 +325,85 @@ ssize_t io_send(struct io *io, const struct iovec *iov, int iovcnt)
 	return ret;
 }
 
+/*
+ * Sends the messages without blocking and returns how many were sent. File
+ * descriptors that aren't sockets get the messages written one at a time.
+ */
+int io_sendmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	unsigned int i;
+	ssize_t len;
+	int ret;
+
+	if (!io || io->fd < 0)
+		return -ENOTCONN;
+
+	fd = io->fd;
+
+	do {
+		ret = sendmmsg(fd, msgs, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK)
+		return -errno;
+
+	for (i = 0; i < vlen; i++) {
+		do {
+			len = writev(fd, msgs[i].msg_hdr.msg_iov,
+						msgs[i].msg_hdr.msg_iovlen);
+		} while (len < 0 && errno == EINTR);
+
+		if (len < 0)
+			return i ? (int) i : -errno;
+
+		msgs[i].msg_len = len;
+	}
+
+	return vlen;
+}
+
+/*
+ * Receives the messages queued up to vlen without blocking. File descriptors
+ * that aren't sockets are read once into the first message.
+ */
+int io_recvmmsg(struct io *io, struct mmsghdr *msgs, unsigned int vlen)
+{
+	int fd;
+	ssize_t len;
+	int ret;
+
+	if (!io || io->fd < 0)
+		return -ENOTCONN;
+
+	fd = io->fd;
+
+	do {
+		ret = recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, NULL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret >= 0)
+		return ret;
+
+	if (errno != ENOTSOCK || !vlen)
+		return -errno;
+
+	do {
+		len = readv(fd, msgs[0].msg_hdr.msg_iov,
+						msgs[0].msg_hdr.msg_iovlen);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -errno;
+
+	msgs[0].msg_len = len;
+
+	return 1;
+}
+
 bool io_shutdown(struct io *io)
 {
 	if (!io || io->fd < 0)
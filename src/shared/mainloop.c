@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <string.h>
 #include <signal.h>
 #include <sys/signalfd.h>
@@ -30,12 +31,23 @@
 #include "mainloop.h"
 #include "mainloop-notify.h"
 
-#define MAX_EPOLL_EVENTS 10
+/*
+ * The number of events fetched per epoll_wait() call grows while the
+ * buffer keeps getting filled completely and shrinks again once the
+ * load goes down.
+ */
+#define MIN_EPOLL_EVENTS 16
+#define MAX_EPOLL_EVENTS 1024
 
 static int epoll_fd;
 static int epoll_terminate;
 static int exit_status = EXIT_SUCCESS;
 
+static struct epoll_event *epoll_events;
+static unsigned int epoll_events_size;
+static int epoll_events_count;
+static int epoll_events_index;
+
 struct mainloop_data {
 	int fd;
 	uint32_t events;
@@ -44,9 +56,10 @@ struct mainloop_data {
 	void *user_data;
 };
 
-#define MAX_MAINLOOP_ENTRIES 128
+#define MIN_MAINLOOP_ENTRIES 128
 
-static struct mainloop_data *mainloop_list[MAX_MAINLOOP_ENTRIES];
+static struct mainloop_data **mainloop_list;
+static unsigned int mainloop_list_size;
 
 struct timeout_data {
 	int fd;
@@ -57,12 +70,17 @@ struct timeout_data {
 
 void mainloop_init(void)
 {
-	unsigned int i;
-
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++)
-		mainloop_list[i] = NULL;
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_list_size = 0;
+
+	free(epoll_events);
+	epoll_events = NULL;
+	epoll_events_size = 0;
+	epoll_events_count = 0;
+	epoll_events_index = 0;
 
 	epoll_terminate = 0;
 }
@@ -86,27 +104,68 @@ void mainloop_exit_failure(void)
 	epoll_terminate = 1;
 }
 
+static bool resize_events(unsigned int size)
+{
+	struct epoll_event *events;
+
+	if (size == epoll_events_size)
+		return true;
+
+	events = realloc(epoll_events, size * sizeof(*events));
+	if (!events)
+		return false;
+
+	epoll_events = events;
+	epoll_events_size = size;
+
+	return true;
+}
+
+static void adjust_events(int nfds)
+{
+	unsigned int size = epoll_events_size;
+
+	if ((unsigned int) nfds == size && size < MAX_EPOLL_EVENTS)
+		resize_events(size * 2);
+	else if ((unsigned int) nfds < size / 4 && size > MIN_EPOLL_EVENTS)
+		resize_events(size / 2);
+}
+
 int mainloop_run(void)
 {
 	unsigned int i;
 
+	if (!resize_events(MIN_EPOLL_EVENTS))
+		return EXIT_FAILURE;
+
 	while (!epoll_terminate) {
-		struct epoll_event events[MAX_EPOLL_EVENTS];
-		int n, nfds;
+		int nfds;
 
-		nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+		nfds = epoll_wait(epoll_fd, epoll_events, epoll_events_size, -1);
 		if (nfds < 0)
 			continue;
 
-		for (n = 0; n < nfds; n++) {
-			struct mainloop_data *data = events[n].data.ptr;
+		epoll_events_count = nfds;
+
+		for (epoll_events_index = 0; epoll_events_index < nfds;
+							epoll_events_index++) {
+			struct epoll_event *ev = &epoll_events[epoll_events_index];
+			struct mainloop_data *data = ev->data.ptr;
 
-			data->callback(data->fd, events[n].events,
-							data->user_data);
+			/* Handler got removed while dispatching this batch */
+			if (!data)
+				continue;
+
+			data->callback(data->fd, ev->events, data->user_data);
 		}
+
+		epoll_events_count = 0;
+		epoll_events_index = 0;
+
+		adjust_events(nfds);
 	}
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++) {
+	for (i = 0; i < mainloop_list_size; i++) {
 		struct mainloop_data *data = mainloop_list[i];
 
 		mainloop_list[i] = NULL;
@@ -121,6 +180,14 @@ int mainloop_run(void)
 		}
 	}
 
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_list_size = 0;
+
+	free(epoll_events);
+	epoll_events = NULL;
+	epoll_events_size = 0;
+
 	close(epoll_fd);
 	epoll_fd = 0;
 
@@ -129,6 +196,38 @@ int mainloop_run(void)
 	return exit_status;
 }
 
+static bool resize_list(int fd)
+{
+	struct mainloop_data **list;
+	unsigned int size = mainloop_list_size ? : MIN_MAINLOOP_ENTRIES;
+
+	if ((unsigned int) fd < mainloop_list_size)
+		return true;
+
+	while (size <= (unsigned int) fd)
+		size *= 2;
+
+	list = realloc(mainloop_list, size * sizeof(*list));
+	if (!list)
+		return false;
+
+	memset(list + mainloop_list_size, 0,
+			(size - mainloop_list_size) * sizeof(*list));
+
+	mainloop_list = list;
+	mainloop_list_size = size;
+
+	return true;
+}
+
+static struct mainloop_data *lookup_data(int fd)
+{
+	if (fd < 0 || (unsigned int) fd >= mainloop_list_size)
+		return NULL;
+
+	return mainloop_list[fd];
+}
+
 int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 				void *user_data, mainloop_destroy_func destroy)
 {
@@ -136,9 +235,12 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1 || !callback)
+	if (fd < 0 || !callback)
 		return -EINVAL;
 
+	if (!resize_list(fd))
+		return -ENOMEM;
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return -ENOMEM;
@@ -171,10 +273,10 @@ int mainloop_modify_fd(int fd, uint32_t events)
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = lookup_data(fd);
 	if (!data)
 		return -ENXIO;
 
@@ -194,17 +296,23 @@ int mainloop_modify_fd(int fd, uint32_t events)
 int mainloop_remove_fd(int fd)
 {
 	struct mainloop_data *data;
-	int err;
+	int i, err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = lookup_data(fd);
 	if (!data)
 		return -ENXIO;
 
 	mainloop_list[fd] = NULL;
 
+	/* Drop events of the current batch that are still to be handled */
+	for (i = epoll_events_index; i < epoll_events_count; i++) {
+		if (epoll_events[i].data.ptr == data)
+			epoll_events[i].data.ptr = NULL;
+	}
+
 	err = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, data->fd, NULL);
 
 	if (data->destroy)
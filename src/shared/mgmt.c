@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "bluetooth/bluetooth.h"
 #include "bluetooth/mgmt.h"
@@ -30,16 +31,27 @@
 #define DBG(_mgmt, _format, arg...) \
 	mgmt_log(_mgmt, "%s:%s() " _format, __FILE__, __func__, ## arg)
 
+/*
+ * Event codes are small so this gives one bucket per event in practice.
+ * Each bucket keeps a list of handlers per controller index, so events are
+ * only matched against the handlers of their own index and the ones
+ * registered for any index.
+ */
+#define NOTIFY_BUCKETS 64
+
 struct mgmt {
 	int ref_count;
 	int fd;
 	bool close_on_unref;
 	struct io *io;
 	bool writer_active;
-	struct queue *request_queue;
+	struct queue *index_list;
 	struct queue *reply_queue;
 	struct queue *pending_list;
 	struct queue *notify_list;
+	struct queue *notify_buckets[NOTIFY_BUCKETS];
+	unsigned int window;
+	struct queue *stats_list;
 	unsigned int next_request_id;
 	unsigned int next_notify_id;
 	bool need_notify_cleanup;
@@ -64,6 +76,13 @@ struct mgmt_request {
 	void *user_data;
 	int timeout;
 	unsigned int timeout_id;
+	uint64_t start;
+};
+
+/* Requests waiting to be sent to a controller index */
+struct mgmt_index {
+	uint16_t index;
+	struct queue *request_queue;
 };
 
 struct mgmt_notify {
@@ -76,6 +95,12 @@ struct mgmt_notify {
 	void *user_data;
 };
 
+/* Handlers of a bucket registered for the same index */
+struct mgmt_notify_index {
+	uint16_t index;
+	struct queue *notify_list;
+};
+
 struct mgmt_tlv_list {
 	struct queue *tlv_queue;
 	uint16_t size;
@@ -125,6 +150,78 @@ static bool match_request_index(const void *a, const void *b)
 	return request->index == index;
 }
 
+static void destroy_index(void *data)
+{
+	struct mgmt_index *idx = data;
+
+	queue_destroy(idx->request_queue, destroy_request);
+	free(idx);
+}
+
+static bool match_index(const void *a, const void *b)
+{
+	const struct mgmt_index *idx = a;
+	uint16_t index = PTR_TO_UINT(b);
+
+	return idx->index == index;
+}
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool match_stats_opcode(const void *a, const void *b)
+{
+	const struct mgmt_stats *stats = a;
+	uint16_t opcode = PTR_TO_UINT(b);
+
+	return stats->opcode == opcode;
+}
+
+static uint32_t update_stats(struct mgmt *mgmt, struct mgmt_request *request,
+							bool timeout)
+{
+	struct mgmt_stats *stats;
+	uint64_t latency;
+
+	if (!request->start)
+		return 0;
+
+	stats = queue_find(mgmt->stats_list, match_stats_opcode,
+					UINT_TO_PTR(request->opcode));
+	if (!stats) {
+		stats = new0(struct mgmt_stats, 1);
+		stats->opcode = request->opcode;
+		stats->min_latency = UINT32_MAX;
+		queue_push_tail(mgmt->stats_list, stats);
+	}
+
+	latency = get_usec() - request->start;
+	if (latency > UINT32_MAX)
+		latency = UINT32_MAX;
+
+	stats->count++;
+	stats->total_latency += latency;
+
+	if (latency < stats->min_latency)
+		stats->min_latency = latency;
+
+	if (latency > stats->max_latency)
+		stats->max_latency = latency;
+
+	if (timeout)
+		stats->timeouts++;
+
+	stats_hist_add(&stats->hist, latency);
+
+	return latency;
+}
+
 static void destroy_notify(void *data)
 {
 	struct mgmt_notify *notify = data;
@@ -158,6 +255,66 @@ static bool match_notify_removed(const void *a, const void *b)
 	return notify->removed;
 }
 
+static void destroy_notify_index(void *data)
+{
+	struct mgmt_notify_index *list = data;
+
+	queue_destroy(list->notify_list, NULL);
+	free(list);
+}
+
+static bool match_notify_index_list(const void *a, const void *b)
+{
+	const struct mgmt_notify_index *list = a;
+	uint16_t index = PTR_TO_UINT(b);
+
+	return list->index == index;
+}
+
+static bool match_notify_index_empty(const void *a, const void *b)
+{
+	const struct mgmt_notify_index *list = a;
+
+	return queue_isempty(list->notify_list);
+}
+
+static struct queue *notify_bucket(struct mgmt *mgmt, uint16_t event)
+{
+	return mgmt->notify_buckets[event % NOTIFY_BUCKETS];
+}
+
+static struct mgmt_notify_index *notify_index(struct mgmt *mgmt,
+						uint16_t event, uint16_t index)
+{
+	return queue_find(notify_bucket(mgmt, event), match_notify_index_list,
+							UINT_TO_PTR(index));
+}
+
+static void remove_notify_all(struct mgmt *mgmt, queue_match_func_t function,
+							void *user_data)
+{
+	const struct queue_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < NOTIFY_BUCKETS; i++) {
+		struct queue *bucket = mgmt->notify_buckets[i];
+
+		for (entry = queue_get_entries(bucket); entry;
+							entry = entry->next) {
+			struct mgmt_notify_index *list = entry->data;
+
+			queue_remove_all(list->notify_list, function,
+							user_data, NULL);
+		}
+
+		queue_remove_all(bucket, match_notify_index_empty, NULL,
+							destroy_notify_index);
+	}
+
+	queue_remove_all(mgmt->notify_list, function, user_data,
+							destroy_notify);
+}
+
 static void mark_notify_removed(void *data , void *user_data)
 {
 	struct mgmt_notify *notify = data;
@@ -174,6 +331,8 @@ static void write_watch_destroy(void *user_data)
 	mgmt->writer_active = false;
 }
 
+static void wakeup_writer(struct mgmt *mgmt);
+
 static bool request_timeout(void *data)
 {
 	struct mgmt_request *request = data;
@@ -185,6 +344,9 @@ static bool request_timeout(void *data)
 
 	queue_remove_if(request->mgmt->pending_list, NULL, request);
 
+	update_stats(request->mgmt, request, true);
+	wakeup_writer(request->mgmt);
+
 	if (request->callback)
 		request->callback(MGMT_STATUS_TIMEOUT, 0, NULL,
 						request->user_data);
@@ -233,11 +395,109 @@ static bool send_request(struct mgmt *mgmt, struct mgmt_request *request)
 
 	DBG(mgmt, "[0x%04x] command 0x%04x", request->index, request->opcode);
 
+	request->start = get_usec();
+
 	queue_push_tail(mgmt->pending_list, request);
 
 	return true;
 }
 
+struct index_busy {
+	uint16_t opcode;
+	uint16_t index;
+	unsigned int pending;
+	bool conflict;
+};
+
+static void check_pending(void *data, void *user_data)
+{
+	struct mgmt_request *request = data;
+	struct index_busy *busy = user_data;
+
+	if (request->index != busy->index)
+		return;
+
+	busy->pending++;
+
+	/* Completions are matched by opcode and index only */
+	if (request->opcode == busy->opcode)
+		busy->conflict = true;
+}
+
+static bool index_can_send(struct mgmt *mgmt, struct mgmt_index *idx)
+{
+	struct mgmt_request *request;
+	struct index_busy busy;
+
+	request = queue_peek_head(idx->request_queue);
+	if (!request)
+		return false;
+
+	memset(&busy, 0, sizeof(busy));
+	busy.opcode = request->opcode;
+	busy.index = request->index;
+
+	queue_foreach(mgmt->pending_list, check_pending, &busy);
+
+	return !busy.conflict && busy.pending < mgmt->window;
+}
+
+static struct mgmt_request *next_request(struct mgmt *mgmt)
+{
+	const struct queue_entry *entry;
+	struct mgmt_index *next = NULL;
+
+	/*
+	 * Without a window only a single command can be outstanding, so
+	 * pick the oldest request of all indexes to keep the order in
+	 * which they have been queued.
+	 */
+	if (!mgmt->window) {
+		struct mgmt_request *oldest = NULL;
+
+		if (!queue_isempty(mgmt->pending_list))
+			return NULL;
+
+		for (entry = queue_get_entries(mgmt->index_list); entry;
+							entry = entry->next) {
+			struct mgmt_index *idx = entry->data;
+			struct mgmt_request *request;
+
+			request = queue_peek_head(idx->request_queue);
+			if (!request)
+				continue;
+
+			if (!oldest || (int) (request->id - oldest->id) < 0) {
+				oldest = request;
+				next = idx;
+			}
+		}
+
+		return next ? queue_pop_head(next->request_queue) : NULL;
+	}
+
+	/*
+	 * Each index can have up to window commands outstanding. Indexes
+	 * are served round-robin by moving the one that has been served
+	 * to the end of the list.
+	 */
+	for (entry = queue_get_entries(mgmt->index_list); entry;
+							entry = entry->next) {
+		if (index_can_send(mgmt, entry->data)) {
+			next = entry->data;
+			break;
+		}
+	}
+
+	if (!next)
+		return NULL;
+
+	queue_remove(mgmt->index_list, next);
+	queue_push_tail(mgmt->index_list, next);
+
+	return queue_pop_head(next->request_queue);
+}
+
 static bool can_write_data(struct io *io, void *user_data)
 {
 	struct mgmt *mgmt = user_data;
@@ -247,14 +507,12 @@ static bool can_write_data(struct io *io, void *user_data)
 	request = queue_pop_head(mgmt->reply_queue);
 	if (!request) {
 		/* only reply commands can jump the queue */
-		if (!queue_isempty(mgmt->pending_list))
-			return false;
-
-		request = queue_pop_head(mgmt->request_queue);
+		request = next_request(mgmt);
 		if (!request)
 			return false;
 
-		can_write = false;
+		/* other indexes might still have room in their window */
+		can_write = mgmt->window > 0;
 	} else {
 		/* allow multiple replies to jump the queue */
 		can_write = !queue_isempty(mgmt->reply_queue);
@@ -268,7 +526,7 @@ static bool can_write_data(struct io *io, void *user_data)
 
 static void wakeup_writer(struct mgmt *mgmt)
 {
-	if (!queue_isempty(mgmt->pending_list)) {
+	if (!mgmt->window && !queue_isempty(mgmt->pending_list)) {
 		/* only queued reply commands trigger wakeup */
 		if (queue_isempty(mgmt->reply_queue))
 			return;
@@ -316,6 +574,11 @@ static void request_complete(struct mgmt *mgmt, uint8_t status,
 	}
 
 	if (request) {
+		uint32_t latency = update_stats(mgmt, request, false);
+
+		DBG(mgmt, "[0x%04x] command 0x%04x latency %u usec", index,
+							opcode, latency);
+
 		if (request->callback)
 			request->callback(status, length, param,
 							request->user_data);
@@ -352,21 +615,58 @@ static void notify_handler(void *data, void *user_data)
 							notify->user_data);
 }
 
+static unsigned int entry_notify_id(const struct queue_entry *entry)
+{
+	const struct mgmt_notify *notify = entry->data;
+
+	return notify->id;
+}
+
 static void process_notify(struct mgmt *mgmt, uint16_t event, uint16_t index,
 					uint16_t length, const void *param)
 {
 	struct event_index match = { .event = event, .index = index,
 					.length = length, .param = param };
+	struct mgmt_notify_index *any, *own = NULL;
+	const struct queue_entry *a = NULL, *b = NULL;
+
+	any = notify_index(mgmt, event, MGMT_INDEX_NONE);
+	if (index != MGMT_INDEX_NONE)
+		own = notify_index(mgmt, event, index);
+
+	if (any)
+		a = queue_get_entries(any->notify_list);
+
+	if (own)
+		b = queue_get_entries(own->notify_list);
+
+	if (!a && !b)
+		return;
 
 	mgmt->in_notify = true;
 
-	queue_foreach(mgmt->notify_list, notify_handler, &match);
+	/*
+	 * Run the handlers of both lists in registration order. Entries are
+	 * only removed once dispatch completes.
+	 */
+	while (a || b) {
+		const struct queue_entry *entry;
+
+		if (!b || (a && entry_notify_id(a) < entry_notify_id(b))) {
+			entry = a;
+			a = a->next;
+		} else {
+			entry = b;
+			b = b->next;
+		}
+
+		notify_handler(entry->data, &match);
+	}
 
 	mgmt->in_notify = false;
 
 	if (mgmt->need_notify_cleanup) {
-		queue_remove_all(mgmt->notify_list, match_notify_removed,
-							NULL, destroy_notify);
+		remove_notify_all(mgmt, match_notify_removed, NULL);
 		mgmt->need_notify_cleanup = false;
 	}
 }
@@ -481,16 +781,20 @@ struct mgmt *mgmt_new(int fd)
 		return NULL;
 	}
 
-	mgmt->request_queue = queue_new();
+	io_set_stats(mgmt->io, "mgmt");
+
+	mgmt->index_list = queue_new();
 	mgmt->reply_queue = queue_new();
 	mgmt->pending_list = queue_new();
 	mgmt->notify_list = queue_new();
+	mgmt->stats_list = queue_new();
 
 	if (!io_set_read_handler(mgmt->io, can_read_data, mgmt, NULL)) {
+		queue_destroy(mgmt->stats_list, NULL);
 		queue_destroy(mgmt->notify_list, NULL);
 		queue_destroy(mgmt->pending_list, NULL);
 		queue_destroy(mgmt->reply_queue, NULL);
-		queue_destroy(mgmt->request_queue, NULL);
+		queue_destroy(mgmt->index_list, NULL);
 		io_destroy(mgmt->io);
 		free(mgmt->buf);
 		free(mgmt);
@@ -561,7 +865,8 @@ void mgmt_unref(struct mgmt *mgmt)
 	mgmt_cancel_all(mgmt);
 
 	queue_destroy(mgmt->reply_queue, NULL);
-	queue_destroy(mgmt->request_queue, NULL);
+	queue_destroy(mgmt->index_list, destroy_index);
+	queue_destroy(mgmt->stats_list, free);
 
 	io_set_write_handler(mgmt->io, NULL, NULL, NULL);
 	io_set_read_handler(mgmt->io, NULL, NULL, NULL);
@@ -579,6 +884,12 @@ void mgmt_unref(struct mgmt *mgmt)
 	mgmt->buf = NULL;
 
 	if (!mgmt->in_notify) {
+		unsigned int i;
+
+		for (i = 0; i < NOTIFY_BUCKETS; i++)
+			queue_destroy(mgmt->notify_buckets[i],
+							destroy_notify_index);
+
 		queue_destroy(mgmt->notify_list, NULL);
 		queue_destroy(mgmt->pending_list, NULL);
 		free(mgmt);
@@ -612,6 +923,47 @@ bool mgmt_set_close_on_unref(struct mgmt *mgmt, bool do_close)
 	return true;
 }
 
+bool mgmt_set_window(struct mgmt *mgmt, unsigned int window)
+{
+	if (!mgmt)
+		return false;
+
+	mgmt->window = window;
+
+	wakeup_writer(mgmt);
+
+	return true;
+}
+
+struct stats_data {
+	mgmt_stats_func_t func;
+	void *user_data;
+};
+
+static void stats_foreach(void *data, void *user_data)
+{
+	struct mgmt_stats *stats = data;
+	struct stats_data *foreach = user_data;
+
+	foreach->func(stats, foreach->user_data);
+}
+
+bool mgmt_foreach_stats(struct mgmt *mgmt, mgmt_stats_func_t func,
+							void *user_data)
+{
+	struct stats_data data;
+
+	if (!mgmt || !func)
+		return false;
+
+	data.func = func;
+	data.user_data = user_data;
+
+	queue_foreach(mgmt->stats_list, stats_foreach, &data);
+
+	return true;
+}
+
 static struct mgmt_request *create_request(struct mgmt *mgmt, uint16_t opcode,
 				uint16_t index, uint16_t length,
 				const void *param, mgmt_request_func_t callback,
@@ -796,6 +1148,22 @@ unsigned int mgmt_send_tlv(struct mgmt *mgmt, uint16_t opcode, uint16_t index,
 	return ret;
 }
 
+static bool queue_push_index(struct mgmt *mgmt, struct mgmt_request *request)
+{
+	struct mgmt_index *idx;
+
+	idx = queue_find(mgmt->index_list, match_index,
+					UINT_TO_PTR(request->index));
+	if (!idx) {
+		idx = new0(struct mgmt_index, 1);
+		idx->index = request->index;
+		idx->request_queue = queue_new();
+		queue_push_tail(mgmt->index_list, idx);
+	}
+
+	return queue_push_tail(idx->request_queue, request);
+}
+
 unsigned int mgmt_send_timeout(struct mgmt *mgmt, uint16_t opcode,
 				uint16_t index, uint16_t length,
 				const void *param, mgmt_request_func_t callback,
@@ -817,7 +1185,7 @@ unsigned int mgmt_send_timeout(struct mgmt *mgmt, uint16_t opcode,
 
 	request->id = mgmt->next_request_id++;
 
-	if (!queue_push_tail(mgmt->request_queue, request)) {
+	if (!queue_push_index(mgmt, request)) {
 		free(request->buf);
 		free(request);
 		return 0;
@@ -907,15 +1275,21 @@ unsigned int mgmt_reply(struct mgmt *mgmt, uint16_t opcode, uint16_t index,
 
 bool mgmt_cancel(struct mgmt *mgmt, unsigned int id)
 {
+	const struct queue_entry *entry;
 	struct mgmt_request *request;
 
 	if (!mgmt || !id)
 		return false;
 
-	request = queue_remove_if(mgmt->request_queue, match_request_id,
+	for (entry = queue_get_entries(mgmt->index_list); entry;
+							entry = entry->next) {
+		struct mgmt_index *idx = entry->data;
+
+		request = queue_remove_if(idx->request_queue, match_request_id,
 							UINT_TO_PTR(id));
-	if (request)
-		goto done;
+		if (request)
+			goto done;
+	}
 
 	request = queue_remove_if(mgmt->reply_queue, match_request_id,
 							UINT_TO_PTR(id));
@@ -937,11 +1311,15 @@ done:
 
 bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 {
+	struct mgmt_index *idx;
+
 	if (!mgmt)
 		return false;
 
-	queue_remove_all(mgmt->request_queue, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
+	idx = queue_remove_if(mgmt->index_list, match_index,
+						UINT_TO_PTR(index));
+	if (idx)
+		destroy_index(idx);
 	queue_remove_all(mgmt->reply_queue, match_request_index,
 					UINT_TO_PTR(index), destroy_request);
 	queue_remove_all(mgmt->pending_list, match_request_index,
@@ -957,7 +1335,7 @@ bool mgmt_cancel_all(struct mgmt *mgmt)
 
 	queue_remove_all(mgmt->pending_list, NULL, NULL, destroy_request);
 	queue_remove_all(mgmt->reply_queue, NULL, NULL, destroy_request);
-	queue_remove_all(mgmt->request_queue, NULL, NULL, destroy_request);
+	queue_remove_all(mgmt->index_list, NULL, NULL, destroy_index);
 
 	return true;
 }
@@ -967,6 +1345,7 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 				void *user_data, mgmt_destroy_func_t destroy)
 {
 	struct mgmt_notify *notify;
+	struct mgmt_notify_index *list;
 
 	if (!mgmt || !event)
 		return 0;
@@ -989,6 +1368,19 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 		return 0;
 	}
 
+	if (!notify_bucket(mgmt, event))
+		mgmt->notify_buckets[event % NOTIFY_BUCKETS] = queue_new();
+
+	list = notify_index(mgmt, event, index);
+	if (!list) {
+		list = new0(struct mgmt_notify_index, 1);
+		list->index = index;
+		list->notify_list = queue_new();
+		queue_push_tail(notify_bucket(mgmt, event), list);
+	}
+
+	queue_push_tail(list->notify_list, notify);
+
 	return notify->id;
 }
 
@@ -999,12 +1391,24 @@ bool mgmt_unregister(struct mgmt *mgmt, unsigned int id)
 	if (!mgmt || !id)
 		return false;
 
-	notify = queue_remove_if(mgmt->notify_list, match_notify_id,
+	notify = queue_find(mgmt->notify_list, match_notify_id,
 							UINT_TO_PTR(id));
-	if (!notify)
+	if (!notify || notify->removed)
 		return false;
 
+	/* Buckets may be in use, removal is done once dispatch completes */
 	if (!mgmt->in_notify) {
+		struct mgmt_notify_index *list;
+
+		list = notify_index(mgmt, notify->event, notify->index);
+		queue_remove(list->notify_list, notify);
+
+		if (queue_isempty(list->notify_list)) {
+			queue_remove(notify_bucket(mgmt, notify->event), list);
+			destroy_notify_index(list);
+		}
+
+		queue_remove(mgmt->notify_list, notify);
 		destroy_notify(notify);
 		return true;
 	}
@@ -1025,8 +1429,8 @@ bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index)
 							UINT_TO_PTR(index));
 		mgmt->need_notify_cleanup = true;
 	} else
-		queue_remove_all(mgmt->notify_list, match_notify_index,
-					UINT_TO_PTR(index), destroy_notify);
+		remove_notify_all(mgmt, match_notify_index,
+						UINT_TO_PTR(index));
 
 	return true;
 }
@@ -1041,7 +1445,7 @@ bool mgmt_unregister_all(struct mgmt *mgmt)
 						UINT_TO_PTR(MGMT_INDEX_NONE));
 		mgmt->need_notify_cleanup = true;
 	} else
-		queue_remove_all(mgmt->notify_list, NULL, NULL, destroy_notify);
+		remove_notify_all(mgmt, NULL, NULL);
 
 	return true;
 }
@@ -13,6 +13,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "src/shared/stats.h"
+
 #define MGMT_VERSION(v, r) (((v) << 16) + (r))
 
 typedef void (*mgmt_destroy_func_t)(void *user_data);
@@ -32,6 +34,23 @@ bool mgmt_set_debug(struct mgmt *mgmt, mgmt_debug_func_t callback,
 				void *user_data, mgmt_destroy_func_t destroy);
 
 bool mgmt_set_close_on_unref(struct mgmt *mgmt, bool do_close);
+bool mgmt_set_window(struct mgmt *mgmt, unsigned int window);
+
+struct mgmt_stats {
+	uint16_t opcode;
+	unsigned int count;
+	unsigned int timeouts;
+	uint64_t total_latency;		/* usec */
+	uint32_t min_latency;		/* usec */
+	uint32_t max_latency;		/* usec */
+	struct stats_hist hist;
+};
+
+typedef void (*mgmt_stats_func_t)(const struct mgmt_stats *stats,
+							void *user_data);
+
+bool mgmt_foreach_stats(struct mgmt *mgmt, mgmt_stats_func_t func,
+							void *user_data);
 
 typedef void (*mgmt_request_func_t)(uint8_t status, uint16_t length,
 					const void *param, void *user_data);
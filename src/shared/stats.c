@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include "src/shared/stats.h"
+
+#define STATS_MAX_SOURCES	16
+
+struct stats_source {
+	const char *name;
+	struct stats_hist hist;
+};
+
+static bool enabled;
+static struct stats_source sources[STATS_MAX_SOURCES];
+
+void stats_set_enabled(bool enable)
+{
+	enabled = enable;
+}
+
+bool stats_is_enabled(void)
+{
+	return enabled;
+}
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Returns 0 when disabled so callers can skip stats_hist_end cheaply */
+uint64_t stats_start(void)
+{
+	if (!enabled)
+		return 0;
+
+	return get_usec();
+}
+
+static unsigned int hist_bucket(uint32_t value)
+{
+	if (!value)
+		return 0;
+
+	return 32 - __builtin_clz(value);
+}
+
+void stats_hist_add(struct stats_hist *hist, uint32_t value)
+{
+	unsigned int bucket = hist_bucket(value);
+	uint32_t max;
+
+	if (!hist)
+		return;
+
+	if (bucket >= STATS_HIST_BUCKETS)
+		bucket = STATS_HIST_BUCKETS - 1;
+
+	__sync_fetch_and_add(&hist->buckets[bucket], 1);
+	__sync_fetch_and_add(&hist->total, value);
+	__sync_fetch_and_add(&hist->count, 1);
+
+	max = hist->max;
+	while (value > max) {
+		uint32_t old = __sync_val_compare_and_swap(&hist->max, max,
+									value);
+		if (old == max)
+			break;
+
+		max = old;
+	}
+}
+
+void stats_hist_end(struct stats_hist *hist, uint64_t start)
+{
+	uint64_t elapsed;
+
+	if (!hist || !start)
+		return;
+
+	elapsed = get_usec() - start;
+	if (elapsed > UINT32_MAX)
+		elapsed = UINT32_MAX;
+
+	stats_hist_add(hist, elapsed);
+}
+
+/* Upper bound of the bucket holding the given percentile */
+uint32_t stats_hist_percentile(const struct stats_hist *hist,
+						unsigned int percent)
+{
+	uint64_t target, sum = 0;
+	uint32_t bound;
+	unsigned int i;
+
+	if (!hist || !hist->count)
+		return 0;
+
+	target = ((uint64_t) hist->count * percent + 99) / 100;
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target)
+			break;
+	}
+
+	/* The last bucket is open ended */
+	if (i >= STATS_HIST_BUCKETS - 1)
+		return hist->max;
+
+	bound = (UINT32_C(1) << i) - 1;
+
+	return bound < hist->max ? bound : hist->max;
+}
+
+struct stats_hist *stats_source(const char *name)
+{
+	unsigned int i;
+
+	if (!name)
+		return NULL;
+
+	for (i = 0; i < STATS_MAX_SOURCES; i++) {
+		struct stats_source *source = &sources[i];
+
+		if (!source->name &&
+			__sync_bool_compare_and_swap(&source->name, NULL, name))
+			return &source->hist;
+
+		if (!strcmp(source->name, name))
+			return &source->hist;
+	}
+
+	return NULL;
+}
+
+void stats_foreach_source(stats_source_func_t func, void *user_data)
+{
+	unsigned int i;
+
+	if (!func)
+		return;
+
+	for (i = 0; i < STATS_MAX_SOURCES && sources[i].name; i++)
+		func(sources[i].name, &sources[i].hist, user_data);
+}
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Bucket 0 counts zero values, bucket n counts [2^(n-1), 2^n) usec */
+#define STATS_HIST_BUCKETS	32
+
+struct stats_hist {
+	unsigned int count;
+	uint64_t total;			/* usec */
+	uint32_t max;			/* usec */
+	unsigned int buckets[STATS_HIST_BUCKETS];
+};
+
+void stats_set_enabled(bool enable);
+bool stats_is_enabled(void);
+
+uint64_t stats_start(void);
+void stats_hist_add(struct stats_hist *hist, uint32_t value);
+void stats_hist_end(struct stats_hist *hist, uint64_t start);
+uint32_t stats_hist_percentile(const struct stats_hist *hist,
+						unsigned int percent);
+
+struct stats_hist *stats_source(const char *name);
+
+typedef void (*stats_source_func_t)(const char *name,
+					const struct stats_hist *hist,
+					void *user_data);
+
+void stats_foreach_source(stats_source_func_t func, void *user_data);
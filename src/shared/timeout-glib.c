@@ -9,6 +9,7 @@
  */
 
 #include "timeout.h"
+#include "stats.h"
 
 #include <glib.h>
 
@@ -18,14 +19,24 @@ struct timeout_data {
 	void *user_data;
 };
 
+static struct stats_hist *timeout_stats;
+
 static gboolean timeout_callback(gpointer user_data)
 {
 	struct timeout_data *data  = user_data;
+	uint64_t start = stats_start();
+	bool keep;
+
+	keep = data->func(data->user_data);
+
+	if (start) {
+		if (!timeout_stats)
+			timeout_stats = stats_source("timeout");
 
-	if (data->func(data->user_data))
-		return TRUE;
+		stats_hist_end(timeout_stats, start);
+	}
 
-	return FALSE;
+	return keep ? TRUE : FALSE;
 }
 
 static void timeout_destroy(gpointer user_data)
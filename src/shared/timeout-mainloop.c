@@ -8,34 +8,372 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
 #include "mainloop.h"
 #include "util.h"
 #include "timeout.h"
+#include "stats.h"
+
+/*
+ * All timeouts share a single timerfd. Pending timeouts are kept in a
+ * hierarchical timer wheel with millisecond ticks: level 0 has one slot
+ * per tick, and each following level has slots that are WHEEL_SIZE times
+ * wider. Entries are moved down one level (cascaded) once the wheel
+ * reaches the start of their slot. The timerfd is only ever armed to the
+ * earliest pending expiry.
+ */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	5
+#define WHEEL_MAX_DELTA	((UINT64_C(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/*
+ * Identifiers combine an index into the lookup table with a generation
+ * counter so that a stale identifier does not remove a newer timeout.
+ */
+#define ID_INDEX_BITS	20
+#define ID_INDEX_MASK	((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK	((1 << (32 - ID_INDEX_BITS)) - 1)
 
 struct timeout_data {
-	int id;
+	unsigned int id;
 	timeout_func_t func;
 	timeout_destroy_func_t destroy;
 	unsigned int timeout;
 	void *user_data;
+	uint64_t expire;
+	struct timeout_data *next;
+	struct timeout_data **pprev;
+	uint8_t level;
+	uint8_t slot;
+	bool running;
+	bool removed;
+};
+
+struct timeout_entry {
+	struct timeout_data *data;
+	unsigned int gen;
+	unsigned int next_free;
+};
+
+struct timer_wheel {
+	int fd;
+	uint64_t now;
+	uint64_t armed;
+	uint64_t bitmap[WHEEL_LEVELS];
+	struct timeout_data *slots[WHEEL_LEVELS][WHEEL_SIZE];
+	struct timeout_data *expired;
+	struct timeout_entry *entries;
+	unsigned int entries_size;
+	unsigned int free_head;
+	unsigned int count;
 };
 
-static void timeout_callback(int id, void *user_data)
+static struct timer_wheel wheel = { .fd = -1 };
+
+static uint64_t get_ticks(bool round_up)
+{
+	struct timespec ts;
+	uint64_t ticks;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	ticks = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	if (round_up && ts.tv_nsec % 1000000)
+		ticks++;
+
+	return ticks;
+}
+
+static void list_add(struct timeout_data **head, struct timeout_data *data)
 {
-	struct timeout_data *data = user_data;
+	data->next = *head;
+	if (data->next)
+		data->next->pprev = &data->next;
+
+	*head = data;
+	data->pprev = head;
+}
 
-	if (data->func(data->user_data) &&
-			!mainloop_modify_timeout(data->id, data->timeout))
+static void list_del(struct timeout_data *data)
+{
+	if (!data->pprev)
 		return;
 
-	mainloop_remove_timeout(data->id);
+	*data->pprev = data->next;
+	if (data->next)
+		data->next->pprev = data->pprev;
+
+	data->next = NULL;
+	data->pprev = NULL;
 }
 
-static void timeout_destroy(void *user_data)
+static void wheel_unlink(struct timeout_data *data)
 {
-	struct timeout_data *data = user_data;
+	list_del(data);
+
+	if (!wheel.slots[data->level][data->slot])
+		wheel.bitmap[data->level] &= ~(UINT64_C(1) << data->slot);
+}
+
+static void wheel_insert(struct timeout_data *data)
+{
+	uint64_t expire = data->expire;
+	uint64_t delta;
+	unsigned int level;
+
+	if (expire <= wheel.now)
+		expire = wheel.now + 1;
+
+	delta = expire - wheel.now;
+	if (delta > WHEEL_MAX_DELTA) {
+		delta = WHEEL_MAX_DELTA;
+		expire = wheel.now + delta;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (UINT64_C(1) << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+
+	data->level = level;
+	data->slot = (expire >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+	list_add(&wheel.slots[level][data->slot], data);
+	wheel.bitmap[level] |= UINT64_C(1) << data->slot;
+}
+
+/*
+ * Returns the tick at which the given slot is next processed, which is
+ * the point where its entries either expire (level 0) or get cascaded.
+ */
+static uint64_t slot_start(unsigned int level, unsigned int slot)
+{
+	unsigned int shift = WHEEL_BITS * level;
+	uint64_t cur = wheel.now >> shift;
+	uint64_t offset = (slot - cur) & WHEEL_MASK;
+
+	if (!offset)
+		offset = WHEEL_SIZE;
+
+	return (cur + offset) << shift;
+}
+
+static unsigned int next_slot(unsigned int level)
+{
+	unsigned int shift = WHEEL_BITS * level;
+	unsigned int cur = (wheel.now >> shift) & WHEEL_MASK;
+	uint64_t bitmap = wheel.bitmap[level];
+	uint64_t rotated;
+
+	/* Search starting right after the current position */
+	cur = (cur + 1) & WHEEL_MASK;
+	rotated = (bitmap >> cur) | (cur ? bitmap << (WHEEL_SIZE - cur) : 0);
+
+	return (cur + __builtin_ctzll(rotated)) & WHEEL_MASK;
+}
+
+/* Earliest tick at which any slot needs to be processed */
+static uint64_t wheel_next_event(void)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		uint64_t start;
+
+		if (!wheel.bitmap[level])
+			continue;
+
+		start = slot_start(level, next_slot(level));
+		if (start < next)
+			next = start;
+	}
+
+	return next;
+}
+
+/* Earliest actual expiry, used for arming the timerfd */
+static uint64_t wheel_next_expire(void)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		struct timeout_data *data;
+		unsigned int slot;
+
+		if (!wheel.bitmap[level])
+			continue;
+
+		slot = next_slot(level);
+
+		/* Level 0 slots span a single tick */
+		if (!level) {
+			next = slot_start(level, slot);
+			continue;
+		}
+
+		for (data = wheel.slots[level][slot]; data; data = data->next) {
+			if (data->expire < next)
+				next = data->expire;
+		}
+	}
+
+	return next;
+}
+
+static void wheel_arm(uint64_t expire)
+{
+	struct itimerspec itimer;
+
+	/* Zero means disarmed for both the timerfd and the wheel */
+	if (expire == UINT64_MAX)
+		expire = 0;
+
+	if (expire == wheel.armed)
+		return;
+
+	memset(&itimer, 0, sizeof(itimer));
+
+	if (expire) {
+		itimer.it_value.tv_sec = expire / 1000;
+		itimer.it_value.tv_nsec = (expire % 1000) * 1000 * 1000;
+	}
+
+	if (timerfd_settime(wheel.fd, TFD_TIMER_ABSTIME, &itimer, NULL) < 0)
+		return;
+
+	wheel.armed = expire;
+}
+
+static void wheel_cascade(unsigned int level, unsigned int slot)
+{
+	struct timeout_data *list = wheel.slots[level][slot];
+
+	wheel.slots[level][slot] = NULL;
+	wheel.bitmap[level] &= ~(UINT64_C(1) << slot);
+
+	if (list)
+		list->pprev = &list;
+
+	while (list) {
+		struct timeout_data *data = list;
+
+		list_del(data);
+
+		if (data->expire <= wheel.now)
+			list_add(&wheel.expired, data);
+		else
+			wheel_insert(data);
+	}
+}
+
+static void wheel_collect(uint64_t tick)
+{
+	unsigned int level;
+
+	wheel.now = tick;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		unsigned int shift = WHEEL_BITS * level;
+
+		if (tick & ((UINT64_C(1) << shift) - 1))
+			break;
+
+		wheel_cascade(level, (tick >> shift) & WHEEL_MASK);
+	}
+
+	wheel_cascade(0, tick & WHEEL_MASK);
+}
+
+static void entry_release(struct timeout_data *data)
+{
+	unsigned int index = (data->id & ID_INDEX_MASK) - 1;
+	struct timeout_entry *entry = &wheel.entries[index];
+
+	entry->data = NULL;
+	entry->gen = (entry->gen + 1) & ID_GEN_MASK;
+	entry->next_free = wheel.free_head;
+	wheel.free_head = index + 1;
+
+	wheel.count--;
+}
+
+static bool entry_alloc(struct timeout_data *data)
+{
+	struct timeout_entry *entry;
+	unsigned int index;
+
+	if (!wheel.free_head) {
+		unsigned int size = wheel.entries_size ?
+					wheel.entries_size * 2 : WHEEL_SIZE;
+		struct timeout_entry *entries;
+		unsigned int i;
+
+		if (size > ID_INDEX_MASK)
+			size = ID_INDEX_MASK;
+
+		if (size <= wheel.entries_size)
+			return false;
+
+		entries = realloc(wheel.entries, size * sizeof(*entries));
+		if (!entries)
+			return false;
+
+		/* Chain the new entries so the lowest index is used first */
+		for (i = wheel.entries_size; i < size; i++) {
+			entries[i].data = NULL;
+			entries[i].gen = 0;
+			entries[i].next_free = i + 1 < size ? i + 2 : 0;
+		}
+
+		wheel.free_head = wheel.entries_size + 1;
+		wheel.entries = entries;
+		wheel.entries_size = size;
+	}
+
+	index = wheel.free_head - 1;
+	entry = &wheel.entries[index];
+
+	wheel.free_head = entry->next_free;
+	entry->data = data;
+
+	data->id = (entry->gen << ID_INDEX_BITS) | (index + 1);
+	wheel.count++;
+
+	return true;
+}
+
+static struct timeout_data *entry_lookup(unsigned int id)
+{
+	unsigned int index = id & ID_INDEX_MASK;
+	struct timeout_data *data;
+
+	if (!index || index > wheel.entries_size)
+		return NULL;
+
+	data = wheel.entries[index - 1].data;
+	if (!data || data->id != id)
+		return NULL;
+
+	return data;
+}
+
+static void timeout_free(struct timeout_data *data)
+{
+	entry_release(data);
 
 	if (data->destroy)
 		data->destroy(data->user_data);
@@ -43,33 +381,169 @@ static void timeout_destroy(void *user_data)
 	free(data);
 }
 
+static struct stats_hist *timeout_stats;
+
+static void wheel_run(struct timeout_data *data)
+{
+	uint64_t start = stats_start();
+	bool keep;
+
+	data->running = true;
+
+	keep = data->func(data->user_data);
+
+	if (start) {
+		if (!timeout_stats)
+			timeout_stats = stats_source("timeout");
+
+		stats_hist_end(timeout_stats, start);
+	}
+
+	if (!keep || data->removed) {
+		timeout_free(data);
+		return;
+	}
+
+	data->running = false;
+	data->expire = get_ticks(true) + data->timeout;
+
+	wheel_insert(data);
+}
+
+static void wheel_callback(int fd, uint32_t events, void *user_data)
+{
+	uint64_t expired, now;
+
+	if (events & (EPOLLERR | EPOLLHUP))
+		return;
+
+	if (read(wheel.fd, &expired, sizeof(expired)) < 0)
+		return;
+
+	wheel.armed = 0;
+	now = get_ticks(false);
+
+	while (1) {
+		uint64_t next = wheel_next_event();
+
+		if (next > now)
+			break;
+
+		wheel_collect(next);
+
+		while (wheel.expired) {
+			struct timeout_data *data = wheel.expired;
+
+			list_del(data);
+			wheel_run(data);
+		}
+	}
+
+	if (now > wheel.now)
+		wheel.now = now;
+
+	wheel_arm(wheel_next_expire());
+}
+
+static void wheel_destroy(void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < wheel.entries_size; i++) {
+		struct timeout_data *data = wheel.entries[i].data;
+
+		if (!data)
+			continue;
+
+		if (data->destroy)
+			data->destroy(data->user_data);
+
+		free(data);
+	}
+
+	free(wheel.entries);
+	close(wheel.fd);
+
+	memset(&wheel, 0, sizeof(wheel));
+	wheel.fd = -1;
+}
+
+static bool wheel_init(void)
+{
+	wheel.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (wheel.fd < 0)
+		return false;
+
+	if (mainloop_add_fd(wheel.fd, EPOLLIN, wheel_callback, NULL,
+							wheel_destroy) < 0) {
+		close(wheel.fd);
+		wheel.fd = -1;
+		return false;
+	}
+
+	wheel.now = get_ticks(false);
+	wheel.armed = 0;
+
+	return true;
+}
+
 unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy)
 {
 	struct timeout_data *data;
 
+	if (!func)
+		return 0;
+
+	if (wheel.fd < 0 && !wheel_init())
+		return 0;
+
 	data = new0(struct timeout_data, 1);
 	data->func = func;
 	data->user_data = user_data;
 	data->timeout = timeout;
 	data->destroy = destroy;
 
-	data->id = mainloop_add_timeout(timeout, timeout_callback, data,
-							timeout_destroy);
-	if (data->id < 0) {
+	if (!entry_alloc(data)) {
 		free(data);
 		return 0;
 	}
 
-	return (unsigned int) data->id;
+	/* Nothing pending, so the wheel position can be moved forward */
+	if (wheel.count == 1 && !wheel.expired)
+		wheel.now = get_ticks(false);
+
+	data->expire = get_ticks(true) + timeout;
+	wheel_insert(data);
+
+	if (!wheel.armed || data->expire < wheel.armed)
+		wheel_arm(data->expire);
+
+	return data->id;
 }
 
 void timeout_remove(unsigned int id)
 {
+	struct timeout_data *data;
+
 	if (!id)
 		return;
 
-	mainloop_remove_timeout((int) id);
+	data = entry_lookup(id);
+	if (!data || data->removed)
+		return;
+
+	/*
+	 * The timerfd is left armed, a spurious wakeup just re-arms it to
+	 * the next expiry which saves a syscall for every cancellation.
+	 */
+	if (data->running) {
+		data->removed = true;
+		return;
+	}
+
+	wheel_unlink(data);
+	timeout_free(data);
 }
 
 unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+#include "gdbus/gdbus.h"
+
+#include "bluetooth/bluetooth.h"
+#include "bluetooth/mgmt.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/stats.h"
+#include "src/shared/mgmt.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-client.h"
+
+#include "log.h"
+#include "dbus-common.h"
+#include "adapter.h"
+#include "device.h"
+#include "gatt-database.h"
+#include "storage.h"
+#include "statistics.h"
+
+#define STATISTICS_INTERFACE "org.bluez.Statistics1"
+
+struct btd_statistics {
+	struct btd_adapter *adapter;
+	uint16_t adapter_id;
+	struct mgmt *mgmt;
+	struct stats_hist device_found;
+
+	/* Values at the last dump, to report rates */
+	struct btd_gatt_database_stats last_gatt;
+};
+
+static struct queue *statistics_list;
+
+static int64_t last_dump;
+static unsigned int last_storage_writes;
+
+struct statistics_dict {
+	DBusMessageIter entry;
+	DBusMessageIter variant;
+	DBusMessageIter dict;
+};
+
+static void open_dict(DBusMessageIter *iter, DBusMessageIter *dict)
+{
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					dict);
+}
+
+/* Opens a dictionary entry whose value is a nested a{sv} */
+static void open_nested(DBusMessageIter *dict, const char *key,
+					struct statistics_dict *nested)
+{
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+							&nested->entry);
+	dbus_message_iter_append_basic(&nested->entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&nested->entry, DBUS_TYPE_VARIANT,
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&nested->variant);
+	open_dict(&nested->variant, &nested->dict);
+}
+
+static void close_nested(DBusMessageIter *dict,
+					struct statistics_dict *nested)
+{
+	dbus_message_iter_close_container(&nested->variant, &nested->dict);
+	dbus_message_iter_close_container(&nested->entry, &nested->variant);
+	dbus_message_iter_close_container(dict, &nested->entry);
+}
+
+static void append_uint(DBusMessageIter *dict, const char *key,
+							uint32_t value)
+{
+	dict_append_entry(dict, key, DBUS_TYPE_UINT32, &value);
+}
+
+static uint32_t hist_average(const struct stats_hist *hist)
+{
+	if (!hist->count)
+		return 0;
+
+	return hist->total / hist->count;
+}
+
+static void append_hist_entries(DBusMessageIter *dict,
+					const struct stats_hist *hist)
+{
+	append_uint(dict, "Count", hist->count);
+	append_uint(dict, "Average", hist_average(hist));
+	append_uint(dict, "Max", hist->max);
+	append_uint(dict, "P50", stats_hist_percentile(hist, 50));
+	append_uint(dict, "P90", stats_hist_percentile(hist, 90));
+	append_uint(dict, "P99", stats_hist_percentile(hist, 99));
+}
+
+static void append_hist(DBusMessageIter *dict, const char *key,
+					const struct stats_hist *hist)
+{
+	struct statistics_dict nested;
+
+	open_nested(dict, key, &nested);
+	append_hist_entries(&nested.dict, hist);
+	close_nested(dict, &nested);
+}
+
+static void append_mgmt_stats(const struct mgmt_stats *stats, void *user_data)
+{
+	DBusMessageIter *dict = user_data;
+	struct statistics_dict nested;
+
+	open_nested(dict, mgmt_opstr(stats->opcode), &nested);
+	append_hist_entries(&nested.dict, &stats->hist);
+	append_uint(&nested.dict, "Timeouts", stats->timeouts);
+	close_nested(dict, &nested);
+}
+
+static void append_source(const char *name, const struct stats_hist *hist,
+							void *user_data)
+{
+	append_hist(user_data, name, hist);
+}
+
+static void append_prop_stats(const struct btd_device_prop_stats *stats,
+							void *user_data)
+{
+	DBusMessageIter *dict = user_data;
+	struct statistics_dict nested;
+
+	open_nested(dict, stats->name, &nested);
+	append_uint(&nested.dict, "Emitted", stats->emitted);
+	append_uint(&nested.dict, "Suppressed", stats->suppressed);
+	close_nested(dict, &nested);
+}
+
+static struct bt_att *device_get_att(struct btd_device *device)
+{
+	return bt_gatt_client_get_att(btd_device_get_gatt_client(device));
+}
+
+static const char *att_class_names[BT_ATT_CLASS_MAX] = {
+	[BT_ATT_CLASS_REQ] = "Request",
+	[BT_ATT_CLASS_IND] = "Indication",
+	[BT_ATT_CLASS_WRITE] = "Write",
+};
+
+static const char *att_chan_type(uint8_t type)
+{
+	switch (type) {
+	case BT_ATT_BREDR:
+		return "BR/EDR";
+	case BT_ATT_LE:
+		return "LE";
+	case BT_ATT_EATT:
+		return "EATT";
+	default:
+		return "Local";
+	}
+}
+
+static void append_classes(DBusMessageIter *dict, const char *key,
+						const unsigned int *counts)
+{
+	struct statistics_dict nested;
+	unsigned int i;
+
+	open_nested(dict, key, &nested);
+
+	for (i = 0; i < BT_ATT_CLASS_MAX; i++)
+		append_uint(&nested.dict, att_class_names[i], counts[i]);
+
+	close_nested(dict, &nested);
+}
+
+struct chan_iter {
+	DBusMessageIter *dict;
+	const char *addr;
+	unsigned int index;
+};
+
+static void append_chan(const struct bt_att_chan_stats *stats,
+							void *user_data)
+{
+	struct chan_iter *iter = user_data;
+	struct statistics_dict nested;
+	const char *type = att_chan_type(stats->type);
+	uint64_t bytes = stats->sent_bytes;
+	char key[12];
+
+	snprintf(key, sizeof(key), "%u", iter->index++);
+
+	open_nested(iter->dict, key, &nested);
+	dict_append_entry(&nested.dict, "Type", DBUS_TYPE_STRING, &type);
+	append_uint(&nested.dict, "MTU", stats->mtu);
+	append_uint(&nested.dict, "Outstanding", stats->outstanding);
+	append_classes(&nested.dict, "Sent", stats->sent);
+	dict_append_entry(&nested.dict, "SentBytes", DBUS_TYPE_UINT64, &bytes);
+	close_nested(iter->dict, &nested);
+}
+
+static void append_device(struct btd_device *device, void *user_data)
+{
+	DBusMessageIter *dict = user_data;
+	struct statistics_dict nested, channels;
+	struct bt_att_stats stats;
+	struct chan_iter iter;
+
+	if (!bt_att_get_stats(device_get_att(device), &stats))
+		return;
+
+	open_nested(dict, device_get_path(device), &nested);
+	append_uint(&nested.dict, "RequestQueue", stats.req_queue);
+	append_uint(&nested.dict, "IndicationQueue", stats.ind_queue);
+	append_uint(&nested.dict, "WriteQueue", stats.write_queue);
+	append_uint(&nested.dict, "MaxRequestQueue", stats.max_req_queue);
+	append_uint(&nested.dict, "MaxIndicationQueue", stats.max_ind_queue);
+	append_uint(&nested.dict, "MaxWriteQueue", stats.max_write_queue);
+	append_hist(&nested.dict, "RoundTrip", &stats.rtt);
+	append_classes(&nested.dict, "Sent", stats.sent);
+	append_classes(&nested.dict, "Refused", stats.refused);
+
+	memset(&iter, 0, sizeof(iter));
+	iter.dict = &channels.dict;
+
+	open_nested(&nested.dict, "Channels", &channels);
+	bt_att_foreach_chan_stats(device_get_att(device), append_chan, &iter);
+	close_nested(&nested.dict, &channels);
+
+	close_nested(dict, &nested);
+}
+
+static DBusMessage *get_statistics(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	struct btd_statistics *statistics = user_data;
+	struct btd_gatt_database_stats gatt;
+	struct statistics_dict nested;
+	DBusMessageIter iter, dict;
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	open_dict(&iter, &dict);
+
+	open_nested(&dict, "Management", &nested);
+	mgmt_foreach_stats(statistics->mgmt, append_mgmt_stats, &nested.dict);
+	close_nested(&dict, &nested);
+
+	open_nested(&dict, "Dispatch", &nested);
+	stats_foreach_source(append_source, &nested.dict);
+	close_nested(&dict, &nested);
+
+	append_hist(&dict, "DeviceFound", &statistics->device_found);
+
+	memset(&gatt, 0, sizeof(gatt));
+	btd_gatt_database_get_stats(
+			btd_adapter_get_database(statistics->adapter), &gatt);
+	append_uint(&dict, "Notifications", gatt.notifications);
+	append_uint(&dict, "Indications", gatt.indications);
+	append_uint(&dict, "HashUpdates", gatt.hash_updates);
+
+	append_uint(&dict, "StorageWrites", storage_get_writes());
+
+	open_nested(&dict, "PropertiesChanged", &nested);
+	btd_device_foreach_prop_stats(append_prop_stats, &nested.dict);
+	close_nested(&dict, &nested);
+
+	open_nested(&dict, "Devices", &nested);
+	btd_adapter_for_each_device(statistics->adapter, append_device,
+								&nested.dict);
+	close_nested(&dict, &nested);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static const GDBusMethodTable statistics_methods[] = {
+	{ GDBUS_METHOD("GetStatistics", NULL,
+				GDBUS_ARGS({ "statistics", "a{sv}" }),
+				get_statistics) },
+	{ }
+};
+
+struct btd_statistics *btd_statistics_create(struct btd_adapter *adapter,
+							struct mgmt *mgmt)
+{
+	struct btd_statistics *statistics;
+
+	statistics = new0(struct btd_statistics, 1);
+	statistics->adapter = adapter;
+	statistics->adapter_id = btd_adapter_get_index(adapter);
+	statistics->mgmt = mgmt_ref(mgmt);
+
+	if (!g_dbus_register_interface(btd_get_dbus_connection(),
+					adapter_get_path(adapter),
+					STATISTICS_INTERFACE,
+					statistics_methods, NULL, NULL,
+					statistics, NULL)) {
+		btd_error(statistics->adapter_id,
+				"Failed to register " STATISTICS_INTERFACE);
+		mgmt_unref(statistics->mgmt);
+		free(statistics);
+		return NULL;
+	}
+
+	if (!statistics_list) {
+		statistics_list = queue_new();
+		last_dump = g_get_monotonic_time();
+	}
+
+	queue_push_tail(statistics_list, statistics);
+
+	return statistics;
+}
+
+void btd_statistics_destroy(struct btd_statistics *statistics)
+{
+	if (!statistics)
+		return;
+
+	g_dbus_unregister_interface(btd_get_dbus_connection(),
+					adapter_get_path(statistics->adapter),
+					STATISTICS_INTERFACE);
+
+	queue_remove(statistics_list, statistics);
+	if (queue_isempty(statistics_list)) {
+		queue_destroy(statistics_list, NULL);
+		statistics_list = NULL;
+	}
+
+	mgmt_unref(statistics->mgmt);
+	free(statistics);
+}
+
+void btd_statistics_device_found(struct btd_statistics *statistics,
+							uint64_t start)
+{
+	if (!statistics)
+		return;
+
+	stats_hist_end(&statistics->device_found, start);
+}
+
+static void log_hist(const char *prefix, const char *name,
+					const struct stats_hist *hist)
+{
+	info("%s%s: %u calls, avg %u max %u p50 %u p90 %u p99 %u usec",
+			prefix, name, hist->count, hist_average(hist),
+			hist->max, stats_hist_percentile(hist, 50),
+			stats_hist_percentile(hist, 90),
+			stats_hist_percentile(hist, 99));
+}
+
+static double rate(unsigned int count, unsigned int last, int64_t elapsed)
+{
+	if (elapsed <= 0)
+		return 0;
+
+	return (double) (count - last) * G_USEC_PER_SEC / elapsed;
+}
+
+static void log_mgmt_stats(const struct mgmt_stats *stats, void *user_data)
+{
+	log_hist("mgmt ", mgmt_opstr(stats->opcode), &stats->hist);
+
+	if (stats->timeouts)
+		info("mgmt %s: %u timeouts", mgmt_opstr(stats->opcode),
+							stats->timeouts);
+}
+
+static void log_source(const char *name, const struct stats_hist *hist,
+							void *user_data)
+{
+	log_hist("dispatch ", name, hist);
+}
+
+static void log_prop_stats(const struct btd_device_prop_stats *stats,
+							void *user_data)
+{
+	info("property %s: %u emitted, %u suppressed", stats->name,
+					stats->emitted, stats->suppressed);
+}
+
+static void log_chan(const struct bt_att_chan_stats *stats, void *user_data)
+{
+	struct chan_iter *iter = user_data;
+
+	info("%s att channel %u (%s): mtu %u outstanding %u, sent req %u "
+			"ind %u write %u, %" PRIu64 " bytes", iter->addr,
+			iter->index++, att_chan_type(stats->type), stats->mtu,
+			stats->outstanding, stats->sent[BT_ATT_CLASS_REQ],
+			stats->sent[BT_ATT_CLASS_IND],
+			stats->sent[BT_ATT_CLASS_WRITE], stats->sent_bytes);
+}
+
+static void log_device(struct btd_device *device, void *user_data)
+{
+	struct btd_statistics *statistics = user_data;
+	struct bt_att_stats stats;
+	struct chan_iter iter;
+	char addr[18], prefix[32];
+
+	if (!bt_att_get_stats(device_get_att(device), &stats))
+		return;
+
+	ba2str(device_get_address(device), addr);
+
+	btd_info(statistics->adapter_id, "%s att: queues req %u ind %u "
+			"write %u, max req %u ind %u write %u", addr,
+			stats.req_queue, stats.ind_queue, stats.write_queue,
+			stats.max_req_queue, stats.max_ind_queue,
+			stats.max_write_queue);
+
+	btd_info(statistics->adapter_id, "%s att: sent req %u ind %u "
+			"write %u, refused req %u ind %u write %u", addr,
+			stats.sent[BT_ATT_CLASS_REQ],
+			stats.sent[BT_ATT_CLASS_IND],
+			stats.sent[BT_ATT_CLASS_WRITE],
+			stats.refused[BT_ATT_CLASS_REQ],
+			stats.refused[BT_ATT_CLASS_IND],
+			stats.refused[BT_ATT_CLASS_WRITE]);
+
+	snprintf(prefix, sizeof(prefix), "%s att ", addr);
+	log_hist(prefix, "round trip", &stats.rtt);
+
+	memset(&iter, 0, sizeof(iter));
+	iter.addr = addr;
+	bt_att_foreach_chan_stats(device_get_att(device), log_chan, &iter);
+}
+
+static void log_statistics(void *data, void *user_data)
+{
+	struct btd_statistics *statistics = data;
+	int64_t elapsed = *(int64_t *) user_data;
+	struct btd_gatt_database_stats gatt;
+	char prefix[16];
+
+	snprintf(prefix, sizeof(prefix), "hci%u ", statistics->adapter_id);
+	log_hist(prefix, "device found", &statistics->device_found);
+
+	memset(&gatt, 0, sizeof(gatt));
+	btd_gatt_database_get_stats(
+			btd_adapter_get_database(statistics->adapter), &gatt);
+
+	btd_info(statistics->adapter_id,
+			"%u notifications (%.1f/s), %u indications (%.1f/s)",
+			gatt.notifications,
+			rate(gatt.notifications,
+				statistics->last_gatt.notifications, elapsed),
+			gatt.indications,
+			rate(gatt.indications,
+				statistics->last_gatt.indications, elapsed));
+
+	statistics->last_gatt = gatt;
+
+	btd_adapter_for_each_device(statistics->adapter, log_device,
+								statistics);
+}
+
+void btd_statistics_dump(void)
+{
+	unsigned int writes = storage_get_writes();
+	struct btd_statistics *statistics;
+	int64_t now, elapsed;
+
+	statistics = queue_peek_head(statistics_list);
+	if (!statistics) {
+		info("Statistics are disabled");
+		return;
+	}
+
+	now = g_get_monotonic_time();
+	elapsed = now - last_dump;
+
+	info("Statistics for the last %.1f seconds",
+				(double) elapsed / G_USEC_PER_SEC);
+
+	/* The management socket is shared by all adapters */
+	mgmt_foreach_stats(statistics->mgmt, log_mgmt_stats, NULL);
+	stats_foreach_source(log_source, NULL);
+
+	info("storage: %u writes (%.1f/s)", writes,
+			rate(writes, last_storage_writes, elapsed));
+	last_storage_writes = writes;
+
+	btd_device_foreach_prop_stats(log_prop_stats, NULL);
+
+	queue_foreach(statistics_list, log_statistics, &elapsed);
+
+	last_dump = now;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+struct btd_adapter;
+struct btd_statistics;
+struct mgmt;
+
+struct btd_statistics *btd_statistics_create(struct btd_adapter *adapter,
+							struct mgmt *mgmt);
+void btd_statistics_destroy(struct btd_statistics *statistics);
+
+void btd_statistics_device_found(struct btd_statistics *statistics,
+							uint64_t start);
+
+void btd_statistics_dump(void);
@@ -178,3 +178,19 @@ sdp_record_t *find_record_in_list(sdp_list_t *recs, const char *uuid)
 	}
 	return NULL;
 }
+
+static unsigned int storage_writes;
+
+/* Wrapper around g_file_set_contents counting writes for statistics */
+gboolean storage_set_contents(const char *filename, const char *contents,
+					gssize length, GError **error)
+{
+	__sync_fetch_and_add(&storage_writes, 1);
+
+	return g_file_set_contents(filename, contents, length, error);
+}
+
+unsigned int storage_get_writes(void)
+{
+	return storage_writes;
+}
@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "bluetooth/bluetooth.h"
+#include "bluetooth/uuid.h"
+
+#include "monitor/bt.h"
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/ad.h"
+#include "src/eir.h"
+
+struct report {
+	uint8_t len;
+	uint8_t data[BT_EA_MAX_DATA_LEN];
+};
+
+static struct report *reports;
+static unsigned int num_reports;
+static unsigned int max_reports;
+
+static void add_report(const uint8_t *data, uint8_t len)
+{
+	struct report *report;
+
+	if (len > BT_EA_MAX_DATA_LEN)
+		return;
+
+	if (num_reports == max_reports) {
+		unsigned int max = max_reports ? max_reports * 2 : 1024;
+		struct report *new_reports;
+
+		new_reports = realloc(reports, max * sizeof(*reports));
+		if (!new_reports)
+			return;
+
+		reports = new_reports;
+		max_reports = max;
+	}
+
+	report = &reports[num_reports++];
+	report->len = len;
+	memcpy(report->data, data, len);
+}
+
+static void parse_adv_report(const uint8_t *data, uint16_t size)
+{
+	uint8_t num_reports, i;
+
+	if (size < 1)
+		return;
+
+	num_reports = data[0];
+	data++;
+	size--;
+
+	/* Event type, address type, address, length, data and RSSI */
+	for (i = 0; i < num_reports; i++) {
+		uint8_t len;
+
+		if (size < 9 || size < 10 + data[8])
+			return;
+
+		len = data[8];
+		add_report(data + 9, len);
+
+		data += 10 + len;
+		size -= 10 + len;
+	}
+}
+
+static void parse_ext_adv_report(const uint8_t *data, uint16_t size)
+{
+	const struct bt_hci_evt_le_ext_adv_report *ev = (void *) data;
+	uint8_t i;
+
+	if (size < sizeof(*ev))
+		return;
+
+	data += sizeof(*ev);
+	size -= sizeof(*ev);
+
+	for (i = 0; i < ev->num_reports; i++) {
+		const struct bt_hci_le_ext_adv_report *rp = (void *) data;
+
+		if (size < sizeof(*rp) || size < sizeof(*rp) + rp->data_len)
+			return;
+
+		add_report(rp->data, rp->data_len);
+
+		data += sizeof(*rp) + rp->data_len;
+		size -= sizeof(*rp) + rp->data_len;
+	}
+}
+
+static bool load_reports(const char *path)
+{
+	struct btsnoop *btsnoop;
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, size;
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	if (!btsnoop)
+		return false;
+
+	while (btsnoop_read_hci(btsnoop, &tv, &index, &opcode, buf, &size)) {
+		const struct bt_hci_evt_hdr *hdr = (void *) buf;
+
+		if (opcode != BTSNOOP_OPCODE_EVENT_PKT || size < sizeof(*hdr) +
+									2)
+			continue;
+
+		if (hdr->evt != BT_HCI_EVT_LE_META_EVENT)
+			continue;
+
+		size -= sizeof(*hdr) + 1;
+
+		switch (buf[sizeof(*hdr)]) {
+		case BT_HCI_EVT_LE_ADV_REPORT:
+			parse_adv_report(buf + sizeof(*hdr) + 1, size);
+			break;
+		case BT_HCI_EVT_LE_EXT_ADV_REPORT:
+			parse_ext_adv_report(buf + sizeof(*hdr) + 1, size);
+			break;
+		}
+	}
+
+	btsnoop_unref(btsnoop);
+
+	return true;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool match_uuid(const void *data, const void *user_data)
+{
+	return !strcmp(data, user_data);
+}
+
+/* What device found used to do for every report */
+static unsigned int run_parse(struct queue *patterns, const bt_uuid_t *uuid)
+{
+	char str[MAX_LEN_UUID_STR];
+	unsigned int i, matches = 0;
+
+	bt_uuid_to_string(uuid, str, sizeof(str));
+
+	for (i = 0; i < num_reports; i++) {
+		struct eir_data eir;
+		struct bt_ad *ad;
+
+		ad = bt_ad_new_with_data(reports[i].len, reports[i].data);
+		if (ad) {
+			if (bt_ad_pattern_match(ad, patterns))
+				matches++;
+			bt_ad_unref(ad);
+		}
+
+		memset(&eir, 0, sizeof(eir));
+		eir_parse(&eir, reports[i].data, reports[i].len);
+
+		if (queue_find(eir.services, match_uuid, str))
+			matches++;
+
+		eir_data_free(&eir);
+	}
+
+	return matches;
+}
+
+/* What device found does for reports that don't update any device */
+static unsigned int run_view(struct queue *patterns, const bt_uuid_t *uuid)
+{
+	unsigned int i, matches = 0;
+
+	for (i = 0; i < num_reports; i++) {
+		struct bt_ad_view view;
+
+		bt_ad_view_init(&view, reports[i].data, reports[i].len);
+
+		if (bt_ad_view_pattern_match(&view, patterns))
+			matches++;
+
+		if (bt_ad_view_has_service_uuid(&view, uuid))
+			matches++;
+	}
+
+	return matches;
+}
+
+/* Random reports with flags, manufacturer data and service data */
+static void random_reports(unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		uint8_t data[BT_AD_MAX_DATA_LEN];
+		uint8_t len = 0, j;
+
+		data[len++] = 2;
+		data[len++] = BT_AD_FLAGS;
+		data[len++] = 0x06;
+
+		data[len++] = 9;
+		data[len++] = BT_AD_MANUFACTURER_DATA;
+		for (j = 0; j < 8; j++)
+			data[len++] = rand() % 64;
+
+		data[len++] = 7;
+		data[len++] = BT_AD_SERVICE_DATA16;
+		for (j = 0; j < 6; j++)
+			data[len++] = rand() % 64;
+
+		add_report(data, len);
+	}
+}
+
+static struct queue *random_pattern_sets(unsigned int count)
+{
+	struct queue *sets = queue_new();
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		struct queue *patterns = queue_new();
+		uint8_t data[4], j;
+		uint8_t type = i % 2 ? BT_AD_SERVICE_DATA16 :
+						BT_AD_MANUFACTURER_DATA;
+
+		for (j = 0; j < sizeof(data); j++)
+			data[j] = rand() % 64;
+
+		queue_push_tail(patterns, bt_ad_pattern_new(type, 0,
+							sizeof(data), data));
+		queue_push_tail(sets, patterns);
+	}
+
+	return sets;
+}
+
+static void pattern_set_free(void *data)
+{
+	queue_destroy(data, free);
+}
+
+/* What the content filter used to do, one monitor after another */
+static unsigned int run_monitors(struct queue *sets)
+{
+	unsigned int i, matches = 0;
+
+	for (i = 0; i < num_reports; i++) {
+		const struct queue_entry *entry;
+		struct bt_ad_view view;
+
+		bt_ad_view_init(&view, reports[i].data, reports[i].len);
+
+		for (entry = queue_get_entries(sets); entry;
+							entry = entry->next) {
+			if (bt_ad_view_pattern_match(&view, entry->data))
+				matches++;
+		}
+	}
+
+	return matches;
+}
+
+static unsigned int run_matcher(struct bt_ad_matcher *matcher)
+{
+	unsigned int i, matches = 0;
+
+	for (i = 0; i < num_reports; i++) {
+		struct bt_ad_view view;
+
+		bt_ad_view_init(&view, reports[i].data, reports[i].len);
+
+		matches += bt_ad_matcher_match(matcher, &view, NULL, NULL);
+	}
+
+	return matches;
+}
+
+static void bench_monitors(unsigned int iterations, unsigned int count)
+{
+	struct bt_ad_matcher *matcher = bt_ad_matcher_new();
+	struct queue *sets = random_pattern_sets(count);
+	const struct queue_entry *entry;
+	unsigned int i, linear_matches, matcher_matches;
+	double start, linear_time, matcher_time;
+
+	for (entry = queue_get_entries(sets); entry; entry = entry->next)
+		bt_ad_matcher_add(matcher, entry->data, entry->data);
+
+	start = now();
+	for (i = 0, linear_matches = 0; i < iterations; i++)
+		linear_matches += run_monitors(sets);
+	linear_time = now() - start;
+
+	start = now();
+	for (i = 0, matcher_matches = 0; i < iterations; i++)
+		matcher_matches += run_matcher(matcher);
+	matcher_time = now() - start;
+
+	printf("%u monitor patterns\n", count);
+	printf("per monitor:       %.0f ns/report (%u matches)\n",
+			linear_time * 1e9 / (num_reports * iterations),
+			linear_matches);
+	printf("bt_ad_matcher:     %.0f ns/report (%u matches)\n",
+			matcher_time * 1e9 / (num_reports * iterations),
+			matcher_matches);
+
+	bt_ad_matcher_free(matcher);
+	queue_destroy(sets, pattern_set_free);
+}
+
+static void usage(void)
+{
+	printf("adbench - Advertising data parsing benchmark\n"
+		"Usage:\n");
+	printf("\tadbench [options] <btsnoop file>\n");
+	printf("\tadbench [options] -r <num>\n");
+	printf("Options:\n"
+		"\t-i, --iterations <num>  Number of replays (default 100)\n"
+		"\t-r, --random <num>      Use random reports instead\n"
+		"\t-p, --patterns <num>    Also match <num> monitor patterns\n"
+		"\t-h, --help              Show help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "iterations",	required_argument,	NULL, 'i' },
+	{ "random",	required_argument,	NULL, 'r' },
+	{ "patterns",	required_argument,	NULL, 'p' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	static const uint8_t apple[] = { 0x4c, 0x00 };
+	unsigned int iterations = 100, i, parse_matches, view_matches;
+	unsigned int random = 0, num_patterns = 0;
+	struct queue *patterns;
+	bt_uuid_t uuid;
+	double start, parse_time, view_time;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "i:r:p:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'r':
+			random = atoi(optarg);
+			break;
+		case 'p':
+			num_patterns = atoi(optarg);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != (random ? 0 : 1) || !iterations) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (!random && !load_reports(argv[optind])) {
+		fprintf(stderr, "Failed to open %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	random_reports(random);
+
+	if (!num_reports) {
+		fprintf(stderr, "No advertising reports found\n");
+		return EXIT_FAILURE;
+	}
+
+	patterns = queue_new();
+	queue_push_tail(patterns, bt_ad_pattern_new(BT_AD_MANUFACTURER_DATA,
+						0, sizeof(apple), apple));
+	bt_uuid16_create(&uuid, 0x180d);
+
+	start = now();
+	for (i = 0, parse_matches = 0; i < iterations; i++)
+		parse_matches += run_parse(patterns, &uuid);
+	parse_time = now() - start;
+
+	start = now();
+	for (i = 0, view_matches = 0; i < iterations; i++)
+		view_matches += run_view(patterns, &uuid);
+	view_time = now() - start;
+
+	printf("%u reports, %u iterations\n", num_reports, iterations);
+	printf("bt_ad + eir_parse: %.0f ns/report (%u matches)\n",
+			parse_time * 1e9 / (num_reports * iterations),
+			parse_matches);
+	printf("bt_ad_view:        %.0f ns/report (%u matches)\n",
+			view_time * 1e9 / (num_reports * iterations),
+			view_matches);
+
+	if (num_patterns)
+		bench_monitors(iterations, num_patterns);
+
+	queue_destroy(patterns, free);
+	free(reports);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "src/shared/util.h"
+#include "src/shared/mainloop.h"
+#include "src/shared/att.h"
+
+/* Notifications queued at once, the reader waits for all of them */
+#define WINDOW 64
+
+enum mode {
+	MODE_SEND,
+	MODE_SEND_PDU,
+	MODE_SENDV,
+	MODE_LAST,
+};
+
+static const char *mode_names[] = {
+	"bt_att_send:    ",
+	"bt_att_send_pdu:",
+	"bt_att_sendv:   ",
+};
+
+static struct bt_att *att;
+static struct bt_att *peer;
+static struct bt_att_pdu *shared;
+static uint8_t *value;
+static uint16_t value_len;
+
+static enum mode mode;
+static unsigned int count;
+static unsigned int queued;
+static unsigned int received;
+static double start;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool send_notification(void)
+{
+	struct iovec iov[2];
+
+	switch (mode) {
+	case MODE_SEND:
+		return bt_att_send(att, BT_ATT_OP_HANDLE_NFY, value,
+						value_len, NULL, NULL, NULL);
+	case MODE_SEND_PDU:
+		return bt_att_send_pdu(att, shared, NULL, NULL, NULL);
+	case MODE_SENDV:
+		/* Handle and value kept apart, as a server would have them */
+		iov[0].iov_base = value;
+		iov[0].iov_len = 2;
+		iov[1].iov_base = value + 2;
+		iov[1].iov_len = value_len - 2;
+
+		return bt_att_sendv(att, BT_ATT_OP_HANDLE_NFY, iov, 2, NULL,
+									NULL);
+	case MODE_LAST:
+		break;
+	}
+
+	return false;
+}
+
+static void send_window(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < WINDOW && queued < count; i++, queued++) {
+		if (!send_notification()) {
+			fprintf(stderr, "Failed to queue notification\n");
+			mainloop_quit();
+			return;
+		}
+	}
+}
+
+static void start_mode(void)
+{
+	queued = 0;
+	received = 0;
+	start = now();
+
+	send_window();
+}
+
+static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
+					const void *pdu, uint16_t length,
+					void *user_data)
+{
+	double elapsed;
+
+	if (++received < queued)
+		return;
+
+	if (received < count) {
+		send_window();
+		return;
+	}
+
+	elapsed = now() - start;
+
+	printf("%s %.0f PDUs/sec\n", mode_names[mode], count / elapsed);
+
+	if (++mode == MODE_LAST) {
+		mainloop_quit();
+		return;
+	}
+
+	start_mode();
+}
+
+static void usage(void)
+{
+	printf("attbench - ATT throughput benchmark\n"
+		"Usage:\n");
+	printf("\tattbench [options]\n");
+	printf("Options:\n"
+		"\t-c, --count <num>       Number of notifications "
+							"(default 1000000)\n"
+		"\t-m, --mtu <num>         ATT MTU (default 247)\n"
+		"\t-l, --length <num>      Notification value length "
+							"(default 20)\n"
+		"\t-h, --help              Show help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "count",	required_argument,	NULL, 'c' },
+	{ "mtu",	required_argument,	NULL, 'm' },
+	{ "length",	required_argument,	NULL, 'l' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int mtu = 247, length = 20;
+	int fds[2];
+
+	count = 1000000;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "c:m:l:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'm':
+			mtu = atoi(optarg);
+			break;
+		case 'l':
+			length = atoi(optarg);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!count || mtu < BT_ATT_DEFAULT_LE_MTU || mtu > UINT16_MAX ||
+							length + 3 > mtu) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+		perror("Failed to create socket pair");
+		return EXIT_FAILURE;
+	}
+
+	mainloop_init();
+
+	att = bt_att_new(fds[0], false);
+	peer = bt_att_new(fds[1], false);
+	if (!att || !peer || !bt_att_set_mtu(att, mtu) ||
+					!bt_att_set_mtu(peer, mtu)) {
+		fprintf(stderr, "Failed to create ATT bearers\n");
+		return EXIT_FAILURE;
+	}
+
+	bt_att_set_close_on_unref(att, true);
+	bt_att_set_close_on_unref(peer, true);
+	bt_att_register(peer, BT_ATT_OP_HANDLE_NFY, notify_cb, NULL, NULL);
+
+	/* Handle followed by the value */
+	value_len = 2 + length;
+	value = calloc(1, value_len);
+	put_le16(0x0003, value);
+
+	shared = bt_att_pdu_new(BT_ATT_OP_HANDLE_NFY, value_len);
+	memcpy(bt_att_pdu_get_params(shared), value, value_len);
+
+	printf("%u notifications, %u bytes, MTU %u\n", count, length, mtu);
+
+	start_mode();
+
+	mainloop_run();
+
+	bt_att_pdu_unref(shared);
+	bt_att_unref(peer);
+	bt_att_unref(att);
+	free(value);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bluetooth/bluetooth.h"
+#include "bluetooth/uuid.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/mainloop.h"
+#include "src/shared/timeout.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+
+/* Service declaration followed by characteristics with a CCC each */
+#define CHRCS_PER_SERVICE	5
+#define HANDLES_PER_SERVICE	(1 + CHRCS_PER_SERVICE * 3)
+
+/* Handles covered by a Find Information or Read By Type request */
+#define WINDOW			16
+
+/* Services registered one at a time, as applications would do */
+#define REGISTER_SERVICES	100
+#define REGISTER_INTERVAL	10
+
+static unsigned int iterations;
+static uint16_t num_handles;
+static unsigned int found;
+static unsigned int registered;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct gatt_db_attribute *add_service(struct gatt_db *db,
+							unsigned int index)
+{
+	struct gatt_db_attribute *service, *chrc;
+	bt_uuid_t uuid, ccc_uuid;
+	unsigned int i;
+
+	bt_uuid16_create(&ccc_uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	bt_uuid16_create(&uuid, 0x1800 + index);
+
+	service = gatt_db_add_service(db, &uuid, true, HANDLES_PER_SERVICE);
+
+	for (i = 0; i < CHRCS_PER_SERVICE; i++) {
+		bt_uuid16_create(&uuid, 0x2a00 + i);
+		chrc = gatt_db_service_add_characteristic(service, &uuid,
+					BT_ATT_PERM_READ,
+					BT_GATT_CHRC_PROP_READ |
+					BT_GATT_CHRC_PROP_NOTIFY,
+					NULL, NULL, NULL);
+		gatt_db_service_add_descriptor(chrc, &ccc_uuid,
+					BT_ATT_PERM_READ | BT_ATT_PERM_WRITE,
+					NULL, NULL, NULL);
+	}
+
+	gatt_db_service_set_active(service, true);
+
+	return service;
+}
+
+static struct gatt_db *create_db(unsigned int attributes)
+{
+	struct gatt_db *db;
+	unsigned int i;
+
+	db = gatt_db_new();
+
+	for (i = 0; i < attributes / HANDLES_PER_SERVICE; i++)
+		add_service(db, i);
+
+	return db;
+}
+
+static void count_attribute(struct gatt_db_attribute *attrib, void *user_data)
+{
+	found++;
+}
+
+static void report(const char *name, double start, unsigned int ops)
+{
+	printf("%-24s %10.0f ops/sec\n", name, ops / (now() - start));
+}
+
+static void bench_get_attribute(struct gatt_db *db)
+{
+	unsigned int i;
+	double start;
+	uint16_t handle;
+
+	found = 0;
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		handle = 1 + (i * 7919) % num_handles;
+		if (gatt_db_get_attribute(db, handle))
+			found++;
+	}
+
+	report("gatt_db_get_attribute", start, iterations);
+
+	if (found != iterations)
+		fprintf(stderr, "Missing attributes: %u\n",
+						iterations - found);
+}
+
+static void bench_get_service(struct gatt_db *db)
+{
+	unsigned int i;
+	double start;
+	uint16_t handle;
+
+	found = 0;
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		handle = 1 + (i * 7919) % num_handles;
+		if (gatt_db_get_service(db, handle))
+			found++;
+	}
+
+	report("gatt_db_get_service", start, iterations);
+
+	if (found != iterations)
+		fprintf(stderr, "Missing services: %u\n", iterations - found);
+}
+
+static void bench_find_information(struct gatt_db *db)
+{
+	struct queue *q = queue_new();
+	unsigned int i;
+	double start;
+	uint16_t handle;
+
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		handle = 1 + (i * 7919) % num_handles;
+		gatt_db_find_information(db, handle, handle + WINDOW - 1, q);
+		queue_remove_all(q, NULL, NULL, NULL);
+	}
+
+	report("gatt_db_find_information", start, iterations);
+
+	queue_destroy(q, NULL);
+}
+
+static void bench_read_by_type(struct gatt_db *db)
+{
+	struct queue *q = queue_new();
+	unsigned int i;
+	double start;
+	uint16_t handle;
+	bt_uuid_t uuid;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_UUID);
+
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		handle = 1 + (i * 7919) % num_handles;
+		gatt_db_read_by_type(db, handle, handle + WINDOW - 1, uuid, q);
+		queue_remove_all(q, NULL, NULL, NULL);
+	}
+
+	report("gatt_db_read_by_type", start, iterations);
+
+	queue_destroy(q, NULL);
+}
+
+static void bench_foreach(struct gatt_db *db)
+{
+	unsigned int i, loops = iterations / num_handles + 1;
+	double start;
+
+	found = 0;
+	start = now();
+
+	for (i = 0; i < loops; i++)
+		gatt_db_foreach_in_range(db, NULL, count_attribute, NULL,
+							0x0001, 0xffff);
+
+	report("gatt_db_foreach_in_range", start, loops);
+
+	if (found != loops * num_handles)
+		fprintf(stderr, "Unexpected attribute count: %u\n",
+							found / loops);
+}
+
+static bool quit_cb(void *user_data)
+{
+	mainloop_quit();
+
+	return false;
+}
+
+static bool register_cb(void *user_data)
+{
+	struct gatt_db *db = user_data;
+
+	add_service(db, registered);
+
+	if (++registered < REGISTER_SERVICES)
+		return true;
+
+	/* Let the pending hash update run */
+	timeout_add(500, quit_cb, NULL, NULL);
+
+	return false;
+}
+
+static void bench_register(void)
+{
+	struct gatt_db *db = gatt_db_new();
+	struct gatt_db_stats stats;
+
+	if (!gatt_db_hash_support(db)) {
+		printf("Database Hash not supported, skipping registration\n");
+		gatt_db_unref(db);
+		return;
+	}
+
+	registered = 0;
+	timeout_add(REGISTER_INTERVAL, register_cb, db, NULL);
+
+	mainloop_run();
+
+	gatt_db_get_stats(db, &stats);
+
+	printf("%u services registered every %u ms: %u hash updates, "
+				"%u services serialized\n", registered,
+				REGISTER_INTERVAL, stats.hash_updates,
+				stats.hash_segments);
+
+	gatt_db_unref(db);
+}
+
+static void bench_hash(struct gatt_db *db)
+{
+	struct gatt_db_attribute *service;
+	unsigned int i, loops = iterations / 1000 + 1;
+	double start;
+
+	if (!gatt_db_hash_support(db))
+		return;
+
+	service = gatt_db_get_service(db, 0x0001);
+
+	start = now();
+
+	/* Change a single service and hash the whole database again */
+	for (i = 0; i < loops; i++) {
+		gatt_db_service_set_active(service, !(i & 1));
+		gatt_db_get_hash(db);
+	}
+
+	report("gatt_db_get_hash", start, loops);
+}
+
+static void usage(void)
+{
+	printf("gattdbbench - GATT database lookup benchmark\n"
+		"Usage:\n");
+	printf("\tgattdbbench [options]\n");
+	printf("Options:\n"
+		"\t-a, --attributes <num>  Number of attributes "
+							"(default 2000)\n"
+		"\t-i, --iterations <num>  Number of lookups "
+							"(default 1000000)\n"
+		"\t-h, --help              Show help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "attributes",	required_argument,	NULL, 'a' },
+	{ "iterations",	required_argument,	NULL, 'i' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int attributes = 2000;
+	struct gatt_db *db;
+
+	iterations = 1000000;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "a:i:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'a':
+			attributes = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!iterations || attributes < HANDLES_PER_SERVICE ||
+						attributes > UINT16_MAX) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	mainloop_init();
+
+	db = create_db(attributes);
+	num_handles = attributes / HANDLES_PER_SERVICE * HANDLES_PER_SERVICE;
+
+	printf("%u attributes, %u iterations\n", num_handles, iterations);
+
+	bench_get_attribute(db);
+	bench_get_service(db);
+	bench_find_information(db);
+	bench_read_by_type(db);
+	bench_foreach(db);
+	bench_hash(db);
+
+	gatt_db_unref(db);
+
+	bench_register();
+
+	return EXIT_SUCCESS;
+}
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <poll.h>
 #include <stdbool.h>
+#include <inttypes.h>
 
 #include <glib.h>
 
@@ -31,6 +32,7 @@
 #include "src/shared/tester.h"
 #include "src/shared/mgmt.h"
 #include "src/shared/util.h"
+#include "src/shared/att.h"
 
 #include "tester.h"
 
@@ -52,6 +54,9 @@ struct test_data {
 	bool host_disconnected;
 	int step;
 	struct tx_tstamp_data tx_ts;
+	struct bt_att *att;
+	unsigned int att_sent;
+	int64_t att_start;
 };
 
 struct l2cap_data {
@@ -112,6 +117,9 @@ struct l2cap_data {
 
 	/* Set PHY */
 	uint32_t phy;
+
+	/* Number of ATT notifications to receive */
+	unsigned int att_notify;
 };
 
 static void print_debug(const char *str, void *user_data)
@@ -263,6 +271,9 @@ static void test_post_teardown(const void *test_data)
 		data->err_io_id = 0;
 	}
 
+	bt_att_unref(data->att);
+	data->att = NULL;
+
 	hciemu_unref(data->hciemu);
 	data->hciemu = NULL;
 }
@@ -283,6 +294,7 @@ static void test_data_free(void *test_data)
 		user->hciemu_type = type; \
 		user->io_id = 0; \
 		user->err_io_id = 0; \
+		user->att = NULL; \
 		user->test_data = data; \
 		tester_add_full(name, data, \
 				test_pre_setup, setup, func, NULL, \
@@ -1085,6 +1097,12 @@ static const struct l2cap_data le_att_server_success_test_1 = {
 	.cid = 0x0004,
 };
 
+static const struct l2cap_data le_att_client_notify_test_1 = {
+	.cid = 0x0004,
+	.sec_level = BT_SECURITY_LOW,
+	.att_notify = 5000,
+};
+
 static const struct l2cap_data le_eatt_client_connect_success_test_1 = {
 	.client_psm = 0x0027,
 	.server_psm = 0x0027,
@@ -1451,6 +1469,15 @@ static void send_rsp_new_conn(uint16_t handle, void *user_data)
 						bthost_send_rsp, NULL);
 }
 
+static void att_new_conn(uint16_t handle, void *user_data)
+{
+	struct test_data *data = user_data;
+
+	tester_print("New connection with handle 0x%04x", handle);
+
+	data->handle = handle;
+}
+
 static void setup_powered_common(void)
 {
 	struct test_data *data = tester_get_data();
@@ -1503,6 +1530,11 @@ static void setup_powered_client(const void *test_data)
 		bthost_set_connect_cb(bthost, send_rsp_new_conn, data);
 	}
 
+	if (test && test->att_notify) {
+		struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+		bthost_set_connect_cb(bthost, att_new_conn, data);
+	}
+
 	if (test && test->direct_advertising)
 		mgmt_send(data->mgmt, MGMT_OP_SET_ADVERTISING,
 				data->mgmt_index, sizeof(param), param,
@@ -1924,6 +1956,83 @@ static void l2cap_write_data(struct test_data *data, GIOChannel *io,
 	}
 }
 
+static const uint8_t att_nfy[] = { BT_ATT_OP_HANDLE_NFY, 0x03, 0x00,
+				0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+				0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+				0x11, 0x12, 0x13, 0x14 };
+
+/* Notifications in flight, the socket drops what doesn't fit its buffer */
+#define ATT_NOTIFY_WINDOW 32
+
+static void att_send_window(struct test_data *data)
+{
+	const struct l2cap_data *l2data = data->test_data;
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+	unsigned int i;
+
+	for (i = 0; i < ATT_NOTIFY_WINDOW &&
+			data->att_sent < l2data->att_notify; i++) {
+		bthost_send_cid(bthost, data->handle, 0x0004, att_nfy,
+							sizeof(att_nfy));
+		data->att_sent++;
+	}
+}
+
+static void att_notify_cb(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct l2cap_data *l2data = data->test_data;
+	int64_t elapsed;
+
+	if (length != sizeof(att_nfy) - 1 || memcmp(pdu, att_nfy + 1,
+								length)) {
+		tester_warn("Unexpected notification");
+		tester_test_failed();
+		return;
+	}
+
+	if ((unsigned int) ++data->step < data->att_sent)
+		return;
+
+	if (data->att_sent < l2data->att_notify) {
+		att_send_window(data);
+		return;
+	}
+
+	elapsed = g_get_monotonic_time() - data->att_start;
+
+	tester_print("Received %u notifications in %" PRId64 " usec",
+					l2data->att_notify, elapsed);
+
+	tester_test_passed();
+}
+
+static void l2cap_att_notify(struct test_data *data, GIOChannel *io)
+{
+	int sk;
+
+	sk = dup(g_io_channel_unix_get_fd(io));
+
+	data->att = bt_att_new(sk, false);
+	if (!data->att) {
+		close(sk);
+		tester_test_failed();
+		return;
+	}
+
+	bt_att_set_close_on_unref(data->att, true);
+	bt_att_register(data->att, BT_ATT_OP_HANDLE_NFY, att_notify_cb, NULL,
+									NULL);
+
+	data->step = 0;
+	data->att_sent = 0;
+	data->att_start = g_get_monotonic_time();
+
+	att_send_window(data);
+}
+
 static gboolean l2cap_connect_cb(GIOChannel *io, GIOCondition cond,
 							gpointer user_data)
 {
@@ -1969,6 +2078,9 @@ static gboolean l2cap_connect_cb(GIOChannel *io, GIOCondition cond,
 	} else if (l2data->write_data) {
 		l2cap_write_data(data, io, data->dcid);
 		return FALSE;
+	} else if (l2data->att_notify) {
+		l2cap_att_notify(data, io);
+		return FALSE;
 	} else if (l2data->shut_sock_wr) {
 		g_io_add_watch(io, G_IO_HUP, socket_closed_cb, NULL);
 		shutdown(sk, SHUT_WR);
@@ -3284,6 +3396,9 @@ int main(int argc, char *argv[])
 	test_l2cap_le("L2CAP LE ATT Server - Success",
 				&le_att_server_success_test_1,
 				setup_powered_server, test_server);
+	test_l2cap_le("L2CAP LE ATT Client - Notify Throughput",
+				&le_att_client_notify_test_1,
+				setup_powered_client, test_connect);
 
 	test_l2cap_le("L2CAP LE EATT Client - Success",
 				&le_eatt_client_connect_success_test_1,
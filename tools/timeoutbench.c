@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/mainloop.h"
+#include "src/shared/timeout.h"
+
+/* Pending timeouts are spread over this range, like protocol timers */
+#define MAX_TIMEOUT		60000
+
+/* Expiring timeouts are spread over this range */
+#define EXPIRE_SPREAD		1000
+
+/* Stay below the number of identifiers the wheel can hand out */
+#define MAX_TIMEOUTS		1000000
+
+static unsigned int num_timeouts;
+static unsigned int iterations;
+static unsigned int *ids;
+static unsigned int fired;
+static double late_total;
+static double late_max;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double start, unsigned int ops)
+{
+	printf("%-24s %10.0f ops/sec\n", name, ops / (now() - start));
+}
+
+static unsigned int spread(unsigned int i, unsigned int range)
+{
+	return 1 + (i * 7919) % range;
+}
+
+static bool never_cb(void *user_data)
+{
+	return false;
+}
+
+static void bench_add_remove(void)
+{
+	unsigned int i;
+	double start;
+
+	start = now();
+
+	for (i = 0; i < num_timeouts; i++)
+		ids[i] = timeout_add(spread(i, MAX_TIMEOUT), never_cb, NULL,
+									NULL);
+
+	report("timeout_add", start, num_timeouts);
+
+	start = now();
+
+	/* Remove in a different order than added */
+	for (i = 0; i < num_timeouts; i++)
+		timeout_remove(ids[(i * 7919) % num_timeouts]);
+
+	report("timeout_remove", start, num_timeouts);
+}
+
+static void bench_rearm(void)
+{
+	unsigned int i, index;
+	double start;
+
+	for (i = 0; i < num_timeouts; i++)
+		ids[i] = timeout_add(spread(i, MAX_TIMEOUT), never_cb, NULL,
+									NULL);
+
+	start = now();
+
+	/* Restart timers while the wheel holds the other timeouts */
+	for (i = 0; i < iterations; i++) {
+		index = (i * 7919) % num_timeouts;
+
+		timeout_remove(ids[index]);
+		ids[index] = timeout_add(spread(i, MAX_TIMEOUT), never_cb,
+								NULL, NULL);
+	}
+
+	report("timeout_remove+add", start, iterations);
+
+	for (i = 0; i < num_timeouts; i++)
+		timeout_remove(ids[i]);
+}
+
+struct expire_data {
+	double deadline;
+};
+
+static bool expire_cb(void *user_data)
+{
+	struct expire_data *data = user_data;
+	double late = now() - data->deadline;
+
+	if (late > 0) {
+		late_total += late;
+
+		if (late > late_max)
+			late_max = late;
+	}
+
+	if (++fired == num_timeouts)
+		mainloop_quit();
+
+	return false;
+}
+
+static void bench_expire(void)
+{
+	struct expire_data *data;
+	unsigned int i, timeout;
+	double cpu_start;
+
+	data = new0(struct expire_data, num_timeouts);
+
+	fired = 0;
+	late_total = 0;
+	late_max = 0;
+
+	for (i = 0; i < num_timeouts; i++) {
+		timeout = spread(i, EXPIRE_SPREAD);
+		data[i].deadline = now() + timeout / 1e3;
+		timeout_add(timeout, expire_cb, &data[i], NULL);
+	}
+
+	cpu_start = cpu_now();
+
+	mainloop_run();
+
+	printf("%-24s %10.0f ops/cpu-sec\n", "timeout expire",
+					fired / (cpu_now() - cpu_start));
+	printf("%u timeouts fired, late by %.3f ms on average, "
+				"%.3f ms at most\n", fired,
+				late_total / fired * 1e3, late_max * 1e3);
+
+	free(data);
+}
+
+static void usage(void)
+{
+	printf("timeoutbench - Timeout wheel benchmark\n"
+		"Usage:\n");
+	printf("\ttimeoutbench [options]\n");
+	printf("Options:\n"
+		"\t-t, --timeouts <num>    Number of pending timeouts "
+							"(default 100000)\n"
+		"\t-i, --iterations <num>  Number of timer restarts "
+							"(default 1000000)\n"
+		"\t-h, --help              Show help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "timeouts",	required_argument,	NULL, 't' },
+	{ "iterations",	required_argument,	NULL, 'i' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	num_timeouts = 100000;
+	iterations = 1000000;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "t:i:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 't':
+			num_timeouts = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!num_timeouts || num_timeouts > MAX_TIMEOUTS || !iterations) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	mainloop_init();
+
+	ids = new0(unsigned int, num_timeouts);
+
+	printf("%u timeouts, %u iterations\n", num_timeouts, iterations);
+
+	bench_add_remove();
+	bench_rearm();
+	bench_expire();
+
+	free(ids);
+
+	return EXIT_SUCCESS;
+}
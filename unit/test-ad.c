@@ -0,0 +1,511 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "bluetooth/bluetooth.h"
+#include "bluetooth/uuid.h"
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/ad.h"
+#include "src/shared/tester.h"
+
+static const uint8_t basic_data[] = {
+	0x02, BT_AD_FLAGS, 0x06,
+	0x05, BT_AD_UUID16_ALL, 0x0d, 0x18, 0x0f, 0x18,
+	0x05, BT_AD_NAME_COMPLETE, 'T', 'e', 's', 't',
+	0x02, BT_AD_TX_POWER, 0xf4,
+	0x06, BT_AD_MANUFACTURER_DATA, 0x4c, 0x00, 0x01, 0x02, 0x03,
+};
+
+/* The name claims more octets than there are left */
+static const uint8_t truncated_data[] = {
+	0x02, BT_AD_FLAGS, 0x06,
+	0x05, BT_AD_NAME_COMPLETE, 'T', 'e',
+};
+
+/* A zero length structure ends the significant part */
+static const uint8_t zero_len_data[] = {
+	0x02, BT_AD_FLAGS, 0x06,
+	0x00,
+	0x02, BT_AD_TX_POWER, 0x00,
+};
+
+static const uint8_t uuid_data[] = {
+	/* The trailing octet does not form a whole UUID */
+	0x04, BT_AD_UUID16_SOME, 0x0d, 0x18, 0x0f,
+	0x02, BT_AD_FLAGS, 0x06,
+	0x05, BT_AD_UUID32_ALL, 0x78, 0x56, 0x34, 0x12,
+	0x11, BT_AD_UUID128_ALL, 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00,
+	0x80, 0x00, 0x10, 0x00, 0x00, 0x0a, 0x18, 0x00, 0x00,
+};
+
+static const uint8_t service_data[] = {
+	/* Too short to hold the UUID */
+	0x02, BT_AD_SERVICE_DATA16, 0x0f,
+	0x04, BT_AD_SERVICE_DATA16, 0x0f, 0x18, 0x64,
+	0x06, BT_AD_SERVICE_DATA32, 0x78, 0x56, 0x34, 0x12, 0xaa,
+	0x11, BT_AD_SERVICE_DATA128, 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00,
+	0x80, 0x00, 0x10, 0x00, 0x00, 0x0a, 0x18, 0x00, 0x00,
+};
+
+static const uint8_t manufacturer_data[] = {
+	/* Too short to hold the company identifier */
+	0x02, BT_AD_MANUFACTURER_DATA, 0x4c,
+	0x05, BT_AD_MANUFACTURER_DATA, 0x4c, 0x00, 0x01, 0x02,
+	0x03, BT_AD_MANUFACTURER_DATA, 0x59, 0x00,
+};
+
+static void test_view_basic(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+	bt_uuid_t uuid;
+
+	bt_ad_view_init(&view, basic_data, sizeof(basic_data));
+
+	g_assert_cmpint(view.len, ==, sizeof(basic_data));
+	g_assert_cmpint(view.flags, ==, 0x06);
+	g_assert_cmpint(view.tx_power, ==, -12);
+	g_assert_cmpint(view.name_len, ==, 4);
+	g_assert(!memcmp(view.name, "Test", 4));
+	g_assert(view.name_complete);
+
+	g_assert(bt_ad_view_has_type(&view, BT_AD_UUID16_ALL));
+	g_assert(bt_ad_view_has_type(&view, BT_AD_MANUFACTURER_DATA));
+	g_assert(!bt_ad_view_has_type(&view, BT_AD_NAME_SHORT));
+
+	bt_uuid16_create(&uuid, 0x180f);
+	g_assert(bt_ad_view_has_service_uuid(&view, &uuid));
+
+	bt_uuid16_create(&uuid, 0x180a);
+	g_assert(!bt_ad_view_has_service_uuid(&view, &uuid));
+
+	bt_ad_iter_init(&iter, &view);
+	g_assert(bt_ad_iter_next_type(&iter, BT_AD_NAME_COMPLETE));
+	g_assert_cmpint(iter.len, ==, 4);
+	g_assert(iter.data == &basic_data[11]);
+
+	/* Every structure in order, then nothing */
+	bt_ad_iter_init(&iter, &view);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_FLAGS);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_UUID16_ALL);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_NAME_COMPLETE);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_TX_POWER);
+	g_assert(bt_ad_iter_next(&iter) &&
+				iter.type == BT_AD_MANUFACTURER_DATA);
+	g_assert(!bt_ad_iter_next(&iter));
+
+	tester_test_passed();
+}
+
+static void test_view_truncated(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+
+	bt_ad_view_init(&view, truncated_data, sizeof(truncated_data));
+
+	/* Only the structures before the truncated one are used */
+	g_assert_cmpint(view.len, ==, 3);
+	g_assert_cmpint(view.flags, ==, 0x06);
+	g_assert(view.name == NULL);
+	g_assert(!bt_ad_view_has_type(&view, BT_AD_NAME_COMPLETE));
+
+	bt_ad_iter_init(&iter, &view);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_FLAGS);
+	g_assert(!bt_ad_iter_next(&iter));
+
+	/* A length octet without its type */
+	bt_ad_view_init(&view, truncated_data, 4);
+	g_assert_cmpint(view.len, ==, 3);
+
+	tester_test_passed();
+}
+
+static void test_view_zero_len(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+
+	bt_ad_view_init(&view, zero_len_data, sizeof(zero_len_data));
+
+	g_assert_cmpint(view.len, ==, 3);
+	g_assert_cmpint(view.tx_power, ==, 127);
+	g_assert(!bt_ad_view_has_type(&view, BT_AD_TX_POWER));
+
+	bt_ad_iter_init(&iter, &view);
+	g_assert(bt_ad_iter_next(&iter) && iter.type == BT_AD_FLAGS);
+	g_assert(!bt_ad_iter_next(&iter));
+
+	/* No data at all */
+	bt_ad_view_init(&view, NULL, 0);
+	g_assert_cmpint(view.len, ==, 0);
+
+	bt_ad_iter_init(&iter, &view);
+	g_assert(!bt_ad_iter_next(&iter));
+
+	tester_test_passed();
+}
+
+static void test_iter_uuid(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+	bt_uuid_t uuid, expected;
+
+	bt_ad_view_init(&view, uuid_data, sizeof(uuid_data));
+	bt_ad_iter_init(&iter, &view);
+
+	g_assert(bt_ad_iter_next_uuid(&iter, &uuid));
+	bt_uuid16_create(&expected, 0x180d);
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+
+	g_assert(bt_ad_iter_next_uuid(&iter, &uuid));
+	bt_uuid32_create(&expected, 0x12345678);
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+
+	g_assert(bt_ad_iter_next_uuid(&iter, &uuid));
+	bt_string_to_uuid(&expected, "0000180a-0000-1000-8000-00805f9b34fb");
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+
+	g_assert(!bt_ad_iter_next_uuid(&iter, &uuid));
+
+	tester_test_passed();
+}
+
+static void test_iter_service_data(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+	bt_uuid_t uuid, expected;
+	const uint8_t *value;
+	uint8_t len;
+
+	bt_ad_view_init(&view, service_data, sizeof(service_data));
+	bt_ad_iter_init(&iter, &view);
+
+	g_assert(bt_ad_iter_next_service_data(&iter, &uuid, &value, &len));
+	bt_uuid16_create(&expected, 0x180f);
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+	g_assert_cmpint(len, ==, 1);
+	g_assert_cmpint(value[0], ==, 0x64);
+
+	g_assert(bt_ad_iter_next_service_data(&iter, &uuid, &value, &len));
+	bt_uuid32_create(&expected, 0x12345678);
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+	g_assert_cmpint(len, ==, 1);
+	g_assert_cmpint(value[0], ==, 0xaa);
+
+	g_assert(bt_ad_iter_next_service_data(&iter, &uuid, &value, &len));
+	bt_string_to_uuid(&expected, "0000180a-0000-1000-8000-00805f9b34fb");
+	g_assert(!bt_uuid_cmp(&uuid, &expected));
+	g_assert_cmpint(len, ==, 0);
+
+	g_assert(!bt_ad_iter_next_service_data(&iter, &uuid, &value, &len));
+
+	tester_test_passed();
+}
+
+static void test_iter_manufacturer_data(const void *data)
+{
+	struct bt_ad_view view;
+	struct bt_ad_iter iter;
+	const uint8_t *value;
+	uint16_t id;
+	uint8_t len;
+
+	bt_ad_view_init(&view, manufacturer_data, sizeof(manufacturer_data));
+	bt_ad_iter_init(&iter, &view);
+
+	g_assert(bt_ad_iter_next_manufacturer_data(&iter, &id, &value, &len));
+	g_assert_cmpint(id, ==, 0x004c);
+	g_assert_cmpint(len, ==, 2);
+	g_assert_cmpint(value[0], ==, 0x01);
+	g_assert_cmpint(value[1], ==, 0x02);
+
+	g_assert(bt_ad_iter_next_manufacturer_data(&iter, &id, &value, &len));
+	g_assert_cmpint(id, ==, 0x0059);
+	g_assert_cmpint(len, ==, 0);
+
+	g_assert(!bt_ad_iter_next_manufacturer_data(&iter, &id, &value,
+								&len));
+
+	tester_test_passed();
+}
+
+static bool view_matches(const struct bt_ad_view *view, uint8_t type,
+					size_t offset, size_t len,
+					const uint8_t *value)
+{
+	struct bt_ad_pattern *pattern;
+	struct queue *patterns;
+	bool ret;
+
+	pattern = bt_ad_pattern_new(type, offset, len, value);
+	g_assert(pattern);
+
+	patterns = queue_new();
+	queue_push_tail(patterns, pattern);
+
+	ret = bt_ad_view_pattern_match(view, patterns) == pattern;
+
+	queue_destroy(patterns, free);
+
+	return ret;
+}
+
+static void test_view_pattern_end(const void *data)
+{
+	const uint8_t tail[] = { 0x02, 0x03 };
+	const uint8_t battery[] = { 0x64 };
+	struct bt_ad_view view;
+
+	bt_ad_view_init(&view, basic_data, sizeof(basic_data));
+
+	/* Manufacturer data 4c 00 01 02 03 ends with the pattern */
+	g_assert(view_matches(&view, BT_AD_MANUFACTURER_DATA, 3, 2, tail));
+
+	/* One octet further runs past the end of the field */
+	g_assert(!view_matches(&view, BT_AD_MANUFACTURER_DATA, 4, 2, tail));
+	g_assert(!view_matches(&view, BT_AD_MANUFACTURER_DATA, 5, 1, tail));
+
+	bt_ad_view_init(&view, service_data, sizeof(service_data));
+
+	/* Service data is matched past the UUID */
+	g_assert(view_matches(&view, BT_AD_SERVICE_DATA16, 0, 1, battery));
+	g_assert(!view_matches(&view, BT_AD_SERVICE_DATA16, 1, 1, battery));
+
+	tester_test_passed();
+}
+
+struct match_result {
+	unsigned int count[4];
+};
+
+static void match_cb(void *match_data, void *user_data)
+{
+	struct match_result *result = user_data;
+
+	result->count[PTR_TO_UINT(match_data)]++;
+}
+
+static struct queue *pattern_list(uint8_t type, size_t offset, size_t len,
+							const uint8_t *value)
+{
+	struct queue *patterns = queue_new();
+
+	queue_push_tail(patterns, bt_ad_pattern_new(type, offset, len, value));
+
+	return patterns;
+}
+
+static unsigned int matcher_match(struct bt_ad_matcher *matcher,
+					const uint8_t *data, size_t len,
+					struct match_result *result)
+{
+	struct bt_ad_view view;
+
+	memset(result, 0, sizeof(*result));
+	bt_ad_view_init(&view, data, len);
+
+	return bt_ad_matcher_match(matcher, &view, match_cb, result);
+}
+
+static void test_matcher_basic(const void *data)
+{
+	const uint8_t name[] = { 'T', 'e', 's', 't' };
+	const uint8_t other[] = { 'N', 'o', 'p', 'e' };
+	struct bt_ad_matcher *matcher;
+	struct match_result result;
+	struct queue *patterns;
+
+	matcher = bt_ad_matcher_new();
+	g_assert(matcher);
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 0);
+
+	patterns = pattern_list(BT_AD_NAME_COMPLETE, 0, sizeof(name), name);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(1)));
+	queue_destroy(patterns, free);
+
+	patterns = pattern_list(BT_AD_NAME_COMPLETE, 0, sizeof(other), other);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(2)));
+	queue_destroy(patterns, free);
+
+	/* Empty pattern lists are refused */
+	patterns = queue_new();
+	g_assert(!bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(3)));
+	queue_destroy(patterns, NULL);
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 1);
+	g_assert_cmpint(result.count[1], ==, 1);
+	g_assert_cmpint(result.count[2], ==, 0);
+
+	g_assert(bt_ad_matcher_remove(matcher, UINT_TO_PTR(1)));
+	g_assert(!bt_ad_matcher_remove(matcher, UINT_TO_PTR(1)));
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 0);
+	g_assert_cmpint(result.count[1], ==, 0);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+static void test_matcher_offsets(const void *data)
+{
+	const uint8_t value[] = { 0x01 };
+	struct bt_ad_matcher *matcher;
+	struct match_result result;
+	struct queue *patterns;
+
+	matcher = bt_ad_matcher_new();
+
+	/* Manufacturer data is 4c 00 01 02 03 */
+	patterns = pattern_list(BT_AD_MANUFACTURER_DATA, 2, 1, value);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(1)));
+	queue_destroy(patterns, free);
+
+	patterns = pattern_list(BT_AD_MANUFACTURER_DATA, 3, 1, value);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(2)));
+	queue_destroy(patterns, free);
+
+	patterns = pattern_list(BT_AD_MANUFACTURER_DATA, 5, 1, value);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(3)));
+	queue_destroy(patterns, free);
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 1);
+	g_assert_cmpint(result.count[1], ==, 1);
+	g_assert_cmpint(result.count[2], ==, 0);
+	g_assert_cmpint(result.count[3], ==, 0);
+
+	/* Removing one offset leaves the others in place */
+	g_assert(bt_ad_matcher_remove(matcher, UINT_TO_PTR(2)));
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 1);
+	g_assert_cmpint(result.count[1], ==, 1);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+static void test_matcher_owner_once(const void *data)
+{
+	const uint8_t flags[] = { 0x06 };
+	const uint8_t name[] = { 'T', 'e' };
+	const uint8_t company[] = { 0x4c, 0x00 };
+	struct bt_ad_matcher *matcher;
+	struct match_result result;
+	struct queue *patterns;
+
+	matcher = bt_ad_matcher_new();
+
+	/* Several patterns of one owner match the same report */
+	patterns = queue_new();
+	queue_push_tail(patterns, bt_ad_pattern_new(BT_AD_FLAGS, 0,
+						sizeof(flags), flags));
+	queue_push_tail(patterns, bt_ad_pattern_new(BT_AD_NAME_COMPLETE, 0,
+						sizeof(name), name));
+	queue_push_tail(patterns, bt_ad_pattern_new(BT_AD_MANUFACTURER_DATA,
+						0, sizeof(company), company));
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(1)));
+	queue_destroy(patterns, free);
+
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 1);
+	g_assert_cmpint(result.count[1], ==, 1);
+
+	/* And again on the next report */
+	g_assert_cmpint(matcher_match(matcher, basic_data,
+					sizeof(basic_data), &result), ==, 1);
+	g_assert_cmpint(result.count[1], ==, 1);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+static void test_matcher_data(const void *data)
+{
+	const uint8_t battery[] = { 0x64 };
+	const uint8_t uuid32_data[] = { 0xaa };
+	const uint8_t company[] = { 0x59, 0x00 };
+	struct bt_ad_matcher *matcher;
+	struct match_result result;
+	struct queue *patterns;
+
+	matcher = bt_ad_matcher_new();
+
+	/* Service data is matched past its UUID, whatever its size */
+	patterns = pattern_list(BT_AD_SERVICE_DATA16, 0, 1, battery);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(1)));
+	queue_destroy(patterns, free);
+
+	patterns = pattern_list(BT_AD_SERVICE_DATA32, 0, 1, uuid32_data);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(2)));
+	queue_destroy(patterns, free);
+
+	patterns = pattern_list(BT_AD_MANUFACTURER_DATA, 0, sizeof(company),
+								company);
+	g_assert(bt_ad_matcher_add(matcher, patterns, UINT_TO_PTR(3)));
+	queue_destroy(patterns, free);
+
+	g_assert_cmpint(matcher_match(matcher, service_data,
+					sizeof(service_data), &result), ==, 2);
+	g_assert_cmpint(result.count[1], ==, 1);
+	g_assert_cmpint(result.count[2], ==, 1);
+	g_assert_cmpint(result.count[3], ==, 0);
+
+	g_assert_cmpint(matcher_match(matcher, manufacturer_data,
+				sizeof(manufacturer_data), &result), ==, 1);
+	g_assert_cmpint(result.count[3], ==, 1);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/ad/view/basic", NULL, NULL, test_view_basic, NULL);
+	tester_add("/ad/view/truncated", NULL, NULL, test_view_truncated,
+									NULL);
+	tester_add("/ad/view/zero-length", NULL, NULL, test_view_zero_len,
+									NULL);
+	tester_add("/ad/view/pattern-end", NULL, NULL, test_view_pattern_end,
+									NULL);
+	tester_add("/ad/iter/uuid", NULL, NULL, test_iter_uuid, NULL);
+	tester_add("/ad/iter/service-data", NULL, NULL,
+						test_iter_service_data, NULL);
+	tester_add("/ad/iter/manufacturer-data", NULL, NULL,
+					test_iter_manufacturer_data, NULL);
+	tester_add("/ad/matcher/basic", NULL, NULL, test_matcher_basic, NULL);
+	tester_add("/ad/matcher/offsets", NULL, NULL, test_matcher_offsets,
+									NULL);
+	tester_add("/ad/matcher/owner-once", NULL, NULL,
+						test_matcher_owner_once, NULL);
+	tester_add("/ad/matcher/data", NULL, NULL, test_matcher_data, NULL);
+
+	return tester_run();
+}
@@ -2336,6 +2336,34 @@ static const struct test_step test_notification_server_1 = {
 	.length = 0x03,
 };
 
+static void test_server_notification_pdu(struct context *context)
+{
+	const struct test_step *step = context->data->step;
+	struct bt_att_pdu *pdu;
+
+	pdu = bt_gatt_server_notification_pdu_new(step->handle, step->value,
+							step->length);
+	g_assert(pdu);
+
+	g_assert(bt_gatt_server_send_notification_pdu(context->server, pdu));
+
+	bt_att_pdu_unref(pdu);
+}
+
+static const struct test_step test_notification_server_2 = {
+	.handle = 0x0003,
+	.func = test_server_notification_pdu,
+	.value = read_data_1,
+	.length = 0x03,
+};
+
+static const struct test_step test_notification_server_3 = {
+	.handle = 0x0003,
+	.func = test_server_notification_pdu,
+	.value = long_data_2,
+	.length = 0x20,
+};
+
 static uint8_t indication_received;
 
 static void test_indication_cb(void *user_data)
@@ -2412,6 +2440,41 @@ static void test_hash_db(gconstpointer data)
 	context_quit(context);
 }
 
+static void test_export_db(gconstpointer data)
+{
+	const struct test_data *test_data = data;
+	struct gatt_db *db;
+	uint8_t *buf, *copy;
+	size_t len, copy_len;
+
+	buf = gatt_db_export(test_data->source_db, &len);
+	g_assert(buf);
+
+	db = gatt_db_new();
+	g_assert(gatt_db_import(db, buf, len));
+
+	/* Exporting the imported database shall produce the same data */
+	copy = gatt_db_export(db, &copy_len);
+	g_assert(copy);
+	g_assert_cmpuint(len, ==, copy_len);
+	g_assert(!memcmp(buf, copy, len));
+
+	if (gatt_db_hash_support(db))
+		g_assert(!memcmp(gatt_db_get_hash(db),
+				gatt_db_get_hash(test_data->source_db), 16));
+
+	/* Truncated data shall be rejected without leaving any service */
+	gatt_db_clear(db);
+	g_assert(!gatt_db_import(db, buf, len - 1));
+	g_assert(gatt_db_isempty(db));
+
+	free(copy);
+	free(buf);
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	struct gatt_db *service_db_1, *service_db_2, *service_db_3;
@@ -3337,6 +3400,24 @@ int main(int argc, char *argv[])
 			raw_pdu(),
 			raw_pdu(0x1B, 0x03, 0x00, 0x01, 0x02, 0x03));
 
+	define_test_server("/TP/GAN/SR/BV-01-C/shared-1", test_server,
+			ts_small_db, &test_notification_server_2,
+			raw_pdu(0x03, 0x00, 0x02),
+			raw_pdu(0x12, 0x04, 0x00, 0x01, 0x00),
+			raw_pdu(0x13),
+			raw_pdu(),
+			raw_pdu(0x1B, 0x03, 0x00, 0x01, 0x02, 0x03));
+
+	define_test_server("/TP/GAN/SR/BV-01-C/shared-2", test_server,
+			ts_small_db, &test_notification_server_3,
+			raw_pdu(0x03, 0x00, 0x02),
+			raw_pdu(0x12, 0x04, 0x00, 0x01, 0x00),
+			raw_pdu(0x13),
+			raw_pdu(),
+			raw_pdu(0x1B, 0x03, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff));
+
 	define_test_server("/TP/GAI/SR/BV-01-C", test_server, ts_small_db,
 			&test_indication_server_1,
 			raw_pdu(0x03, 0x00, 0x02),
@@ -4559,5 +4640,13 @@ int main(int argc, char *argv[])
 			test_hash_db, ts_tail_db, NULL,
 			{});
 
+	define_test_server("/robustness/export-db/small",
+			test_export_db, ts_small_db, NULL,
+			{});
+
+	define_test_server("/robustness/export-db/large-1",
+			test_export_db, ts_large_db_1, NULL,
+			{});
+
 	return tester_run();
 }
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sys/stat.h>
+
+#include "mesh/mesh-config-json.c"
+
+#define UPDATES		1000
+
+static const uint8_t test_uuid[16] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+	0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static char cfg_dir[] = "/tmp/mesh-config-XXXXXX";
+static char node_dir[PATH_MAX];
+static char node_path[PATH_MAX];
+
+static ino_t node_inode(void)
+{
+	struct stat st;
+
+	if (stat(node_path, &st) < 0) {
+		l_info("Missing %s", node_path);
+		exit(1);
+	}
+
+	return st.st_ino;
+}
+
+static int stored_ttl(void)
+{
+	json_object *jnode, *jvalue;
+	int ttl;
+
+	jnode = json_object_from_file(node_path);
+	if (!jnode) {
+		l_info("Failed to parse %s", node_path);
+		exit(1);
+	}
+
+	if (!json_object_object_get_ex(jnode, defaultTTL, &jvalue)) {
+		l_info("No %s in %s", defaultTTL, node_path);
+		exit(1);
+	}
+
+	ttl = json_object_get_int(jvalue);
+	json_object_put(jnode);
+
+	return ttl;
+}
+
+static uint64_t elapsed_us(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - start->tv_sec) * 1000000 +
+					now.tv_usec - start->tv_usec + 1;
+}
+
+static struct mesh_config *create_node(void)
+{
+	struct mesh_config_node node;
+	struct mesh_config *cfg;
+
+	memset(&node, 0, sizeof(node));
+
+	cfg = mesh_config_create(cfg_dir, test_uuid, &node);
+	if (!cfg) {
+		l_info("Failed to create node in %s", cfg_dir);
+		exit(1);
+	}
+
+	return cfg;
+}
+
+static void test_batched(void)
+{
+	struct mesh_config *cfg;
+	struct timeval start;
+	uint64_t usec;
+	ino_t ino;
+	int i;
+
+	l_info("[Batched writes]");
+
+	cfg = create_node();
+	ino = node_inode();
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < UPDATES; i++) {
+		if (!mesh_config_write_ttl(cfg, i & TTL_MASK)) {
+			l_info("Update %d failed", i);
+			exit(1);
+		}
+	}
+
+	/* Nothing may hit the disk before the flush */
+	if (node_inode() != ino || !cfg->dirty || !cfg->flush_to) {
+		l_info("Configuration written before the flush");
+		exit(1);
+	}
+
+	if (!mesh_config_sync(cfg) || node_inode() == ino || cfg->dirty) {
+		l_info("Configuration not written by sync");
+		exit(1);
+	}
+
+	usec = elapsed_us(&start);
+
+	if (stored_ttl() != ((UPDATES - 1) & TTL_MASK)) {
+		l_info("Stored TTL %d is not the last one", stored_ttl());
+		exit(1);
+	}
+
+	/* A sync without changes must not write */
+	ino = node_inode();
+
+	if (!mesh_config_sync(cfg) || node_inode() != ino) {
+		l_info("Clean configuration written again");
+		exit(1);
+	}
+
+	l_info("%d updates in 1 write, %" PRIu64 " updates per second",
+					UPDATES, (uint64_t) UPDATES * 1000000 / usec);
+
+	mesh_config_destroy_nvm(cfg);
+	mesh_config_release(cfg);
+}
+
+static void test_write_through(void)
+{
+	struct mesh_config *cfg;
+	struct timeval start;
+	uint64_t usec;
+	ino_t ino;
+	int i;
+
+	l_info("[Write-through]");
+
+	cfg = create_node();
+	mesh_config_set_write_through(cfg, true);
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < UPDATES; i++) {
+		ino = node_inode();
+
+		if (!mesh_config_write_ttl(cfg, i & TTL_MASK)) {
+			l_info("Update %d failed", i);
+			exit(1);
+		}
+
+		if (node_inode() == ino || cfg->dirty || cfg->flush_to) {
+			l_info("Update %d not written through", i);
+			exit(1);
+		}
+	}
+
+	usec = elapsed_us(&start);
+
+	if (stored_ttl() != ((UPDATES - 1) & TTL_MASK)) {
+		l_info("Stored TTL %d is not the last one", stored_ttl());
+		exit(1);
+	}
+
+	l_info("%d updates in %d writes, %" PRIu64 " writes per second",
+				UPDATES, UPDATES, (uint64_t) UPDATES * 1000000 / usec);
+
+	mesh_config_set_write_through(cfg, false);
+	mesh_config_destroy_nvm(cfg);
+	mesh_config_release(cfg);
+}
+
+static void test_write_failure(void)
+{
+	struct mesh_config *cfg;
+
+	l_info("[Write failure]");
+
+	cfg = create_node();
+	mesh_config_set_write_through(cfg, true);
+
+	/* Pull the storage from under the node */
+	del_path(node_dir);
+
+	if (mesh_config_write_ttl(cfg, 5)) {
+		l_info("Failed write reported as success");
+		exit(1);
+	}
+
+	/* The change stays pending, so that a later write retries it */
+	if (!cfg->dirty) {
+		l_info("Failed change dropped");
+		exit(1);
+	}
+
+	mesh_config_set_write_through(cfg, false);
+	mesh_config_destroy_nvm(cfg);
+	mesh_config_release(cfg);
+}
+
+int main(int argc, char *argv[])
+{
+	char uuid[33];
+
+	l_log_set_stderr();
+	l_main_init();
+
+	if (!mkdtemp(cfg_dir)) {
+		l_info("Failed to create %s", cfg_dir);
+		exit(1);
+	}
+
+	hex2str((uint8_t *) test_uuid, 16, uuid, sizeof(uuid));
+	snprintf(node_dir, sizeof(node_dir), "%s/%s", cfg_dir, uuid);
+	snprintf(node_path, sizeof(node_path), "%s%s", node_dir, cfgnode_name);
+
+	test_batched();
+	test_write_through();
+	test_write_failure();
+
+	del_path(cfg_dir);
+	l_main_exit();
+
+	return 0;
+}
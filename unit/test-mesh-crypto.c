@@ -14,6 +14,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include "client/display.h"
 
@@ -2128,6 +2130,54 @@ static void check_k4(const struct mesh_crypto_test *keys)
 	l_info("");
 }
 
+#define DECODE_RATE_COUNT	10000
+
+static void check_decode_rate(const struct mesh_crypto_test *keys)
+{
+	uint8_t *net_key;
+	uint8_t *packet;
+	uint8_t enc_key[16];
+	uint8_t priv_key[16];
+	uint8_t net_clr[29];
+	uint8_t nid, p = 0;
+	size_t packet_len;
+	struct timespec start, end;
+	uint64_t elapsed;
+	unsigned int i;
+	bool status = true;
+
+	l_info(COLOR_BLUE "[Decode rate %s]" COLOR_OFF, keys->name);
+
+	net_key = l_util_from_hexstring(keys->net_key, NULL);
+	packet = l_util_from_hexstring(keys->packet[0], &packet_len);
+	mesh_crypto_k2(net_key, &p, 1, &nid, enc_key, priv_key);
+
+	mesh_crypto_key_ref(enc_key);
+	mesh_crypto_key_ref(priv_key);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; status && i < DECODE_RATE_COUNT; i++)
+		status = mesh_crypto_packet_decode(packet, packet_len, false,
+						net_clr, keys->iv_index,
+						enc_key, priv_key);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	mesh_crypto_key_unref(priv_key);
+	mesh_crypto_key_unref(enc_key);
+
+	verify_bool("Crypto Decode", 0, true, status);
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1000000ULL +
+					(end.tv_nsec - start.tv_nsec) / 1000;
+	l_info("%u packets in %" PRIu64 " usec (%" PRIu64 " packets/sec)", i,
+				elapsed, elapsed ? i * 1000000ULL / elapsed : 0);
+
+	l_free(packet);
+	l_free(net_key);
+}
+
 int main(int argc, char *argv[])
 {
 	l_log_set_stderr();
@@ -2173,6 +2223,7 @@ int main(int argc, char *argv[])
 	check_decrypt(&s8_3_11); /* Single segment tester unavailable */
 	check_encrypt(&s8_3_22);
 	check_decrypt(&s8_3_22);
+	check_decode_rate(&s8_3_1);
 
 	/* Section 8.4 Beacon Sample Data */
 	check_beacon(&s8_4_3);
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "mesh/msg-cache.c"
+
+#define STRESS_PACKETS	100000
+
+/*
+ * Reference model: a plain FIFO of the last size distinct entries, searched
+ * linearly.
+ */
+struct fifo_model {
+	struct cache_entry *entries;
+	unsigned int size;
+	unsigned int head;
+	unsigned int count;
+};
+
+static void fifo_init(struct fifo_model *fifo, unsigned int size)
+{
+	fifo->entries = l_new(struct cache_entry, size);
+	fifo->size = size;
+	fifo->head = 0;
+	fifo->count = 0;
+}
+
+static bool fifo_check(struct fifo_model *fifo, uint64_t key, uint32_t ext)
+{
+	unsigned int i;
+
+	for (i = 0; i < fifo->count; i++) {
+		if (fifo->entries[i].key == key && fifo->entries[i].ext == ext)
+			return true;
+	}
+
+	fifo->entries[fifo->head].key = key;
+	fifo->entries[fifo->head].ext = ext;
+	fifo->head = (fifo->head + 1) % fifo->size;
+
+	if (fifo->count < fifo->size)
+		fifo->count++;
+
+	return false;
+}
+
+static uint32_t rand_state = 0x12345678;
+
+/* xorshift32, so that failures can be reproduced */
+static uint32_t next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static void check_basic(void)
+{
+	struct msg_cache *cache = msg_cache_new(4);
+
+	l_info("[Insert and lookup]");
+
+	if (msg_cache_check(cache, 1, 0) || msg_cache_check(cache, 2, 0))
+		exit(1);
+
+	if (!msg_cache_check(cache, 1, 0) || !msg_cache_check(cache, 2, 0))
+		exit(1);
+
+	/* The extension is part of the key */
+	if (msg_cache_check(cache, 1, 1) || !msg_cache_check(cache, 1, 1))
+		exit(1);
+
+	msg_cache_free(cache);
+}
+
+static void check_evict(void)
+{
+	struct msg_cache *cache = msg_cache_new(3);
+	uint64_t key;
+
+	l_info("[Eviction order]");
+
+	for (key = 1; key <= 4; key++) {
+		if (msg_cache_check(cache, key, 0))
+			exit(1);
+	}
+
+	/* The oldest entry made room for the fourth */
+	if (msg_cache_check(cache, 1, 0))
+		exit(1);
+
+	/* 1 evicted 2 in turn, 3 and 4 are still cached */
+	if (!msg_cache_check(cache, 3, 0) || !msg_cache_check(cache, 4, 0))
+		exit(1);
+
+	if (msg_cache_check(cache, 2, 0))
+		exit(1);
+
+	msg_cache_free(cache);
+}
+
+static void check_clear(void)
+{
+	struct msg_cache *cache = msg_cache_new(4);
+
+	l_info("[Clear]");
+
+	msg_cache_check(cache, 1, 0);
+	msg_cache_clear(cache);
+
+	if (msg_cache_check(cache, 1, 0) || !msg_cache_check(cache, 1, 0))
+		exit(1);
+
+	msg_cache_free(cache);
+}
+
+/*
+ * Feeds the cache and the model the same packets, keys are drawn from a
+ * range a few times the cache size so that hits, misses and evictions all
+ * happen, including colliding hash chains being shifted back.
+ */
+static void check_model(uint16_t size, uint32_t range)
+{
+	struct msg_cache *cache = msg_cache_new(size);
+	struct fifo_model fifo;
+	unsigned int i, hits = 0;
+
+	l_info("[FIFO model, size %u, %u keys]", size, range);
+
+	fifo_init(&fifo, size);
+
+	for (i = 0; i < STRESS_PACKETS; i++) {
+		uint32_t r = next_rand() % range;
+		uint64_t key = ((uint64_t) r << 32) | (r * 0x9e3779b1);
+		uint32_t ext = r & 0x3;
+		bool cached = msg_cache_check(cache, key, ext);
+
+		if (cached != fifo_check(&fifo, key, ext)) {
+			l_info("Mismatch at packet %u: key %" PRIx64
+					" ext %u cached %d", i, key, ext,
+					cached);
+			exit(1);
+		}
+
+		hits += cached;
+	}
+
+	l_info("%u hits in %u packets", hits, STRESS_PACKETS);
+
+	l_free(fifo.entries);
+	msg_cache_free(cache);
+}
+
+int main(int argc, char *argv[])
+{
+	l_log_set_stderr();
+
+	check_basic();
+	check_evict();
+	check_clear();
+
+	check_model(1, 4);
+	check_model(8, 24);
+	check_model(70, 200);
+	check_model(70, 70);
+	check_model(1000, 4000);
+
+	return 0;
+}
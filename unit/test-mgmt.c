@@ -29,14 +29,18 @@ struct context {
 	struct mgmt *mgmt_client;
 	guint server_source;
 	GList *handler_list;
+	unsigned int count;
 };
 
 enum action {
 	ACTION_PASSED,
 	ACTION_IGNORE,
 	ACTION_RESPOND,
+	ACTION_CALL,
 };
 
+typedef void (*handler_func_t)(struct context *context, int fd);
+
 struct handler {
 	const void *cmd_data;
 	uint16_t cmd_size;
@@ -45,6 +49,7 @@ struct handler {
 	uint8_t rsp_status;
 	bool match_prefix;
 	enum action action;
+	handler_func_t func;
 };
 
 static void mgmt_debug(const char *str, void *user_data)
@@ -90,6 +95,9 @@ static void check_actions(struct context *context, int fd,
 			return;
 		case ACTION_IGNORE:
 			return;
+		case ACTION_CALL:
+			handler->func(context, fd);
+			return;
 		}
 	}
 
@@ -191,6 +199,19 @@ static void add_action(struct context *context,
 	context->handler_list = g_list_append(context->handler_list, handler);
 }
 
+static void add_call(struct context *context, const void *cmd_data,
+				uint16_t cmd_size, handler_func_t func)
+{
+	struct handler *handler = g_new0(struct handler, 1);
+
+	handler->cmd_data = cmd_data;
+	handler->cmd_size = cmd_size;
+	handler->action = ACTION_CALL;
+	handler->func = func;
+
+	context->handler_list = g_list_append(context->handler_list, handler);
+}
+
 struct command_test_data {
 	uint16_t opcode;
 	uint16_t index;
@@ -243,6 +264,14 @@ static const struct command_test_data command_test_3 = {
 	.rsp_status = MGMT_STATUS_INVALID_INDEX,
 };
 
+static const unsigned char read_info_index_0[] =
+				{ 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const unsigned char read_info_index_1[] =
+				{ 0x04, 0x00, 0x01, 0x00, 0x00, 0x00 };
+static const unsigned char read_info_index_0_response[] =
+				{ 0x01, 0x00, 0x00, 0x00, 0x03, 0x00,
+				0x04, 0x00, 0x00 };
+
 static const unsigned char event_index_added[] =
 				{ 0x04, 0x00, 0x01, 0x00, 0x00, 0x00 };
 
@@ -269,6 +298,51 @@ static void test_command(gconstpointer data)
 	execute_context(context);
 }
 
+static void window_index_0(struct context *context, int fd)
+{
+	/* The second command is only written once the first completed */
+	if (++context->count == 2)
+		context_quit(context);
+}
+
+static void window_index_1(struct context *context, int fd)
+{
+	ssize_t ret;
+
+	/* Index 0 has not responded yet, which must not block index 1 */
+	g_assert_cmpint(context->count, ==, 1);
+
+	ret = write(fd, read_info_index_0_response,
+					sizeof(read_info_index_0_response));
+	g_assert(ret >= 0);
+}
+
+static void test_window(gconstpointer data)
+{
+	struct context *context = create_context();
+
+	/*
+	 * With a window of 2 the second command to index 0 is only held
+	 * back since completions cannot tell apart two outstanding commands
+	 * with the same opcode.
+	 */
+	mgmt_set_window(context->mgmt_client, GPOINTER_TO_UINT(data));
+
+	add_call(context, read_info_index_0, sizeof(read_info_index_0),
+							window_index_0);
+	add_call(context, read_info_index_1, sizeof(read_info_index_1),
+							window_index_1);
+
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_INFO, 0, 0, NULL,
+							NULL, NULL, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_INFO, 0, 0, NULL,
+							NULL, NULL, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_INFO, 1, 0, NULL,
+							NULL, NULL, NULL);
+
+	execute_context(context);
+}
+
 static void response_cb(uint8_t status, uint16_t length, const void *param,
 							void *user_data)
 {
@@ -423,6 +497,11 @@ int main(int argc, char *argv[])
 	g_test_add_data_func("/mgmt/command/1", &command_test_1, test_command);
 	g_test_add_data_func("/mgmt/command/2", &command_test_2, test_command);
 
+	g_test_add_data_func("/mgmt/window/1", GUINT_TO_POINTER(1),
+								test_window);
+	g_test_add_data_func("/mgmt/window/2", GUINT_TO_POINTER(2),
+								test_window);
+
 	g_test_add_data_func("/mgmt/response/1", &command_test_1,
 								test_response);
 	g_test_add_data_func("/mgmt/response/2", &command_test_3,